@@ -19,14 +19,23 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE := cocos2dx-db
 LOCAL_SRC_FILES := $(call all-cpp-files-under,src)
+
+# NEON column kernels, .neon suffix builds only that file with -mfpu=neon
+# they are picked at runtime so armeabi-v7a devices without NEON still work
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_SRC_FILES := $(patsubst src/CCColumnKernelsNeon.cpp,src/CCColumnKernelsNeon.cpp.neon,$(LOCAL_SRC_FILES))
+endif
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/include \
                     $(LOCAL_PATH)/include/platform/android
 LOCAL_EXPORT_LDLIBS := -L$(LOCAL_PATH)/system_libs/$(TARGET_ARCH) -lsqlite
 LOCAL_C_INCLUDES := $(LOCAL_EXPORT_C_INCLUDES)
 LOCAL_LDLIBS := $(LOCAL_EXPORT_LDLIBS)
-LOCAL_WHOLE_STATIC_LIBRARIES := cocos2dx_static cocos2dx-common
+LOCAL_WHOLE_STATIC_LIBRARIES := cocos2dx_static cocos_extension_static cocos2dx-common
+LOCAL_STATIC_LIBRARIES := cpufeatures
 
 include $(BUILD_STATIC_LIBRARY)
 
 $(call import-module,cocos2dx)
+$(call import-module,extensions)
 $(call import-module,cocos2dx-common)
+$(call import-module,android/cpufeatures)
@@ -0,0 +1,193 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCAggregateView_h__
+#define __CCAggregateView_h__
+
+#include "cocos2d.h"
+
+struct sqlite3_stmt;
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * Count, sum, min and max of a table column grouped by a key, maintained incrementally so
+ * reading them doesn't scan table.
+ * \code
+ * // score summary per player
+ * CCAggregateView* v = CCAggregateView::create(db, "score_stats", "score", "player", "points");
+ * v->install();
+ * int64_t games = v->countForKey(playerId);
+ * double best = v->maxForKey(playerId);
+ * \endcode
+ *
+ * \par maintenance
+ * Aggregates are stored in a summary table named as view, one row per group, and generated
+ * insert, update and delete triggers on source table apply every change to its group. Sum
+ * and count are adjusted by delta. Min and max are adjusted by delta on insert, and only
+ * when removed value is current min or max, they are recomputed from rows of that group.
+ * Because triggers live in database, changes from any connection or raw sql are applied and
+ * summary survives restart. Row replaced by INSERT OR REPLACE fires delete trigger only if
+ * PRAGMA recursive_triggers is on, install turns it on for this connection, other connections
+ * which write source table must turn it on too, otherwise replaced rows are counted twice.
+ *
+ * \par lookup
+ * Reading a group is a primary key lookup of summary table with a cached statement.
+ *
+ * \note
+ * Rows whose group key is null are not aggregated. Null values are counted but don't
+ * affect sum, min and max.
+ */
+class CC_DLL CCAggregateView : public CCObject {
+public:
+	/// aggregates of a group
+	struct Aggregate {
+		/// row count
+		int64_t count;
+
+		/// sum of non-null values
+		double sum;
+
+		/// min of non-null values, 0 if no value
+		double min;
+
+		/// max of non-null values, 0 if no value
+		double max;
+
+		/// false if group has no non-null value
+		bool hasValue;
+
+		Aggregate() : count(0), sum(0), min(0), max(0), hasValue(false) {}
+	};
+
+private:
+	/// database
+	CCDatabase* m_db;
+
+	/// summary table name
+	string m_name;
+
+	/// source table name
+	string m_table;
+
+	/// group column, empty if whole table is one group
+	string m_groupColumn;
+
+	/// value column, empty if only rows are counted
+	string m_valueColumn;
+
+	/// select of a group
+	string m_selectSQL;
+
+private:
+	/// generate trigger sql
+	string triggerSQL(const char* suffix, const char* event, const string& body);
+
+	/// statements removing OLD row from its group
+	string removeSQL();
+
+	/// statements adding NEW row to its group
+	string addSQL();
+
+	/// get statement of a sql for binding, or NULL
+	sqlite3_stmt* beginLookup(const string& sql);
+
+	/// step lookup statement, read result and give statement back
+	bool endLookup(const string& sql, sqlite3_stmt* stmt, Aggregate& out);
+
+	/// run statements in a transaction if there is no transaction
+	bool executeAll(const vector<string>& sqls);
+
+protected:
+	CCAggregateView();
+
+	/// initialization
+	bool initWithTable(CCDatabase* db, const string& name, const string& table, const string& groupColumn, const string& valueColumn);
+
+public:
+	virtual ~CCAggregateView();
+
+	/**
+	 * create an aggregate view, install must be called before it is read
+	 *
+	 * @param db database
+	 * @param name summary table name, also prefix of trigger names
+	 * @param table source table
+	 * @param groupColumn group key column, empty means whole table is one group
+	 * @param valueColumn column of sum, min and max, empty means only rows are counted
+	 * @return view, autoreleased
+	 */
+	static CCAggregateView* create(CCDatabase* db, const string& name, const string& table, const string& groupColumn, const string& valueColumn = "");
+
+	/**
+	 * create summary table if it is not existent and (re)create triggers. If summary table is
+	 * created, it is filled from source table by one grouped scan. It runs in a transaction
+	 * if there is no transaction. It also turns on PRAGMA recursive_triggers for connection,
+	 * so call it again after database is opened again
+	 *
+	 * @return true if successful
+	 */
+	bool install();
+
+	/// drop triggers and summary table
+	bool uninstall();
+
+	/// refill summary table from source table, useful if source was changed while triggers were dropped
+	bool rebuild();
+
+	/// get aggregates of a group, return false if group has no row. Key type should match stored key
+	bool getAggregate(const string& key, Aggregate& out);
+
+	/// get aggregates of a group, return false if group has no row. Key type should match stored key
+	bool getAggregate(int64_t key, Aggregate& out);
+
+	/// get aggregates of all groups, reads every group row but not source table
+	bool getTotal(Aggregate& out);
+
+	/// get row count of a group
+	template<typename K>
+	int64_t countForKey(const K& key) { Aggregate a; getAggregate(key, a); return a.count; }
+
+	/// get sum of a group
+	template<typename K>
+	double sumForKey(const K& key) { Aggregate a; getAggregate(key, a); return a.sum; }
+
+	/// get min of a group
+	template<typename K>
+	double minForKey(const K& key) { Aggregate a; getAggregate(key, a); return a.min; }
+
+	/// get max of a group
+	template<typename K>
+	double maxForKey(const K& key) { Aggregate a; getAggregate(key, a); return a.max; }
+
+	/// get summary table name
+	const string& getName() { return m_name; }
+};
+
+NS_CC_END
+
+#endif // __CCAggregateView_h__
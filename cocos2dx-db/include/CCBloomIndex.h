@@ -0,0 +1,239 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCBloomIndex_h__
+#define __CCBloomIndex_h__
+
+#include "cocos2d.h"
+
+struct sqlite3_stmt;
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * In-memory Bloom filter of values in a table column, created by CCDatabase::addBloomIndex.
+ * It answers "is this value in column" without sqlite when answer is no, which is the
+ * common case of existence checks such as whether player has seen an item.
+ * \code
+ * CCBloomIndex* seen = db->addBloomIndex("seen_items", "item_id", 10000);
+ * if(seen->contains(itemId)) ...
+ * \endcode
+ *
+ * \par maintenance
+ * Filter is built from column when it is first used after database is opened. Update hook
+ * reports rowids of inserted and updated rows, their values are added before next lookup.
+ * A filter can't remove values, so deleted rows only count up until filter is rebuilt,
+ * which happens when deleted or added rows exceed its capacity. Filter is always a superset
+ * of column, so a negative answer is exact.
+ *
+ * \par matching
+ * Values are hashed by text form, integer 5 and text "5" are same value. Float values which
+ * are integral are same as integers. If column has numeric affinity, a text value which looks
+ * like a number is hashed in canonical form, "05" and "1.50" are same as 5 and 1.5, same as
+ * sqlite converts them. Column declared with a collation other than BINARY, such as NOCASE,
+ * is not supported because its equal values have different text, filter is not built for it
+ * and every lookup answers maybe.
+ *
+ * \note
+ * Changes by other connections and WITHOUT ROWID tables are not seen by update hook, use
+ * rebuild if table is changed that way.
+ */
+class CC_DLL CCBloomIndex : public CCObject {
+	friend class CCDatabase;
+
+private:
+	/// database, not retained because database owns index
+	CCDatabase* m_db;
+
+	/// filter bits
+	vector<uint32_t> m_bits;
+
+	/// bit count
+	uint32_t m_bitCount;
+
+	/// hash function count
+	int m_hashCount;
+
+	/// wanted false positive rate
+	double m_targetRate;
+
+	/// expected value count given by user
+	int m_expectedCount;
+
+	/// value count filter is sized for
+	int m_capacity;
+
+	/// values added since build
+	int m_count;
+
+	/// rows deleted since build
+	int m_deletedCount;
+
+	/// rows inserted or updated but not added yet
+	vector<int64_t> m_pendingRows;
+
+	/// true if filter must be built before use
+	bool m_stale;
+
+	/// true if column collation is not BINARY so filter can't be built
+	bool m_unsupported;
+
+	/// true if column has numeric affinity, text values are normalized then
+	bool m_numeric;
+
+	/// statement reading column by rowid
+	sqlite3_stmt* m_rowStmt;
+
+	/// statement checking value in table
+	sqlite3_stmt* m_existsStmt;
+
+	/// statistics
+	int m_lookups;
+	int m_negatives;
+	int m_checks;
+	int m_falsePositives;
+
+	/// table name
+	CC_SYNTHESIZE_READONLY_PASS_BY_REF(string, m_table, TableName);
+
+	/// column name
+	CC_SYNTHESIZE_READONLY_PASS_BY_REF(string, m_column, ColumnName);
+
+	/// times filter is built
+	CC_SYNTHESIZE_READONLY(int, m_buildCount, BuildCount);
+
+private:
+	/// hash a value text
+	static uint64_t hash(const char* p, size_t len);
+
+	/// get text form of a column value, return false if it is null
+	static bool textOf(sqlite3_stmt* stmt, int columnIdx, string& out);
+
+	/// text form of an integer
+	static string textOf(int64_t value);
+
+	/// text form of a float, integral value has same form as integer
+	static string textOf(double value);
+
+	/// get canonical text of a numeric text, return false if text doesn't look like a number
+	static bool normalizeNumber(const string& text, string& out);
+
+	/// check declared collation of a column in create table sql is BINARY
+	static bool isBinaryCollation(const string& createSQL, const string& column);
+
+	/// read collation and affinity of column, return false if column is not supported
+	bool checkColumn();
+
+	/// add a value text
+	void addText(const string& text);
+
+	/// test a value text
+	bool testText(const string& text);
+
+	/// prepare a kept statement
+	bool prepare(sqlite3_stmt** stmt, const string& sql);
+
+	/// build filter if stale and add pending rows, return false if filter can't be used
+	bool update();
+
+	/// add values of pending rows
+	bool addPendingRows();
+
+	/// a row is changed, called by update hook
+	void rowChanged(int op, int64_t rowId);
+
+	/// finalize statements and mark stale, called when database is closed
+	void reset();
+
+	/// check value in table by sql
+	bool checkTable(const string& text, int64_t* intValue);
+
+	/// lookup value text, sql is run to confirm if exact is true
+	bool lookup(const string& text, int64_t* intValue, bool exact);
+
+protected:
+	CCBloomIndex();
+
+	/// initialization
+	bool initWithDatabase(CCDatabase* db, const string& table, const string& column, int expectedCount, double falsePositiveRate);
+
+public:
+	virtual ~CCBloomIndex();
+
+	/**
+	 * create index, use CCDatabase::addBloomIndex instead so that it is maintained
+	 *
+	 * @param db database
+	 * @param table table name
+	 * @param column column name
+	 * @param expectedCount expected value count, filter is sized for larger one of it and
+	 * 		twice of row count when built
+	 * @param falsePositiveRate wanted false positive rate at capacity
+	 * @return index, autoreleased
+	 */
+	static CCBloomIndex* create(CCDatabase* db, const string& table, const string& column, int expectedCount = 0, double falsePositiveRate = 0.01);
+
+	/// build filter from table again
+	bool rebuild();
+
+	/// check a value may be in column, false means it is surely not. No sql is run
+	bool mightContain(const string& value) { return lookup(value, NULL, false); }
+
+	/// check a value may be in column, false means it is surely not. No sql is run
+	bool mightContain(int64_t value) { return lookup(textOf(value), &value, false); }
+
+	/// check a value is in column, sql is run only if filter can't say no
+	bool contains(const string& value) { return lookup(value, NULL, true); }
+
+	/// check a value is in column, sql is run only if filter can't say no
+	bool contains(int64_t value) { return lookup(textOf(value), &value, true); }
+
+	/// get observed false positive rate, of lookups confirmed by sql, how many are not found
+	float getFalsePositiveRate() { return m_checks > 0 ? (float)m_falsePositives / m_checks : 0; }
+
+	/// get false positive rate estimated from filled bits
+	float getEstimatedFalsePositiveRate();
+
+	/// get lookup count
+	int getLookupCount() { return m_lookups; }
+
+	/// get count of lookups answered no by filter
+	int getNegativeCount() { return m_negatives; }
+
+	/// get count of lookups confirmed by sql
+	int getCheckCount() { return m_checks; }
+
+	/// get count of lookups filter said maybe but value is not in table
+	int getFalsePositiveCount() { return m_falsePositives; }
+
+	/// get bytes of filter bits
+	size_t getMemorySize() { return m_bits.size() * sizeof(uint32_t); }
+};
+
+NS_CC_END
+
+#endif // __CCBloomIndex_h__
@@ -0,0 +1,151 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCColumnBatch_h__
+#define __CCColumnBatch_h__
+
+#include "cocos2d.h"
+
+struct sqlite3_stmt;
+using namespace std;
+
+NS_CC_BEGIN
+
+/**
+ * storage type of a column in batch, values are same as sqlite fundamental types
+ */
+enum {
+	/// not decided yet, it is decided by first non-null value
+	kCCColumnUnknown = 0,
+	kCCColumnInteger = 1,
+	kCCColumnFloat = 2,
+	kCCColumnText = 3,
+	kCCColumnBlob = 4
+};
+
+/**
+ * A batch of rows stored by columns. Every column is a typed array of one storage type,
+ * integers are int64_t, floats are double, text and blob are offsets plus a byte buffer.
+ * Null is recorded in a bitmap and null cell has zero value or zero length. Buffers are
+ * reused between fetches so fetching many batches doesn't allocate again.
+ *
+ * \par storage type
+ * Storage type of a column is decided by type of first non-null value, or declared type
+ * if the first batch has only nulls. Values of other types are converted by sqlite. It
+ * can also be forced by setColumnType before first fetch. Decided types are kept for
+ * next batches of same result set, only forced types are kept if batch is filled by
+ * another result set.
+ */
+class CC_DLL CCColumnBatch {
+	friend class CCResultSet;
+
+private:
+	/// a column
+	struct Column {
+		int type;
+
+		/// true if type is set by setColumnType
+		bool forced;
+		vector<int64_t> ints;
+		vector<double> doubles;
+
+		/// for text and blob, value i is bytes[offsets[i], offsets[i + 1])
+		vector<uint32_t> offsets;
+		vector<char> bytes;
+
+		/// bit i is set if row i is null
+		vector<uint8_t> nulls;
+	};
+	typedef vector<Column> ColumnList;
+	ColumnList m_columns;
+
+	/// row count in batch
+	int m_rowCount;
+
+	/// serial of result set which filled batch last, 0 if none
+	unsigned int m_filler;
+
+private:
+	/**
+	 * prepare columns for a statement, keep buffers
+	 *
+	 * @param keepTypes true if same result set filled batch last so decided types are kept,
+	 * 		false means types not forced are decided again
+	 */
+	void reset(sqlite3_stmt* stmt, bool keepTypes);
+
+	/// append current row of statement
+	void appendRow(sqlite3_stmt* stmt);
+
+	/// decide storage type of a column
+	int decideType(sqlite3_stmt* stmt, int columnIdx);
+
+public:
+	CCColumnBatch();
+	virtual ~CCColumnBatch();
+
+	/// get row count
+	int rowCount() { return m_rowCount; }
+
+	/// get column count
+	int columnCount() { return (int)m_columns.size(); }
+
+	/// get storage type of a column, see kCCColumnInteger, etc.
+	int columnType(int columnIdx);
+
+	/// force storage type of a column, it must be called before first fetch
+	void setColumnType(int columnIdx, int type);
+
+	/// is a cell null?
+	bool isNull(int columnIdx, int row);
+
+	/// get null bitmap of a column, bit i of byte i / 8 is set if row i is null
+	const uint8_t* nullBitmap(int columnIdx);
+
+	/// get integer array of a column, or NULL if column is not integer
+	const int64_t* int64Column(int columnIdx);
+
+	/// get double array of a column, or NULL if column is not float
+	const double* doubleColumn(int columnIdx);
+
+	/**
+	 * get text or blob of a cell, it is valid until next fetch. Text is not null terminated
+	 *
+	 * @param outLen byte length of value
+	 * @return value pointer, or NULL if column is not text or blob
+	 */
+	const char* bytesAt(int columnIdx, int row, size_t* outLen);
+
+	/// get offset array of a text or blob column, it has rowCount + 1 elements
+	const uint32_t* offsets(int columnIdx);
+
+	/// get byte buffer of a text or blob column
+	const char* bytes(int columnIdx);
+
+	/// get text of a cell as string
+	string stringAt(int columnIdx, int row);
+};
+
+NS_CC_END
+
+#endif // __CCColumnBatch_h__
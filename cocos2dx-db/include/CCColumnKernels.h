@@ -0,0 +1,125 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCColumnKernels_h__
+#define __CCColumnKernels_h__
+
+#include "cocos2d.h"
+
+NS_CC_BEGIN
+
+class CCColumnBatch;
+
+/**
+ * compare operator of selection
+ */
+enum {
+	kCCCompareEqual,
+	kCCCompareNotEqual,
+	kCCCompareLess,
+	kCCCompareLessEqual,
+	kCCCompareGreater,
+	kCCCompareGreaterEqual
+};
+
+/**
+ * Filter and aggregate kernels over columns fetched by CCResultSet::fetchBatch. They work on
+ * plain arrays so they can also be used for other data. SSE2 or NEON is used if compiler
+ * enables it, otherwise scalar code is used. On armeabi-v7a, where NEON is optional, NEON
+ * variants are built separately and used only if cpu-features reports NEON.
+ *
+ * \par selection vector
+ * A filter writes indexes of matched rows to a selection vector, which must have room for
+ * all input rows. A selection can be refined by another filter, and aggregates accept an
+ * optional selection, so "sum of b where a > x and c is not null" needs no copy.
+ *
+ * \note
+ * Null cell of batch has zero value. Sum is not affected, but for min, max and filters, use
+ * selectNotNull to exclude nulls. Double sum is computed in multiple lanes, so result may
+ * differ from sequential sum in last bits.
+ */
+class CC_DLL CCColumnKernels {
+public:
+	/**
+	 * select rows whose null bit is not set
+	 *
+	 * @param nullBitmap null bitmap, bit i of byte i / 8 is row i. NULL means no null
+	 * @param count row count
+	 * @param outSel selection vector to be filled
+	 * @return selected row count
+	 */
+	static int selectNotNull(const uint8_t* nullBitmap, int count, uint32_t* outSel);
+
+	/**
+	 * select rows of an integer column which match a condition
+	 *
+	 * @param values column values
+	 * @param count row count
+	 * @param op compare operator, kCCCompareEqual, etc.
+	 * @param value value compared with
+	 * @param sel input selection, or NULL for all rows
+	 * @param selCount input selection count, ignored if sel is NULL
+	 * @param outSel output selection, it can be same as sel
+	 * @return selected row count
+	 */
+	static int selectInt64(const int64_t* values, int count, int op, int64_t value, const uint32_t* sel, int selCount, uint32_t* outSel);
+
+	/// select rows of a double column which match a condition, see selectInt64
+	static int selectDouble(const double* values, int count, int op, double value, const uint32_t* sel, int selCount, uint32_t* outSel);
+
+	/// sum of an integer column, sel can be NULL
+	static int64_t sumInt64(const int64_t* values, int count, const uint32_t* sel = NULL, int selCount = 0);
+
+	/// sum of a double column, sel can be NULL
+	static double sumDouble(const double* values, int count, const uint32_t* sel = NULL, int selCount = 0);
+
+	/// min and max of an integer column, return false if no rows
+	static bool minMaxInt64(const int64_t* values, int count, int64_t* outMin, int64_t* outMax, const uint32_t* sel = NULL, int selCount = 0);
+
+	/// min and max of a double column, return false if no rows
+	static bool minMaxDouble(const double* values, int count, double* outMin, double* outMax, const uint32_t* sel = NULL, int selCount = 0);
+
+	/**
+	 * histogram of a double column with equal width bins. Values out of [minValue, maxValue]
+	 * are counted in first or last bin
+	 *
+	 * @param outCounts bin counts, it is cleared before counting
+	 */
+	static void histogramDouble(const double* values, int count, double minValue, double maxValue, int bins, uint32_t* outCounts, const uint32_t* sel = NULL, int selCount = 0);
+
+	/// histogram of an integer column, see histogramDouble
+	static void histogramInt64(const int64_t* values, int count, int64_t minValue, int64_t maxValue, int bins, uint32_t* outCounts, const uint32_t* sel = NULL, int selCount = 0);
+
+	/**
+	 * sum of a batch column, integer or float column. Nulls are zero so they don't
+	 * affect sum
+	 */
+	static double sum(CCColumnBatch* batch, int columnIdx);
+
+	/// count of non-null cells of a batch column
+	static int countNotNull(CCColumnBatch* batch, int columnIdx);
+};
+
+NS_CC_END
+
+#endif // __CCColumnKernels_h__
@@ -0,0 +1,160 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCCursor_h__
+#define __CCCursor_h__
+
+#include "cocos2d.h"
+#include "CCResultSet.h"
+
+struct sqlite3_stmt;
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+class CCStatement;
+
+/**
+ * A stack cursor returned by CCDatabase::query. It is a plain value, not a CCObject, so a
+ * query doesn't allocate result set or touch autorelease pool. If database caches statements,
+ * cursor borrows cached statement and gives it back when it is destroyed, closed or exhausted.
+ * Otherwise cursor prepares its own sqlite3_stmt and finalizes it then, no CCStatement is
+ * created. Close cursor before database is closed.
+ *
+ * \par ownership
+ * Copying a cursor transfers the statement, like std::auto_ptr, so it can be returned by
+ * value. The source cursor becomes invalid after copy.
+ *
+ * \par iteration
+ * Cursor can be used with next() like CCResultSet, or with iterators. Dereferencing an
+ * iterator gives the cursor itself, positioned at current row:
+ * \code
+ * CCCursor c = db->query("select id, name from item");
+ * for(CCCursor::iterator it = c.begin(); it != c.end(); ++it) {
+ *     int64_t id = it->int64ForColumnIndex(0);
+ * }
+ * \endcode
+ * With C++11, range based for works too: for(CCCursor& row : db->query(...)).
+ */
+class CC_DLL CCCursor {
+	friend class CCDatabase;
+
+public:
+	/// forward iterator over rows, all iterators of a cursor share its position
+	class iterator {
+	private:
+		/// cursor, NULL for end iterator
+		CCCursor* m_cursor;
+
+	public:
+		iterator(CCCursor* cursor) : m_cursor(cursor) {}
+		CCCursor& operator*() { return *m_cursor; }
+		CCCursor* operator->() { return m_cursor; }
+		iterator& operator++() { if(!m_cursor->next()) m_cursor = NULL; return *this; }
+		bool operator==(const iterator& i) const { return m_cursor == i.m_cursor; }
+		bool operator!=(const iterator& i) const { return m_cursor != i.m_cursor; }
+	};
+
+private:
+	/// database, NULL if cursor is invalid
+	mutable CCDatabase* m_db;
+
+	/// cached statement, NULL after closed or if cursor owns a raw statement
+	mutable CCStatement* m_statement;
+
+	/// sqlite statement, owned by cursor if m_statement is NULL, NULL after closed
+	mutable sqlite3_stmt* m_stmt;
+
+	/// has a current row?
+	bool m_hasRow;
+
+private:
+	/// cursor of a prepared statement, statement use count is already increased
+	CCCursor(CCDatabase* db, CCStatement* statement);
+
+	/// cursor owning a prepared statement, it is finalized when cursor is closed
+	CCCursor(CCDatabase* db, sqlite3_stmt* stmt);
+
+	/// assignment is not supported
+	CCCursor& operator=(const CCCursor& c);
+
+public:
+	/// an invalid cursor
+	CCCursor();
+
+	/// transfer statement from another cursor
+	CCCursor(const CCCursor& c);
+
+	~CCCursor();
+
+	/// is cursor valid and not closed?
+	bool isValid() { return m_stmt != NULL; }
+
+	/// move to next row, return false if no more rows. Cursor is closed at end
+	bool next();
+
+	/// give statement back to database or finalize it, it is called by destructor
+	void close();
+
+	/// step to first row and return iterator of it, or end if no rows
+	iterator begin() { return next() ? iterator(this) : end(); }
+
+	/// end iterator
+	iterator end() { return iterator(NULL); }
+
+	/// get column count
+	int columnCount();
+
+	/// get column index by name, case insensitive, or -1 if not found
+	int columnIndexForName(const char* columnName);
+
+	/// is a column null at current row?
+	bool columnIndexIsNull(int columnIdx);
+
+	/// get integer value in a column at current row
+	int intForColumnIndex(int columnIdx);
+
+	/// get int64_t value in a column at current row
+	int64_t int64ForColumnIndex(int columnIdx);
+
+	/// get bool value in a column at current row
+	bool boolForColumnIndex(int columnIdx) { return int64ForColumnIndex(columnIdx) != 0; }
+
+	/// get double value in a column at current row
+	double doubleForColumnIndex(int columnIdx);
+
+	/// get string value in a column at current row, empty string if it is null
+	string stringForColumnIndex(int columnIdx) { return textViewForColumnIndex(columnIdx).toString(); }
+
+	/// get text in a column at current row without copy, valid until cursor moves
+	CCDataView textViewForColumnIndex(int columnIdx);
+
+	/// get blob in a column at current row without copy, valid until cursor moves
+	CCDataView blobViewForColumnIndex(int columnIdx);
+};
+
+NS_CC_END
+
+#endif // __CCCursor_h__
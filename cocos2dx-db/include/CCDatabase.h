@@ -28,12 +28,56 @@
 #include <stdbool.h>
 #include "CCStatement.h"
 #include "CCResultSet.h"
+#include "CCCursor.h"
 
 struct sqlite3;
+struct sqlite3_stmt;
 using namespace std;
 
 NS_CC_BEGIN
 
+class CCDatabaseWorker;
+class CCQueryCache;
+class CCTableChangeNotifier;
+class CCSchemaCatalog;
+class CCEntityTableBase;
+class CCBloomIndex;
+class CCMaterializedResultSet;
+
+/**
+ * state of database opening
+ */
+enum {
+	/// database is opened and passes checks
+	kCCDatabaseOpenOK,
+
+	/// database is still in opening
+	kCCDatabaseOpenPending,
+
+	/// failed to open database, connection is not available
+	kCCDatabaseOpenFailed,
+
+	/// database is opened but integrity check reports error
+	kCCDatabaseOpenCorrupted,
+
+	/// database is opened but some required tables are missing
+	kCCDatabaseOpenSchemaMismatch
+};
+
+/**
+ * integrity check performed by async opening
+ */
+enum {
+	/// no check
+	kCCDatabaseCheckNone,
+
+	/// PRAGMA quick_check, it skips index content verification so it is much faster
+	kCCDatabaseCheckQuick,
+
+	/// PRAGMA integrity_check
+	kCCDatabaseCheckFull
+};
+
 /**
  * CCDatabase is a sqlite3 C++ encapsulation. It is FMDB C++ version, and has similar
  * API with original FMDB
@@ -43,8 +87,86 @@ NS_CC_BEGIN
  */
 class CC_DLL CCDatabase : public CCObject {
 	friend class CCResultSet;
+	friend class CCCursor;
+	friend class CCEntityTableBase;
+	friend class CCSchemaCatalog;
+	friend class CCBloomIndex;
+	friend class CCAggregateView;
+	friend class CCKeyValueStore;
+	friend class CCStaticTable;
 
 private:
+	class OpenJob;
+	friend class OpenJob;
+
+	/// worker of async opening
+	CCDatabaseWorker* m_openWorker;
+
+	/// job of async opening, it is owned by worker
+	OpenJob* m_openJob;
+
+	/// true means async opening is not finished yet
+	bool m_opening;
+
+	/// updates executed before async opening is finished
+	typedef vector<string> StringList;
+	StringList m_pendingUpdates;
+
+	/// tables must exist after opening
+	StringList m_requiredTables;
+
+	/// callback of async opening
+	CCObject* m_openTarget;
+	SEL_CallFuncO m_openSelector;
+
+	/// changed row count of every table, only updated when tracking is enabled
+	typedef map<string, int64_t> TableChangeMap;
+	TableChangeMap m_tableChanges;
+
+	/// true means table changes are tracked
+	bool m_tracksTableChanges;
+
+	/// cache of query results, NULL if result caching is disabled
+	CCQueryCache* m_queryCache;
+
+	/// notifier of table observers, created when first observer is added
+	CCTableChangeNotifier* m_changeNotifier;
+
+	/// in-memory schema, created when schema is first looked up
+	CCSchemaCatalog* m_schemaCatalog;
+
+	/// entity tables caching rows, they are not retained
+	typedef vector<CCEntityTableBase*> EntityTableList;
+	EntityTableList m_entityCaches;
+
+	/// bloom filters of columns, retained
+	typedef vector<CCBloomIndex*> BloomIndexList;
+	BloomIndexList m_bloomIndexes;
+
+	/// job writing snapshot of memory-resident database to file
+	class WriteBackJob;
+	friend class WriteBackJob;
+
+	/// mapped file path of memory-resident database, empty if database is not resident
+	string m_residentPath;
+
+	/// worker writing snapshots to file
+	CCDatabaseWorker* m_writeBackWorker;
+
+	/// seconds between write-backs, 0 means write-back is only done by calling writeBack
+	float m_writeBackInterval;
+
+	/// total changes and schema version when last snapshot is taken, changes is -1 if
+	/// last write-back failed so that database is dirty until next one succeeds
+	int m_writeBackChanges;
+	int m_writeBackSchema;
+
+	/// true means connection is opened in shared-cache mode
+	bool m_sharedCache;
+
+	/// times a statement waited for a table lock held by another shared-cache connection
+	int m_sharedCacheLockCount;
+
 	/// true means compiled statement will be cached for later use
 	bool m_shouldCacheStatements;
 
@@ -65,12 +187,63 @@ private:
 	/// execute a sql query statement, return result set if query is ok, or NULL if failed
 	CCResultSet* _executeQuery(const char* sql);
 
+	/// get cached or compile statement, its use count is increased. Return NULL if failed
+	CCStatement* prepareStatement(const char* sql);
+
+	/// compile statement, retry while database is busy. Return NULL if failed
+	sqlite3_stmt* compileStatement(const char* sql);
+
+	/// decrease use count of a statement, release it if not cached
+	void releaseStatement(const string& sql);
+
+	/// step a statement, retry while database is busy. Return sqlite result code
+	int stepStatement(sqlite3_stmt* stmt);
+
+	/// called when a busy or locked code is got, return true if caller should stop retrying
+	bool shouldStopRetry(int rc, int& numberOfRetries);
+
 	/// execute a sql non-query statement, return true if execution is ok
 	bool _executeUpdate(const char* sql);
 
 	/// invoked when result set is closed, called from CCResultSet
 	void postResultSetClosed(CCResultSet* rs);
 
+	/// take connection opened by async opening, and run pending updates
+	void attachOpenedConnection();
+
+	/// invoked in main thread when async opening job is done
+	void onOpenJobDone();
+
+	/// block until async opening is finished
+	void waitForOpen();
+
+	/// install sqlite hooks on connection
+	void installHooks();
+
+	/// sqlite update hook
+	static void updateHook(void* arg, int op, const char* dbName, const char* tableName, long long rowId);
+
+	/// sqlite rollback hook
+	static void rollbackHook(void* arg);
+
+	/// sqlite commit hook
+	static int commitHook(void* arg);
+
+	/// drop cached query results and entities, when changes can't be tracked by row
+	void clearResultCaches();
+
+	/// read schema version of main database, or -1 if failed
+	int readSchemaVersion();
+
+	/// timer of periodic write-back
+	void onWriteBackTimer(float dt);
+
+	/// sqlite authorizer which collects tables read by a statement
+	static int readTablesAuthorizer(void* arg, int action, const char* arg1, const char* arg2, const char* dbName, const char* trigger);
+
+	/// get tables read by a sql, return false if sql can't be compiled
+	bool collectReadTables(const char* sql, StringList& outTables);
+
 protected:
 	/// constructor
 	CCDatabase(string path);
@@ -92,6 +265,12 @@ public:
 	/// get sqlite version
 	static string sqliteLibVersion();
 
+	/**
+	 * quote a table or column name so that it can be put in sql, embedded double quote
+	 * is doubled. Generated sql should always quote names by it rather than by hand
+	 */
+	static string quoteIdentifier(const string& name);
+
 	/// get sqlite handler
 	sqlite3* sqliteHandle() { return m_db; }
 
@@ -103,6 +282,127 @@ public:
 	 */
 	bool open(int flags = 0);
 
+	/**
+	 * open database in a worker thread, it returns immediately. Directory creation,
+	 * sqlite3_open, integrity check and schema validation are all done by worker.
+	 * Before opening is finished, updates are queued and executed in order after
+	 * opening, other calls which need connection will block until opening is finished.
+	 * Queued update returns true at once, check getFailedUpdateCount in callback to know
+	 * whether all of them succeeded. Queued updates run only if open state is
+	 * kCCDatabaseOpenOK, otherwise they are discarded and counted as failed.
+	 *
+	 * \note
+	 * Callback is invoked in main thread with this database as argument, check
+	 * getOpenState for result. If database is corrupted or schema mismatches, the
+	 * connection is still available so caller can decide to repair or recreate it.
+	 * Callback is not invoked if database is closed before opening is finished
+	 *
+	 * @param target callback target, it is retained until callback is invoked
+	 * @param selector callback selector
+	 * @param flags flag, only used for sqlite version larger than 3.5.0
+	 * @return true means opening is started or database is already opened
+	 */
+	bool openAsync(CCObject* target = NULL, SEL_CallFuncO selector = NULL, int flags = 0);
+
+	/// true means async opening is in progress
+	bool isOpening() { return m_opening; }
+
+	/**
+	 * set whether database is opened in shared-cache mode, it must be set before opening.
+	 * Connections of one process opening same file in shared-cache mode share one page
+	 * cache, so pages loaded by one connection are not read again by others, and memory
+	 * is paid once.
+	 *
+	 * \note
+	 * Shared-cache connections lock by table instead of by file, and a locked table
+	 * returns SQLITE_LOCKED which busy timeout doesn't cover. Statements are reset and
+	 * retried as other locked statements, bounded by shared cache retry timeout since
+	 * lock owner is often a connection of same thread which can't release it while we
+	 * wait. Exclusive transaction started by beginTransaction locks whole cache, use
+	 * beginDeferredTransaction if other connections should keep reading. It has no
+	 * effect for in-memory database
+	 */
+	void setUsesSharedCache(bool flag) { m_sharedCache = flag; }
+
+	/// true means database is opened, or will be opened, in shared-cache mode
+	bool usesSharedCache() { return m_sharedCache; }
+
+	/// max retries when a table is locked by another shared-cache connection, 0 means no limit
+	CC_SYNTHESIZE(int, m_sharedCacheRetryTimeout, SharedCacheRetryTimeout);
+
+	/// times a statement waited for a table lock held by another shared-cache connection
+	int getSharedCacheLockCount() { return m_sharedCacheLockCount; }
+
+	/**
+	 * set read uncommitted isolation, only useful in shared-cache mode. Reader doesn't
+	 * take read lock on tables so it is never blocked by writer of same cache, but it
+	 * may see changes not committed yet
+	 *
+	 * @param flag true means reading uncommitted changes
+	 * @return true means setting is ok
+	 */
+	bool setReadUncommitted(bool flag);
+
+	/**
+	 * get memory used by page cache, in bytes. In shared-cache mode it is the whole
+	 * shared cache if sqlite can report it, otherwise it is this connection's share
+	 *
+	 * @return memory size, or -1 if sqlite doesn't support it
+	 */
+	int getCacheMemoryUsed();
+
+	/// get max memory of page cache, in bytes, computed from cache_size and page_size
+	int64_t getCacheMemoryLimit();
+
+	/**
+	 * open database in memory-resident mode. Database file is copied into an in-memory
+	 * connection by backup api, and all reading and writing are served by memory. Changes
+	 * are written back to file by a worker, periodically and when writeBack is called or
+	 * database is closed. Only committed state is written, and it is written to a temporary
+	 * file which then replaces database file, so file is always a complete snapshot.
+	 *
+	 * \note
+	 * It is for small and hot databases which are only used by this connection. Changes
+	 * after last write-back are lost if app is killed, so call writeBack(true) in
+	 * AppDelegate::applicationDidEnterBackground. If file doesn't exist, it starts empty
+	 * and file is created by first write-back. Scheduler retains database while periodic
+	 * write-back is on, call close to stop it. A failed write-back is tried again by next
+	 * one, close rolls back a transaction in progress and writes back committed state.
+	 *
+	 * @param writeBackInterval seconds between write-backs, 0 means no periodic write-back
+	 * @param flags flag used when opening file for loading, only used for sqlite version
+	 * 		larger than 3.5.0
+	 * @return true means opening is ok
+	 */
+	bool openResident(float writeBackInterval = 30, int flags = 0);
+
+	/// true means database is memory-resident
+	bool isResident() { return !m_residentPath.empty(); }
+
+	/**
+	 * true means database file can be opened by other connections, such as worker
+	 * connections, to see same data. It is false for in-memory and memory-resident
+	 * database, features which use worker must go through this connection then
+	 */
+	bool isFileShared() { return !m_databasePath.empty() && !isResident(); }
+
+	/// true means memory-resident database has changes not written back
+	bool isResidentDirty();
+
+	/**
+	 * write memory-resident database back to file. A snapshot is taken in memory right now
+	 * and worker writes it to file. It does nothing if nothing is changed since last
+	 * snapshot, or if a transaction is in progress
+	 *
+	 * @param wait true means block until file is written
+	 * @return true if snapshot is queued, or written successfully if wait is true, or
+	 * 		nothing needs to be written
+	 */
+	bool writeBack(bool wait = false);
+
+	/// add a table which must exist, it is validated by async opening
+	void addRequiredTable(string tableName);
+
 	/**
 	 * close database, can calling open method to open database again.
 	 * close will be invoked in CCDatabase deconstructor so it is not mandatory
@@ -128,6 +428,14 @@ public:
 	/// execute a query
 	CCResultSet* executeQuery(string sql, ...);
 
+	/**
+	 * execute a query and return a stack cursor. Unlike executeQuery, no result set is allocated
+	 * or autoreleased. If statements are cached, cursor borrows cached statement, otherwise it
+	 * owns a raw sqlite statement and no CCStatement is created. Statement is given back or
+	 * finalized when cursor goes out of scope. Cursor is invalid if query failed
+	 */
+	CCCursor query(const char* sql, ...);
+
 	/// execute update
 	bool executeUpdate(string sql, ...);
 
@@ -172,9 +480,97 @@ public:
 	/// begin a transaction, true means successful
 	bool beginTransaction();
 
-	/// check a table is existent or not
+	/// check a table is existent or not, it is answered by schema catalogue
 	bool tableExists(string tableName);
 
+	/**
+	 * enable or disable tracking of table changes. When enabled, every inserted, updated
+	 * or deleted row increases change count of its table. It is disabled by default because
+	 * it costs a little for every changed row
+	 */
+	void setTracksTableChanges(bool value);
+
+	/// true means table changes are tracked
+	bool tracksTableChanges() { return m_tracksTableChanges; }
+
+	/// get changed row count of a table since tracking is enabled
+	int64_t getTableChangeCount(string tableName);
+
+	/// get changed row count of all changed tables
+	const map<string, int64_t>& getTableChangeCounts() { return m_tableChanges; }
+
+	/**
+	 * enable or disable query result cache. When enabled, executeCachedQuery keeps results
+	 * in memory and returns them until a table they read is written. Disabling drops all
+	 * cached results
+	 *
+	 * \note
+	 * Only writes of this connection are seen. CCKeyValueStore and CCTileChunkStore call
+	 * invalidateTable after their worker writes, custom CCDatabaseWorker jobs which write
+	 * should call it in done
+	 */
+	void setCachesQueryResults(bool value);
+
+	/// drop cached results and entities of a table written by another connection, such as a worker
+	void invalidateTable(const string& tableName);
+
+	/// is query result cache enabled?
+	bool cachesQueryResults() { return m_queryCache != NULL; }
+
+	/// get query result cache, or NULL if it is disabled
+	CCQueryCache* getQueryCache() { return m_queryCache; }
+
+	/**
+	 * execute a read query and return a materialized result, from cache if tables it reads
+	 * are not written since last execution. Results are keyed by final sql so arguments are
+	 * part of the key. Tables read by a query are found by sqlite authorizer when result
+	 * is not cached, views are resolved to their tables.
+	 *
+	 * Row writes are seen by update hook. Statements which may skip update hook, such as
+	 * DELETE without WHERE or DROP TABLE, and rollbacks drop all cached results.
+	 *
+	 * @return autoreleased result which has its own cursor, or NULL if query failed. If
+	 * 		cache is disabled, query is executed and materialized every time
+	 */
+	CCMaterializedResultSet* executeCachedQuery(string sql, ...);
+
+	/**
+	 * observe changes of a table. After a transaction which changes the table commits,
+	 * selector is called on main thread with a CCTableChange, which has rowids of inserted,
+	 * updated and deleted rows. Changes of one transaction are delivered once.
+	 *
+	 * \note
+	 * Changes made without update hook, such as DELETE without WHERE, are not reported.
+	 *
+	 * @param target callback target, it is not retained so remove it before it is released
+	 * @param selector callback
+	 * @param table table name, case insensitive
+	 * @param rowId if not negative, only changes including this row are delivered
+	 */
+	void addTableObserver(CCObject* target, SEL_CallFuncO selector, string table, int64_t rowId = -1);
+
+	/// remove observers of a target on a table, or on all tables if table is empty
+	void removeTableObserver(CCObject* target, string table = "");
+
+	/**
+	 * add an in-memory bloom filter of a column, so that checking a value which is not in
+	 * column doesn't run sql. Filter is built at first lookup and kept current by update hook.
+	 * See CCBloomIndex
+	 *
+	 * @param table table name
+	 * @param column column name
+	 * @param expectedCount expected value count, 0 means sized by row count
+	 * @param falsePositiveRate wanted false positive rate
+	 * @return index, owned by database. If column already has an index, it is returned
+	 */
+	CCBloomIndex* addBloomIndex(string table, string column, int expectedCount = 0, double falsePositiveRate = 0.01);
+
+	/// get bloom filter of a column, or NULL if not added
+	CCBloomIndex* getBloomIndex(string table, string column);
+
+	/// remove bloom filter of a column
+	void removeBloomIndex(string table, string column);
+
 	/// a helper method to quickly get integer result from a query
 	int intForQuery(string sql, ...);
 
@@ -210,9 +606,16 @@ public:
 	/// get table schema
 	CCResultSet* getTableSchema(string tableName);
 
-	/// check a column is existent or not
+	/// check a column is existent or not, it is answered by schema catalogue
 	bool columnExists(string tableName, string columnName);
 
+	/**
+	 * get in-memory schema of main database. It is loaded at first use and loaded again
+	 * only when schema version is changed, so looking up tables and columns from it
+	 * doesn't query database
+	 */
+	CCSchemaCatalog* getSchemaCatalog();
+
 	/**
 	 * execute a sql file in a transaction
 	 *
@@ -244,6 +647,18 @@ public:
 	CC_SYNTHESIZE(int, m_busyRetryTimeout, BusyRetryTimeout);
 	CC_SYNTHESIZE_READONLY(bool, m_inTransaction, InTransaction);
 	CC_SYNTHESIZE(bool, m_inUse, InUse);
+
+	/// integrity check mode used by async opening, default is kCCDatabaseCheckQuick
+	CC_SYNTHESIZE(int, m_integrityCheck, IntegrityCheck);
+
+	/// result of last async opening, see kCCDatabaseOpenOK, etc.
+	CC_SYNTHESIZE_READONLY(int, m_openState, OpenState);
+
+	/// error message of last async opening, such as first line of integrity check
+	CC_SYNTHESIZE_READONLY_PASS_BY_REF(string, m_openMessage, OpenMessage);
+
+	/// updates queued in last async opening which failed, or were discarded because opening failed
+	CC_SYNTHESIZE_READONLY(int, m_failedUpdateCount, FailedUpdateCount);
 	
 	// is prefix method because CC_SYNTHESIZE macro always use get
 	bool isInTransaction() { return m_inTransaction; }
@@ -0,0 +1,168 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCDatabaseMaintenance_h__
+#define __CCDatabaseMaintenance_h__
+
+#include "cocos2d.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * Run database maintenance in small slices when game is idle. Game tells maintenance when
+ * it is idle, such as in menus, then every frame a slice of overdue tasks is run within
+ * a time budget. Tasks are:
+ * - ANALYZE a table when its changed rows reach a threshold, one table per slice
+ * - PRAGMA incremental_vacuum(N) if database is in incremental auto vacuum mode
+ * - full VACUUM, it can't be sliced so it only runs in runInBackground
+ *
+ * \par analyze
+ * ANALYZE scans whole table and can't be interrupted, so in a slice it is bounded by
+ * PRAGMA analysis_limit, which needs sqlite 3.32.0 or later. With older sqlite, such as
+ * the one of Android, tables are only analyzed in runInBackground.
+ *
+ * \note
+ * Maintenance enables table change tracking of database. It uses database connection
+ * in main thread, and it skips a frame if database is in use or in transaction. Director
+ * pausing stops scheduler, so call runInBackground when game is paused or enters background.
+ */
+class CC_DLL CCDatabaseMaintenance : public CCObject {
+private:
+	/// change count of tables when they are analyzed
+	typedef map<string, int64_t> TableChangeMap;
+	TableChangeMap m_analyzedChanges;
+
+	/// true means game is idle
+	bool m_idle;
+
+	/// seconds to wait before checking tasks again
+	float m_waitTime;
+
+	/// auto vacuum mode, -1 means unknown
+	int m_autoVacuum;
+
+private:
+	/// idle tick
+	void tick(float dt);
+
+	/// run tasks until nothing to do or budget is used up, return false if nothing to do
+	bool runSlices(float budget, bool background);
+
+	/// run a slice, unbounded analyze runs only in background. Return false if nothing to do
+	bool runSlice(bool background);
+
+	/// true if sqlite supports PRAGMA analysis_limit
+	static bool canLimitAnalysis();
+
+	/// find a table need analyzing, or empty string
+	string nextTableToAnalyze();
+
+	/// get a pragma integer
+	int pragmaInt(const char* name);
+
+	/// free pages of incremental vacuum
+	void incrementalVacuum(int pages);
+
+	/// check database can be used now
+	bool isDatabaseAvailable();
+
+protected:
+	CCDatabaseMaintenance();
+
+public:
+	virtual ~CCDatabaseMaintenance();
+
+	/// create maintenance for an opened database
+	static CCDatabaseMaintenance* create(CCDatabase* db);
+
+	/// init maintenance, see create
+	virtual bool initWithDatabase(CCDatabase* db);
+
+	/// set game is idle or not, maintenance only runs when idle
+	void setIdle(bool idle);
+
+	/// true means game is idle
+	bool isIdle() { return m_idle; }
+
+	/**
+	 * run overdue tasks now, including full VACUUM if free pages exceed threshold.
+	 * Call it in applicationDidEnterBackground or when game is paused
+	 *
+	 * @param budget seconds for sliced tasks, full VACUUM is not limited by it
+	 */
+	void runInBackground(float budget = 0.5f);
+
+	/// true means some task is overdue
+	bool isOverdue();
+
+	/// get count of tables need analyzing
+	int getOverdueAnalyzeCount();
+
+	/// database, retained
+	CC_SYNTHESIZE_READONLY(CCDatabase*, m_db, Database);
+
+	/// seconds of a frame can be used, default is 0.004
+	CC_SYNTHESIZE(float, m_sliceBudget, SliceBudget);
+
+	/// changed rows of a table which triggers ANALYZE, default is 500
+	CC_SYNTHESIZE(int, m_analyzeThreshold, AnalyzeThreshold);
+
+	/**
+	 * rows of an index ANALYZE reads at most, default is 400. It only works if sqlite
+	 * supports PRAGMA analysis_limit. 0 means no limit, then tables are only analyzed
+	 * in runInBackground
+	 */
+	CC_SYNTHESIZE(int, m_analysisLimit, AnalysisLimit);
+
+	/// pages freed by one incremental vacuum slice, default is 32
+	CC_SYNTHESIZE(int, m_vacuumPagesPerSlice, VacuumPagesPerSlice);
+
+	/// ratio of free pages which triggers full VACUUM in background, default is 0.25, 0 disables it
+	CC_SYNTHESIZE(float, m_vacuumThreshold, VacuumThreshold);
+
+	/**
+	 * true means database is switched to incremental auto vacuum mode before full VACUUM,
+	 * so that later cleaning can be sliced. Default is false
+	 */
+	CC_SYNTHESIZE(bool, m_prefersIncrementalVacuum, PrefersIncrementalVacuum);
+
+	/// seconds to wait before checking again when nothing to do, default is 5
+	CC_SYNTHESIZE(float, m_checkInterval, CheckInterval);
+
+	/// count of ANALYZE executed
+	CC_SYNTHESIZE_READONLY(int, m_analyzeRuns, AnalyzeRuns);
+
+	/// count of pages freed by incremental vacuum
+	CC_SYNTHESIZE_READONLY(int, m_vacuumedPages, VacuumedPages);
+
+	/// count of full VACUUM executed
+	CC_SYNTHESIZE_READONLY(int, m_fullVacuumRuns, FullVacuumRuns);
+};
+
+NS_CC_END
+
+#endif // __CCDatabaseMaintenance_h__
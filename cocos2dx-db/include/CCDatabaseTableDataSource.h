@@ -0,0 +1,243 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCDatabaseTableDataSource_h__
+#define __CCDatabaseTableDataSource_h__
+
+#include "cocos2d.h"
+#include "cocos-ext.h"
+#include "CCDatabaseWorker.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+class CCDatabaseTableDataSourceDelegate;
+
+/**
+ * A CCTableView data source which pages rows of a table with keyset pagination. Only a window
+ * of pages around visible cells is kept in memory, pages in scrolling direction are prefetched
+ * by a worker connection so main thread never waits for the disk.
+ *
+ * \par keyset pagination
+ * Next page is loaded by "key > last key of previous page" instead of OFFSET, so the cost of
+ * loading a page doesn't depend on its position. Key column must be a unique integer column
+ * with index, rowid or INTEGER PRIMARY KEY is the best choice. Only when user jumps to a
+ * page whose neighbours are not loaded, OFFSET is used.
+ *
+ * \note
+ * Worker opens its own connection so database must be a file, not in-memory or resident database. Row
+ * count is also queried in worker, so table view is empty until count is ready.
+ */
+class CC_DLL CCDatabaseTableDataSource : public CCObject, public extension::CCTableViewDataSource {
+public:
+	/**
+	 * a materialized row, column 0 is first column in column list, key is not included
+	 */
+	class CC_DLL Row {
+		friend class CCDatabaseTableDataSource;
+
+	private:
+		/// cell value
+		struct Value {
+			int type;
+			int64_t i;
+			double d;
+			string s;
+		};
+		typedef vector<Value> ValueList;
+		ValueList m_values;
+
+		/// key of row
+		int64_t m_key;
+
+	public:
+		/// get key of row
+		int64_t getKey() { return m_key; }
+
+		/// get column count
+		int columnCount() { return (int)m_values.size(); }
+
+		/// is type of a column is null?
+		bool columnIndexIsNull(int columnIdx);
+
+		/// get integer value of a column
+		int intForColumnIndex(int columnIdx);
+
+		/// get int64_t value of a column
+		int64_t int64ForColumnIndex(int columnIdx);
+
+		/// get bool value of a column
+		bool boolForColumnIndex(int columnIdx);
+
+		/// get double value of a column
+		double doubleForColumnIndex(int columnIdx);
+
+		/// get string value of a column, empty string if null
+		string stringForColumnIndex(int columnIdx);
+	};
+
+private:
+	class CountJob;
+	class PageJob;
+	friend class CountJob;
+	friend class PageJob;
+
+	/// a page of rows
+	typedef vector<Row> RowList;
+	typedef map<int, RowList*> PageMap;
+	PageMap m_pages;
+
+	/// pages in loading
+	typedef set<int> PageSet;
+	PageSet m_loadingPages;
+
+	/// worker
+	CCDatabaseWorker* m_worker;
+
+	/// table view, weak reference
+	extension::CCTableView* m_tableView;
+
+	/// delegate, weak reference
+	CCDatabaseTableDataSourceDelegate* m_delegate;
+
+	/// query parts
+	string m_table;
+	string m_keyColumn;
+	string m_columns;
+	string m_where;
+
+	/// row count, -1 means unknown
+	int m_rowCount;
+
+	/// increased when reloading, results of old generation are discarded
+	int m_generation;
+
+	/// last accessed row index and scrolling direction, 1 or -1
+	int m_lastIndex;
+	int m_direction;
+
+	/// true means visible cells are being refreshed
+	bool m_updatingCells;
+
+private:
+	/// request a page if it is not loaded or loading
+	void requestPage(int page);
+
+	/// request pages around a row and evict pages out of window
+	void ensureWindow(int idx);
+
+	/// invoked when count is ready
+	void onRowCountLoaded(int generation, int count);
+
+	/// invoked when a page is ready, takes ownership of rows
+	void onPageLoaded(int generation, int page, RowList* rows);
+
+	/// release all pages
+	void clearPages();
+
+protected:
+	CCDatabaseTableDataSource();
+
+public:
+	virtual ~CCDatabaseTableDataSource();
+
+	/**
+	 * create a data source
+	 *
+	 * @param db database whose file will be paged, it must be opened from a file
+	 * @param table table name, or any expression can follow FROM
+	 * @param keyColumn unique integer key column for seeking, rowid by default
+	 * @param columns column list, * by default
+	 * @param where optional filter, without WHERE keyword
+	 * @return data source object, or NULL if failed
+	 */
+	static CCDatabaseTableDataSource* create(CCDatabase* db, string table, string keyColumn = "rowid", string columns = "*", string where = "");
+
+	/// init data source, see create
+	virtual bool initWithDatabase(CCDatabase* db, string table, string keyColumn, string columns, string where);
+
+	/// set table view, data source will be set to table view
+	void setTableView(extension::CCTableView* tableView);
+
+	/// discard all loaded rows and count again, call it after table is changed
+	void reload();
+
+	/// get row at index, or NULL if it is not loaded yet
+	Row* rowAtIndex(unsigned int idx);
+
+	/// is row count ready?
+	bool isRowCountLoaded() { return m_rowCount >= 0; }
+
+	/// get count of pages in memory
+	int getLoadedPageCount() { return (int)m_pages.size(); }
+
+	/// CCTableViewDataSource
+	virtual cocos2d::CCSize cellSizeForTable(extension::CCTableView* table);
+	virtual extension::CCTableViewCell* tableCellAtIndex(extension::CCTableView* table, unsigned int idx);
+	virtual unsigned int numberOfCellsInTableView(extension::CCTableView* table);
+
+	/// delegate to create cells
+	void setDelegate(CCDatabaseTableDataSourceDelegate* delegate) { m_delegate = delegate; }
+	CCDatabaseTableDataSourceDelegate* getDelegate() { return m_delegate; }
+
+	/// rows per page, default is 32
+	CC_SYNTHESIZE(int, m_pageSize, PageSize);
+
+	/// pages prefetched in scrolling direction, default is 2
+	CC_SYNTHESIZE(int, m_prefetchPages, PrefetchPages);
+
+	/// max pages kept in memory, default is 6
+	CC_SYNTHESIZE(int, m_maxPages, MaxPages);
+
+	/// true means rows are sorted by key descending
+	CC_SYNTHESIZE(bool, m_descending, Descending);
+};
+
+/**
+ * delegate of CCDatabaseTableDataSource, it creates cells for rows
+ */
+class CC_DLL CCDatabaseTableDataSourceDelegate {
+public:
+	virtual ~CCDatabaseTableDataSourceDelegate() {}
+
+	/**
+	 * create or update a cell for a row
+	 *
+	 * @param ds data source
+	 * @param table table view
+	 * @param idx row index
+	 * @param row row data, or NULL if row is still in loading. In that case, cell should
+	 * 		display a placeholder and it will be updated when row is loaded
+	 * @return cell
+	 */
+	virtual extension::CCTableViewCell* tableCellForRow(CCDatabaseTableDataSource* ds, extension::CCTableView* table, unsigned int idx, CCDatabaseTableDataSource::Row* row) = 0;
+
+	/// get cell size
+	virtual cocos2d::CCSize cellSizeForTable(extension::CCTableView* table) = 0;
+};
+
+NS_CC_END
+
+#endif // __CCDatabaseTableDataSource_h__
@@ -0,0 +1,128 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCDatabaseWarmer_h__
+#define __CCDatabaseWarmer_h__
+
+#include "cocos2d.h"
+#include "CCDatabaseWorker.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * Warm OS page cache for a database file in a worker thread, so that first queries after
+ * a cold launch don't pay for random disk reads. By default the whole file is read
+ * sequentially. If tables or indexes are added, only their b-tree pages are read, they are
+ * found by walking b-tree from root page recorded in sqlite_master.
+ *
+ * \note
+ * Warming only reads the file, it doesn't change anything. Overflow pages of large
+ * records are not followed when warming tables, use whole file mode if they matter.
+ */
+class CC_DLL CCDatabaseWarmer : public CCObject {
+private:
+	class WarmJob;
+	friend class WarmJob;
+
+	/// worker
+	CCDatabaseWorker* m_worker;
+
+	/// callback
+	CCObject* m_target;
+	SEL_CallFuncO m_selector;
+
+	/// tables and indexes to be warmed
+	typedef vector<string> StringList;
+	StringList m_tables;
+	StringList m_indexes;
+
+	/// tables whose indexes should be warmed
+	StringList m_indexTables;
+
+	/// true means warming is in progress
+	bool m_running;
+
+	/// database path before mapping, worker maps it by itself
+	string m_databasePath;
+
+private:
+	/// invoked when warming is done
+	void onWarmJobDone(int64_t bytes, int pages, float duration);
+
+protected:
+	CCDatabaseWarmer();
+
+public:
+	virtual ~CCDatabaseWarmer();
+
+	/**
+	 * create a warmer
+	 *
+	 * @param db database to be warmed, it must be opened from a file
+	 * @return warmer, or NULL if database is in memory
+	 */
+	static CCDatabaseWarmer* create(CCDatabase* db);
+
+	/// init warmer, see create
+	virtual bool initWithDatabase(CCDatabase* db);
+
+	/// warm a table, and its indexes if withIndexes is true
+	void addTable(string tableName, bool withIndexes = true);
+
+	/// warm an index
+	void addIndex(string indexName);
+
+	/**
+	 * start warming in worker thread
+	 *
+	 * @param target callback target, it is retained until callback is invoked
+	 * @param selector callback selector, warmer is passed as argument
+	 */
+	void start(CCObject* target = NULL, SEL_CallFuncO selector = NULL);
+
+	/// cancel warming, callback is not invoked
+	void cancel();
+
+	/// true means warming is in progress
+	bool isRunning() { return m_running; }
+
+	/// database file path, mapped
+	CC_SYNTHESIZE_READONLY_PASS_BY_REF(string, m_path, Path);
+
+	/// bytes read by last warming
+	CC_SYNTHESIZE_READONLY(int64_t, m_bytesWarmed, BytesWarmed);
+
+	/// pages read by last warming
+	CC_SYNTHESIZE_READONLY(int, m_pagesWarmed, PagesWarmed);
+
+	/// seconds used by last warming
+	CC_SYNTHESIZE_READONLY(float, m_duration, Duration);
+};
+
+NS_CC_END
+
+#endif // __CCDatabaseWarmer_h__
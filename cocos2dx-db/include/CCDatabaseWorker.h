@@ -0,0 +1,165 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCDatabaseWorker_h__
+#define __CCDatabaseWorker_h__
+
+#include "cocos2d.h"
+#include <pthread.h>
+
+struct sqlite3;
+using namespace std;
+
+NS_CC_BEGIN
+
+/**
+ * A background thread which owns a private sqlite3 connection to a database file. Jobs
+ * are executed in worker thread in the order they are posted, and then delivered back to
+ * main thread in scheduler tick, similar to the way CCTextureCache loads images asynchronously.
+ *
+ * \note
+ * CCDatabase is not thread safe so worker never touches it, it opens a second connection to
+ * the same file instead. The connection is opened in worker thread when first job is posted.
+ * Owner must call stop before it is destroyed, otherwise finished jobs may be delivered to
+ * an object which no longer exists.
+ */
+class CC_DLL CCDatabaseWorker : public CCObject {
+public:
+	/**
+	 * a job executed by worker, worker takes ownership of it
+	 */
+	class CC_DLL Job {
+	public:
+		virtual ~Job() {}
+
+		/// executed in worker thread, db is worker connection and it is NULL if opening is failed
+		virtual void run(sqlite3* db) = 0;
+
+		/// executed in main thread after run returns
+		virtual void done() {}
+	};
+
+private:
+	typedef list<Job*> JobList;
+
+	/// jobs waiting to be run
+	JobList m_pendingJobs;
+
+	/// jobs which are run but not delivered yet
+	JobList m_finishedJobs;
+
+	/// thread and sync objects
+	pthread_t m_thread;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+	pthread_cond_t m_idleCond;
+
+	/// true means a job is running
+	bool m_running;
+
+	/// true means thread is started
+	bool m_started;
+
+	/// true means thread should exit
+	bool m_quit;
+
+	/// true means dispatch selector is scheduled
+	bool m_scheduled;
+
+	/// count of jobs posted but not delivered, only touched in main thread
+	int m_outstandingJobs;
+
+	/// mapped database path
+	string m_path;
+
+	/// open flags, 0 means default
+	int m_flags;
+
+	/// true means worker doesn't open connection
+	bool m_detached;
+
+	/// worker connection, only touched in worker thread
+	sqlite3* m_db;
+
+private:
+	/// thread entry
+	static void* threadEntry(void* arg);
+
+	/// thread loop
+	void threadLoop();
+
+	/// deliver finished jobs to main thread
+	void dispatchFinishedJobs(float dt);
+
+protected:
+	CCDatabaseWorker(string path, int flags);
+
+public:
+	virtual ~CCDatabaseWorker();
+
+	/**
+	 * create a worker
+	 *
+	 * @param path platform-independent path of database file, will be mapped. Empty
+	 * 		path means a private in-memory database
+	 * @param flags flags passed to sqlite3_open_v2, 0 means default
+	 * @return worker object
+	 */
+	static CCDatabaseWorker* create(string path, int flags = 0);
+
+	/**
+	 * create a worker without connection, db passed to jobs is always NULL. It is
+	 * for jobs which manage connection or file by themselves
+	 *
+	 * @return worker object
+	 */
+	static CCDatabaseWorker* create();
+
+	/// post a job to worker, thread is started if not yet
+	void post(Job* job);
+
+	/// remove jobs which are not started yet, their done won't be called
+	void cancelPendingJobs();
+
+	/**
+	 * block until all posted jobs are run. Finished jobs are not delivered, call it
+	 * before stop if pending jobs must not be lost, such as saving
+	 */
+	void waitUntilIdle();
+
+	/**
+	 * stop worker thread and wait it to exit. Pending and finished jobs are deleted without
+	 * calling done. Worker can't be used after stopping
+	 */
+	void stop();
+
+	/// true if stop is called, it can be checked in job run to return early from long work
+	bool isStopped();
+
+	/// get count of jobs posted but not delivered to main thread yet
+	int getOutstandingJobCount() { return m_outstandingJobs; }
+};
+
+NS_CC_END
+
+#endif // __CCDatabaseWorker_h__
@@ -0,0 +1,289 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCEntityCache_h__
+#define __CCEntityCache_h__
+
+#include "CCEntityTable.h"
+#include <list>
+
+using namespace std;
+
+NS_CC_BEGIN
+
+/**
+ * Entity table with an identity map of loaded rows, keyed by rowid. Reading a cached
+ * row doesn't touch sqlite, and every reader of a rowid gets same instance. Writes go
+ * through to sqlite first, then cached entry is updated with written value.
+ * \code
+ * CCEntityCache<Item>* items = CCEntityCache<Item>::create(db, 128);
+ * const Item* sword = items->get(1); // loaded from database
+ * sword = items->get(1); // from memory
+ * \endcode
+ *
+ * Cache is registered to database, rows changed by other statements of same connection
+ * are dropped by update hook, and all rows are dropped when a transaction is rolled back
+ * or a statement deletes rows without hook. Changes by other connections are not seen.
+ * Cache is bounded by entry count, least recently used entry is evicted first.
+ *
+ * \note
+ * Key must be declared exactly INTEGER PRIMARY KEY, so that it is an alias of rowid and
+ * update hook reports changes by same key.
+ */
+template<typename T>
+class CCEntityCache : public CCEntityTable<T> {
+private:
+	typedef list<int64_t> RowIdList;
+
+	/// a cached entity
+	struct Entry {
+		T value;
+		RowIdList::iterator lru;
+	};
+	typedef map<int64_t, Entry> EntryMap;
+	EntryMap m_entries;
+
+	/// rowid by recent use, most recent is at front
+	RowIdList m_lru;
+
+	/// max entry count
+	int m_capacity;
+
+	/// statistics
+	int m_hits;
+	int m_misses;
+	int m_evictions;
+
+private:
+	/// put a written or loaded entity, it becomes most recent
+	T* store(int64_t rowId, const T& obj) {
+		typename EntryMap::iterator iter = m_entries.find(rowId);
+		if(iter != m_entries.end()) {
+			iter->second.value = obj;
+			touch(iter);
+			return &iter->second.value;
+		}
+
+		// evict before insert so capacity is never exceeded
+		while(!m_lru.empty() && (int)m_entries.size() >= m_capacity) {
+			m_entries.erase(m_lru.back());
+			m_lru.pop_back();
+			m_evictions++;
+		}
+		m_lru.push_front(rowId);
+		Entry& e = m_entries[rowId];
+		e.value = obj;
+		e.lru = m_lru.begin();
+		return &e.value;
+	}
+
+	/// mark an entry most recently used
+	void touch(typename EntryMap::iterator iter) {
+		m_lru.splice(m_lru.begin(), m_lru, iter->second.lru);
+	}
+
+	/// store written entity by its key
+	void storeByKey(const T& obj) {
+		CCEntityKeyGetter g;
+		CCTableSchema<T>::visit(g, const_cast<T&>(obj));
+		if(g.found)
+			store(g.rowId, obj);
+	}
+
+	/// remove an entity by its key
+	void eraseByKey(const T& obj) {
+		CCEntityKeyGetter g;
+		CCTableSchema<T>::visit(g, const_cast<T&>(obj));
+		if(g.found)
+			invalidateRow(g.rowId);
+	}
+
+protected:
+	CCEntityCache() :
+			m_capacity(256),
+			m_hits(0),
+			m_misses(0),
+			m_evictions(0) {
+	}
+
+public:
+	virtual ~CCEntityCache() {
+		this->setCachesEntities(false);
+	}
+
+	/**
+	 * create an entity cache
+	 *
+	 * @param db database
+	 * @param capacity max cached entity count
+	 * @return cache instance, autoreleased, or NULL if key of entity is not an alias of rowid
+	 */
+	static CCEntityCache* create(CCDatabase* db, int capacity = 256) {
+		CCEntityCache* c = new CCEntityCache();
+		c->m_capacity = MAX(1, capacity);
+		if(c->initWithDatabase(db)) {
+			return (CCEntityCache*)c->autorelease();
+		}
+		c->release();
+		return NULL;
+	}
+
+	virtual bool initWithDatabase(CCDatabase* db) {
+		if(!CCEntityTable<T>::initWithDatabase(db))
+			return false;
+		if(!this->isKeyRowId()) {
+			CCLOGERROR("CCEntityCache: key of table %s must be declared INTEGER PRIMARY KEY", this->getTableName().c_str());
+			return false;
+		}
+		this->setCachesEntities(true);
+		return true;
+	}
+
+	/**
+	 * get an entity by rowid, it is loaded if not cached
+	 *
+	 * @return cached entity, or NULL if not found. It is valid until the row is written,
+	 * 		evicted or cache is cleared, don't modify it directly, use update instead
+	 */
+	const T* get(int64_t rowId) {
+		typename EntryMap::iterator iter = m_entries.find(rowId);
+		if(iter != m_entries.end()) {
+			m_hits++;
+			touch(iter);
+			return &iter->second.value;
+		}
+		m_misses++;
+		T obj;
+		if(!CCEntityTable<T>::load(rowId, obj))
+			return NULL;
+		return store(rowId, obj);
+	}
+
+	/// load an entity by key, from memory if cached. Return true if found
+	template<typename K>
+	bool load(const K& key, T& out) {
+		const T* obj = get((int64_t)key);
+		if(obj)
+			out = *obj;
+		return obj != NULL;
+	}
+
+	/// load all entities from database, they are appended to out and cached until capacity is reached
+	bool loadAll(vector<T>& out) {
+		size_t start = out.size();
+		if(!CCEntityTable<T>::loadAll(out))
+			return false;
+		for(size_t i = start; i < out.size() && (int)m_entries.size() < m_capacity; i++)
+			storeByKey(out[i]);
+		return true;
+	}
+
+	/// insert an entity and cache it
+	bool insert(T& obj) {
+		if(!CCEntityTable<T>::insert(obj))
+			return false;
+		storeByKey(obj);
+		return true;
+	}
+
+	/// insert or replace an entity and cache it
+	bool replace(T& obj) {
+		if(!CCEntityTable<T>::replace(obj))
+			return false;
+		storeByKey(obj);
+		return true;
+	}
+
+	/// update an entity and cached entry, nothing is cached if no row has the key
+	bool update(T& obj) {
+		if(!CCEntityTable<T>::update(obj))
+			return false;
+		if(this->getChangedRowCount() == 1)
+			storeByKey(obj);
+		return true;
+	}
+
+	/// delete an entity and its cached entry
+	bool remove(T& obj) {
+		if(!CCEntityTable<T>::remove(obj))
+			return false;
+		eraseByKey(obj);
+		return true;
+	}
+
+	/// delete an entity by key and its cached entry
+	template<typename K>
+	bool removeByKey(const K& key) {
+		if(!CCEntityTable<T>::removeByKey(key))
+			return false;
+		invalidateRow((int64_t)key);
+		return true;
+	}
+
+	/// drop a cached entry
+	virtual void invalidateRow(int64_t rowId) {
+		typename EntryMap::iterator iter = m_entries.find(rowId);
+		if(iter != m_entries.end()) {
+			m_lru.erase(iter->second.lru);
+			m_entries.erase(iter);
+		}
+	}
+
+	/// drop all cached entries
+	virtual void invalidateAll() {
+		m_entries.clear();
+		m_lru.clear();
+	}
+
+	/// is a rowid cached
+	bool isCached(int64_t rowId) { return m_entries.find(rowId) != m_entries.end(); }
+
+	/// set max entry count, least recently used entries are evicted if needed
+	void setCapacity(int capacity) {
+		m_capacity = MAX(1, capacity);
+		while((int)m_entries.size() > m_capacity) {
+			m_entries.erase(m_lru.back());
+			m_lru.pop_back();
+			m_evictions++;
+		}
+	}
+
+	/// get max entry count
+	int getCapacity() { return m_capacity; }
+
+	/// get cached entry count
+	int getCount() { return (int)m_entries.size(); }
+
+	/// get times an entity is found in memory
+	int getHits() { return m_hits; }
+
+	/// get times an entity is loaded from database
+	int getMisses() { return m_misses; }
+
+	/// get times an entry is evicted by capacity
+	int getEvictions() { return m_evictions; }
+};
+
+NS_CC_END
+
+#endif // __CCEntityCache_h__
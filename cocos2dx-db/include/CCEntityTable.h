@@ -0,0 +1,478 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCEntityTable_h__
+#define __CCEntityTable_h__
+
+#include "cocos2d.h"
+#include "CCRowBinding.h"
+#include "CCDatabase.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+/**
+ * generated statements of entity table
+ */
+enum {
+	kCCEntityInsert,
+	kCCEntityReplace,
+	kCCEntityUpdate,
+	kCCEntityDelete,
+	kCCEntitySelectByKey,
+	kCCEntitySelectAll,
+	kCCEntityStatementCount
+};
+
+/**
+ * Table description of an entity struct, it must be specialized by CC_DB_TABLE_BEGIN macros
+ * before a struct can be used with CCEntityTable.
+ */
+template<typename T>
+struct CCTableSchema;
+
+/// a string field stored as blob, made by CC_DB_BLOB_COLUMN and CC_DB_BLOB_KEY
+struct CCEntityBlob {
+	string& value;
+	CCEntityBlob(string& v) : value(v) {}
+};
+
+inline int ccFieldKind(const CCEntityBlob&) { return kCCFieldBlob; }
+
+/// collects column names, kinds and key flags of an entity
+struct CCEntityColumnCollector {
+	int kinds[CC_DB_MAX_FIELDS];
+	const char* names[CC_DB_MAX_FIELDS];
+	bool keys[CC_DB_MAX_FIELDS];
+
+	/// true if field is a CCDataView
+	bool views[CC_DB_MAX_FIELDS];
+	int count;
+
+	CCEntityColumnCollector() : count(0) {}
+
+	template<typename F>
+	void column(const char* name, F& value, bool key) {
+		if(count < CC_DB_MAX_FIELDS) {
+			kinds[count] = ccFieldKind(value);
+			names[count] = name;
+			keys[count] = key;
+			views[count] = isView(value);
+		}
+		count++;
+	}
+
+	template<typename F> static bool isView(const F& value) { return false; }
+	static bool isView(const CCDataView& value) { return true; }
+};
+
+/// adapts a row field visitor to entity columns, so entity can be read by CCResultSet::read
+template<typename V>
+struct CCEntityFieldAdapter {
+	V& v;
+	CCEntityFieldAdapter(V& visitor) : v(visitor) {}
+
+	template<typename F>
+	void column(const char* name, F& value, bool key) {
+		v.field(name, value);
+	}
+
+	/// blob is read into its string
+	void column(const char* name, CCEntityBlob& value, bool key) {
+		v.field(name, value.value);
+	}
+};
+
+/**
+ * Base of CCEntityTable, it generates sql of table and runs statements. Statements are
+ * prepared through statement cache of database, so they are compiled once if database
+ * caches statements.
+ */
+class CC_DLL CCEntityTableBase : public CCObject {
+private:
+	/// column names
+	typedef vector<string> StringList;
+	StringList m_columns;
+
+	/// column kinds, kCCFieldInteger, etc.
+	vector<int> m_kinds;
+
+	/// generated sql
+	string m_sql[kCCEntityStatementCount];
+
+	/// statement being executed, or NULL
+	CCStatement* m_current;
+
+	/// true if table is registered to database as an entity cache
+	bool m_cachesEntities;
+
+protected:
+	/// key column index, or -1 if table has no key
+	int m_keyIndex;
+
+protected:
+	CCEntityTableBase();
+
+	/// setup columns and generate sql
+	bool initWithSchema(CCDatabase* db, const char* table, const CCEntityColumnCollector& c);
+
+	/// prepare a generated statement for binding, return false if failed
+	bool beginStatement(int which);
+
+	/// run prepared statement to end and finish it
+	bool execute();
+
+	/// step prepared select statement, return false if no more rows
+	bool step();
+
+	/// reset prepared statement and give it back to database
+	void finishStatement();
+
+	/// register to database so that cached entities are invalidated when rows are changed
+	void setCachesEntities(bool value);
+
+	/// get kind of key column, or -1 if table has no key
+	int getKeyKind() { return m_keyIndex < 0 ? -1 : m_kinds[m_keyIndex]; }
+
+	/**
+	 * check key column is an alias of rowid, i.e. it is declared exactly INTEGER PRIMARY KEY.
+	 * A table not created yet passes because createTable declares integer key so
+	 */
+	bool isKeyRowId();
+
+	/// get rows changed by last executed statement
+	int getChangedRowCount();
+
+public:
+	virtual ~CCEntityTableBase();
+
+	/// a row of this table is changed by any statement, called by database of an entity cache
+	virtual void invalidateRow(int64_t rowId) {}
+
+	/// rows of this table may be changed in unknown way, called by database of an entity cache
+	virtual void invalidateAll() {}
+
+	/// create table if not exists, columns use declared types of field kinds
+	bool createTable();
+
+	/// get generated sql of a statement, kCCEntityInsert, etc. For debugging
+	const string& getSQL(int which) { return m_sql[which]; }
+
+	/// bind a parameter of current statement, index starts from 1
+	void bindValue(int idx, const bool& value);
+	void bindValue(int idx, const int& value);
+	void bindValue(int idx, const long& value);
+	void bindValue(int idx, const long long& value);
+	void bindValue(int idx, const float& value);
+	void bindValue(int idx, const double& value);
+	void bindValue(int idx, const string& value);
+	void bindValue(int idx, const CCDataView& value);
+	void bindValue(int idx, const CCEntityBlob& value);
+	void bindNull(int idx);
+
+	/// read a column of current row, index starts from 0
+	void readColumn(int columnIdx, bool& out);
+	void readColumn(int columnIdx, int& out);
+	void readColumn(int columnIdx, long& out);
+	void readColumn(int columnIdx, long long& out);
+	void readColumn(int columnIdx, float& out);
+	void readColumn(int columnIdx, double& out);
+	void readColumn(int columnIdx, string& out);
+	void readColumn(int columnIdx, CCDataView& out);
+	void readColumn(int columnIdx, CCEntityBlob& out);
+
+	CC_SYNTHESIZE_READONLY(CCDatabase*, m_db, Database);
+	CC_SYNTHESIZE_READONLY_PASS_BY_REF(string, m_table, TableName);
+};
+
+/// binds columns of an entity to statement parameters
+struct CCEntityBinder {
+	/// bind all columns
+	static const int ALL = 0;
+
+	/// bind non-key columns
+	static const int VALUES = 1;
+
+	/// bind key column only
+	static const int KEY = 2;
+
+	CCEntityTableBase* table;
+	int mode;
+	int index;
+
+	/// if true, integer key of zero is bound as null so sqlite assigns rowid
+	bool autoKey;
+
+	/// set if key was bound as null
+	bool keyAssigned;
+
+	CCEntityBinder(CCEntityTableBase* t, int m, int start, bool ak = false) : table(t), mode(m), index(start), autoKey(ak), keyAssigned(false) {}
+
+	template<typename F>
+	void column(const char* name, F& value, bool key) {
+		if((mode == VALUES && key) || (mode == KEY && !key))
+			return;
+		if(key && autoKey && ccFieldKind(value) == kCCFieldInteger && isZero(value)) {
+			table->bindNull(index++);
+			keyAssigned = true;
+		} else {
+			table->bindValue(index++, value);
+		}
+	}
+
+	template<typename F> static bool isZero(const F& value) { return false; }
+	static bool isZero(const int& value) { return value == 0; }
+	static bool isZero(const long& value) { return value == 0; }
+	static bool isZero(const long long& value) { return value == 0; }
+};
+
+/// reads columns of an entity in declared order
+struct CCEntityReader {
+	CCEntityTableBase* table;
+	int index;
+
+	CCEntityReader(CCEntityTableBase* t) : table(t), index(0) {}
+
+	template<typename F>
+	void column(const char* name, F& value, bool key) {
+		table->readColumn(index++, value);
+	}
+};
+
+/// writes assigned rowid to integer key field
+struct CCEntityKeySetter {
+	int64_t rowId;
+
+	CCEntityKeySetter(int64_t r) : rowId(r) {}
+
+	template<typename F>
+	void column(const char* name, F& value, bool key) {
+		if(key)
+			assign(value);
+	}
+
+	template<typename F> void assign(F& value) {}
+	void assign(int& value) { value = (int)rowId; }
+	void assign(long& value) { value = (long)rowId; }
+	void assign(long long& value) { value = rowId; }
+};
+
+/// reads integer key field as rowid
+struct CCEntityKeyGetter {
+	int64_t rowId;
+	bool found;
+
+	CCEntityKeyGetter() : rowId(0), found(false) {}
+
+	template<typename F>
+	void column(const char* name, F& value, bool key) {
+		if(key)
+			get(value);
+	}
+
+	template<typename F> void get(F& value) {}
+	void get(int& value) { rowId = value; found = true; }
+	void get(long& value) { rowId = value; found = true; }
+	void get(long long& value) { rowId = value; found = true; }
+};
+
+/**
+ * Persistence of an entity struct through generated prepared statements. Struct is
+ * described once by macros, and insert, update, delete and select by key statements
+ * are generated from it. Values are bound as parameters, no sql is formatted at runtime.
+ * \code
+ * struct Item { int64_t id; string name; double price; };
+ *
+ * CC_DB_TABLE_BEGIN(Item, "item")
+ *     CC_DB_KEY(id)
+ *     CC_DB_COLUMN(name)
+ *     CC_DB_COLUMN(price)
+ * CC_DB_TABLE_END(Item)
+ *
+ * CCEntityTable<Item>* items = CCEntityTable<Item>::create(db);
+ * items->createTable();
+ * Item sword = { 0, "sword", 10 };
+ * items->insert(sword); // sword.id is assigned
+ * \endcode
+ *
+ * \note
+ * Struct is also bound to CCResultSet::read, so custom queries can read it. Blob
+ * column must be a string field described by CC_DB_BLOB_COLUMN, it is bound as blob
+ * and bytes are copied into it. A string field described by CC_DB_COLUMN is bound as
+ * text. CCDataView field is rejected because it would point into statement memory
+ * after loading.
+ */
+template<typename T>
+class CCEntityTable : public CCEntityTableBase {
+protected:
+	CCEntityTable() {}
+
+public:
+	virtual ~CCEntityTable() {}
+
+	static CCEntityTable* create(CCDatabase* db) {
+		CCEntityTable* t = new CCEntityTable();
+		if(t->initWithDatabase(db)) {
+			return (CCEntityTable*)t->autorelease();
+		}
+		t->release();
+		return NULL;
+	}
+
+	virtual bool initWithDatabase(CCDatabase* db) {
+		T obj;
+		CCEntityColumnCollector c;
+		CCTableSchema<T>::visit(c, obj);
+		return initWithSchema(db, CCTableSchema<T>::tableName(), c);
+	}
+
+	/**
+	 * insert an entity. If key is an integer and zero, sqlite assigns a rowid and it is
+	 * written back to key field
+	 */
+	bool insert(T& obj) {
+		if(!beginStatement(kCCEntityInsert))
+			return false;
+		CCEntityBinder b(this, CCEntityBinder::ALL, 1, true);
+		CCTableSchema<T>::visit(b, obj);
+		bool ok = execute();
+		if(ok && b.keyAssigned) {
+			CCEntityKeySetter s(getDatabase()->lastInsertRowId());
+			CCTableSchema<T>::visit(s, obj);
+		}
+		return ok;
+	}
+
+	/// insert or replace an entity with same key
+	bool replace(T& obj) {
+		if(!beginStatement(kCCEntityReplace))
+			return false;
+		CCEntityBinder b(this, CCEntityBinder::ALL, 1);
+		CCTableSchema<T>::visit(b, obj);
+		return execute();
+	}
+
+	/// update an entity by key, return false if failed or table has no key
+	bool update(T& obj) {
+		if(!beginStatement(kCCEntityUpdate))
+			return false;
+		CCEntityBinder values(this, CCEntityBinder::VALUES, 1);
+		CCTableSchema<T>::visit(values, obj);
+		CCEntityBinder key(this, CCEntityBinder::KEY, values.index);
+		CCTableSchema<T>::visit(key, obj);
+		return execute();
+	}
+
+	/// delete an entity by its key
+	bool remove(T& obj) {
+		if(!beginStatement(kCCEntityDelete))
+			return false;
+		CCEntityBinder key(this, CCEntityBinder::KEY, 1);
+		CCTableSchema<T>::visit(key, obj);
+		return execute();
+	}
+
+	/// delete an entity by key value
+	template<typename K>
+	bool removeByKey(const K& key) {
+		if(!beginStatement(kCCEntityDelete))
+			return false;
+		bindValue(1, key);
+		return execute();
+	}
+
+	/**
+	 * load an entity by key value
+	 *
+	 * @return true if found, out is not changed if not found
+	 */
+	template<typename K>
+	bool load(const K& key, T& out) {
+		if(!beginStatement(kCCEntitySelectByKey))
+			return false;
+		bindValue(1, key);
+		bool found = step();
+		if(found) {
+			CCEntityReader r(this);
+			CCTableSchema<T>::visit(r, out);
+		}
+		finishStatement();
+		return found;
+	}
+
+	/// load all entities, they are appended to out
+	bool loadAll(vector<T>& out) {
+		if(!beginStatement(kCCEntitySelectAll))
+			return false;
+		while(step()) {
+			out.push_back(T());
+			CCEntityReader r(this);
+			CCTableSchema<T>::visit(r, out.back());
+		}
+		finishStatement();
+		return true;
+	}
+};
+
+NS_CC_END
+
+/**
+ * Describe an entity table, it must be used at global scope and type should be fully
+ * qualified. Columns are stored in listed order. See CCEntityTable
+ */
+#define CC_DB_TABLE_BEGIN(type, name) \
+	NS_CC_BEGIN \
+	template<> struct CCTableSchema<type> { \
+		static const char* tableName() { return name; } \
+		template<typename V> static void visit(V& v, type& o) {
+
+/// the primary key column of table, a table can have one key
+#define CC_DB_KEY(name) v.column(#name, o.name, true);
+
+/// a column of table
+#define CC_DB_COLUMN(name) v.column(#name, o.name, false);
+
+/// key or column whose sql name differs from field name, such as a name with space or a C++ keyword
+#define CC_DB_KEY_NAMED(name, columnName) v.column(columnName, o.name, true);
+#define CC_DB_COLUMN_NAMED(name, columnName) v.column(columnName, o.name, false);
+
+/// std::string key or column of BLOB type, it is bound by sqlite3_bind_blob so bytes are not stored as text
+#define CC_DB_BLOB_KEY(name) { CCEntityBlob b(o.name); v.column(#name, b, true); }
+#define CC_DB_BLOB_COLUMN(name) { CCEntityBlob b(o.name); v.column(#name, b, false); }
+#define CC_DB_BLOB_KEY_NAMED(name, columnName) { CCEntityBlob b(o.name); v.column(columnName, b, true); }
+#define CC_DB_BLOB_COLUMN_NAMED(name, columnName) { CCEntityBlob b(o.name); v.column(columnName, b, false); }
+
+/// end of table, it also binds entity to CCResultSet::read
+#define CC_DB_TABLE_END(type) \
+		} \
+	}; \
+	template<> struct CCRowFields<type> { \
+		template<typename V> static void visit(V& v, type& o) { \
+			CCEntityFieldAdapter<V> a(v); \
+			CCTableSchema<type>::visit(a, o); \
+		} \
+	}; \
+	NS_CC_END
+
+#endif // __CCEntityTable_h__
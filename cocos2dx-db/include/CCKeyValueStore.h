@@ -0,0 +1,236 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCKeyValueStore_h__
+#define __CCKeyValueStore_h__
+
+#include "cocos2d.h"
+#include "CCDatabaseWorker.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+class CCStringPool;
+
+/**
+ * Typed key value store kept in memory and persisted to a database table, a replacement of
+ * CCUserDefault for settings and flags. Keys are grouped by namespace, a namespace is loaded
+ * by one query when it is first touched and after that reading or writing a key is a hash
+ * lookup in memory.
+ * \code
+ * CCKeyValueStore* kv = CCKeyValueStore::create(db);
+ * kv->retain();
+ * kv->setBool("settings", "music", false);
+ * int level = kv->getInt("progress", "level", 1);
+ * \endcode
+ *
+ * \par persisting
+ * Changed keys are marked dirty. Dirty keys of all namespaces are written in one transaction
+ * by a worker connection, either when flush is called or after auto flush delay from first
+ * change. Worker runs jobs in order, so a later flush never lands before an earlier one. For
+ * in-memory or memory-resident database, which can't be shared with worker, flush writes
+ * through database on main thread. Destroying store flushes and waits for worker. If
+ * writing fails, such as when database is locked too long, values are marked dirty again
+ * and written by next flush.
+ *
+ * \par table
+ * CREATE TABLE kv_store (ns TEXT, key TEXT, type INTEGER, value, PRIMARY KEY(ns, key))
+ *
+ * \note
+ * Store is not thread safe, use it in main thread. Don't write same table by other ways while
+ * store is alive, store doesn't see it.
+ */
+class CC_DLL CCKeyValueStore : public CCObject {
+public:
+	/// value types
+	enum {
+		kTypeNone,
+		kTypeInteger,
+		kTypeDouble,
+		kTypeBool,
+		kTypeString
+	};
+
+private:
+	class FlushJob;
+
+	/// a value
+	struct Value {
+		int type;
+		int64_t i;
+		double d;
+		string s;
+
+		/// true if value is not persisted yet
+		bool dirty;
+
+		Value() : type(kTypeNone), i(0), d(0), dirty(false) {}
+	};
+
+	/// values of a namespace, code of key in pool is index of value
+	struct Namespace {
+		CCStringPool* keys;
+		vector<Value> values;
+
+		/// indices of dirty values
+		vector<int> dirty;
+
+		Namespace();
+		~Namespace();
+	};
+	typedef map<string, Namespace*> NamespaceMap;
+	NamespaceMap m_namespaces;
+
+	/// database
+	CCDatabase* m_db;
+
+	/// worker writing dirty values, NULL if database is in memory
+	CCDatabaseWorker* m_worker;
+
+	/// table name
+	string m_table;
+
+	/// seconds from first change to auto flush, 0 or negative means no auto flush
+	float m_autoFlushDelay;
+
+	/// true if auto flush is scheduled
+	bool m_flushScheduled;
+
+	/// dirty value count
+	int m_dirtyCount;
+
+	/// true in destructor, failed flush must not schedule auto flush then
+	bool m_destroying;
+
+private:
+	/// get a namespace, load it if not loaded
+	Namespace* getNamespace(const string& ns);
+
+	/// load values of a namespace
+	void load(const string& ns, Namespace* n);
+
+	/// get a value, or NULL if not found
+	const Value* find(const string& ns, const string& key);
+
+	/// get a value for writing, it is created if not found and marked dirty
+	Value* edit(const string& ns, const string& key);
+
+	/// mark a value dirty and schedule auto flush
+	void markDirty(Namespace* n, int index);
+
+	/// mark values of a failed flush dirty again, so they are written by next flush
+	void markDirty(FlushJob* job);
+
+	/// auto flush callback
+	void onAutoFlush(float dt);
+
+	/// write values on main thread
+	bool writeNow(FlushJob* job);
+
+protected:
+	CCKeyValueStore();
+
+	/// initialization
+	bool initWithDatabase(CCDatabase* db, const string& table);
+
+public:
+	virtual ~CCKeyValueStore();
+
+	/**
+	 * create a store
+	 *
+	 * @param db database, it must be opened
+	 * @param table table name, it is created if not existent
+	 * @return store instance, autoreleased
+	 */
+	static CCKeyValueStore* create(CCDatabase* db, const string& table = "kv_store");
+
+	/// get integer value, or default value if not found
+	int getInt(const string& ns, const string& key, int def = 0) { return (int)getInt64(ns, key, def); }
+
+	/// get int64_t value, or default value if not found
+	int64_t getInt64(const string& ns, const string& key, int64_t def = 0);
+
+	/// get float value, or default value if not found
+	double getDouble(const string& ns, const string& key, double def = 0);
+
+	/// get bool value, or default value if not found
+	bool getBool(const string& ns, const string& key, bool def = false);
+
+	/// get string value, or default value if not found
+	string getString(const string& ns, const string& key, const string& def = "");
+
+	/// set integer value
+	void setInt(const string& ns, const string& key, int value) { setInt64(ns, key, value); }
+
+	/// set int64_t value
+	void setInt64(const string& ns, const string& key, int64_t value);
+
+	/// set float value
+	void setDouble(const string& ns, const string& key, double value);
+
+	/// set bool value
+	void setBool(const string& ns, const string& key, bool value);
+
+	/// set string value
+	void setString(const string& ns, const string& key, const string& value);
+
+	/// check a key exists
+	bool hasKey(const string& ns, const string& key) { return find(ns, key) != NULL; }
+
+	/// get value type of a key, kTypeNone if not found
+	int getType(const string& ns, const string& key);
+
+	/// remove a key
+	void remove(const string& ns, const string& key);
+
+	/// get keys of a namespace
+	void getKeys(const string& ns, vector<string>& out);
+
+	/// load a namespace now, so first access later doesn't query
+	void preload(const string& ns) { getNamespace(ns); }
+
+	/**
+	 * write dirty values. Writing is done by worker, call waitUntilSaved if it must be done
+	 * before continuing, such as when app enters background
+	 */
+	void flush();
+
+	/// block until all flushed values are written
+	void waitUntilSaved();
+
+	/// set seconds from first change to auto flush, 0 disables auto flush and flushes now. Default is 1 second
+	void setAutoFlushDelay(float delay);
+
+	/// get auto flush delay
+	float getAutoFlushDelay() { return m_autoFlushDelay; }
+
+	/// get count of values not flushed yet
+	int getDirtyCount() { return m_dirtyCount; }
+};
+
+NS_CC_END
+
+#endif // __CCKeyValueStore_h__
@@ -0,0 +1,271 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCMaterializedResultSet_h__
+#define __CCMaterializedResultSet_h__
+
+#include "cocos2d.h"
+#include "CCResultSet.h"
+
+struct sqlite3_stmt;
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCStringPool;
+
+/**
+ * A result set whose rows are all read into memory. It is created by CCResultSet::materialize,
+ * which steps the statement to the end and releases it, so the connection is free for other
+ * work. Cursor can move forward, backward or to any row, and row count is known.
+ *
+ * \par storage
+ * Cells are stored row by row in one array, every cell keeps its sqlite storage type and a
+ * value. Text and blob bytes are copied into one arena buffer so a query allocates only a
+ * few times no matter how many rows. Typed accessors convert value like sqlite does.
+ *
+ * \par cursor
+ * Cursor starts before first row like CCResultSet, so the usual while(rs->next()) loop
+ * works. After next returns false, cursor is after last row and previous moves back to
+ * last row.
+ *
+ * \par string interning
+ * If a string pool is given to materialize, text cells are interned in pool and a cell
+ * only keeps the dictionary code. Repeated values, such as item types or localization keys,
+ * are stored once and can be compared by code. stringRefForColumnIndex returns a reference
+ * to pooled string without copy.
+ */
+class CC_DLL CCMaterializedResultSet : public CCObject {
+	friend class CCResultSet;
+
+private:
+	/// a cell value
+	struct Cell {
+		union {
+			int64_t i;
+			double d;
+			struct {
+				uint32_t offset;
+				uint32_t length;
+			} bytes;
+		} v;
+
+		/// sqlite storage type, SQLITE_NULL if null, or interned text whose value is code
+		int type;
+	};
+	typedef vector<Cell> CellList;
+	typedef vector<string> StringList;
+
+	/// rows and columns, shared by copies of result set
+	class Data : public CCObject {
+	public:
+		/// cells, row by row
+		CellList m_cells;
+
+		/// text and blob bytes, text is null terminated
+		vector<char> m_arena;
+
+		/// column names in lowercase
+		StringList m_columnNames;
+
+		/// column count
+		int m_columnCount;
+
+		/// row count
+		int m_rowCount;
+
+		/// string pool for text cells, or NULL if text is not interned
+		CCStringPool* m_pool;
+
+	public:
+		Data();
+		virtual ~Data();
+	};
+
+	/// rows, never NULL
+	Data* m_data;
+
+	/// cursor, -1 is before first row and m_rowCount is after last row
+	int m_cursor;
+
+	/// holds value returned by stringRefForColumnIndex if cell is not interned
+	string m_scratch;
+
+protected:
+	CCMaterializedResultSet();
+
+	/// setup columns from statement, pool can be NULL
+	void initWithStatement(sqlite3_stmt* stmt, CCStringPool* pool);
+
+	/// copy current row of statement
+	void appendRow(sqlite3_stmt* stmt);
+
+	/// get cell at current row, or NULL if cursor or index is invalid
+	const Cell* cellAt(int columnIdx);
+
+	/// get bytes of a text or blob cell, or NULL for other types
+	const char* bytesOf(const Cell* c, uint32_t* outLen);
+
+public:
+	virtual ~CCMaterializedResultSet();
+
+	/// get row count
+	int rowCount() { return m_data->m_rowCount; }
+
+	/// get column count
+	int columnCount() { return m_data->m_columnCount; }
+
+	/// get cursor position, -1 means before first row
+	int getPosition() { return m_cursor; }
+
+	/// move to next row, return false if no more rows
+	bool next();
+
+	/// move to previous row, return false if no previous row
+	bool previous();
+
+	/**
+	 * move cursor to a row
+	 *
+	 * @param row row index, from 0 to rowCount - 1
+	 * @return false if row is out of range, cursor is not moved in that case
+	 */
+	bool moveTo(int row);
+
+	/// move to first row, return false if empty
+	bool first() { return moveTo(0); }
+
+	/// move to last row, return false if empty
+	bool last() { return moveTo(m_data->m_rowCount - 1); }
+
+	/// move cursor before first row, so next can iterate again
+	void rewind() { m_cursor = -1; }
+
+	/// get column index by name, or -1 if not found
+	int columnIndexForName(string columnName);
+
+	/// get column name by index, or empty string if index is invalid
+	string columnNameForIndex(int columnIdx);
+
+	/// is a column null at current row?
+	bool columnIndexIsNull(int columnIdx);
+
+	/// is a column null at current row?
+	bool columnIsNull(string columnName);
+
+	/// get integer value in a column at current row
+	int intForColumn(string columnName);
+
+	/// get integer value in a column at current row
+	int intForColumnIndex(int columnIdx);
+
+	/// get long value in a column at current row
+	long longForColumn(string columnName);
+
+	/// get long value in a column at current row
+	long longForColumnIndex(int columnIdx);
+
+	/// get int64_t value in a column at current row
+	int64_t int64ForColumn(string columnName);
+
+	/// get int64_t value in a column at current row
+	int64_t int64ForColumnIndex(int columnIdx);
+
+	/// get bool value in a column at current row
+	bool boolForColumn(string columnName);
+
+	/// get bool value in a column at current row
+	bool boolForColumnIndex(int columnIdx);
+
+	/// get double value in a column at current row
+	double doubleForColumn(string columnName);
+
+	/// get double value in a column at current row
+	double doubleForColumnIndex(int columnIdx);
+
+	/// get string value in a column at current row, or empty string if null
+	string stringForColumn(string columnName);
+
+	/// get string value in a column at current row, or empty string if null
+	string stringForColumnIndex(int columnIdx);
+
+	/**
+	 * get text in a column at current row without copy. It is valid until result
+	 * set is released
+	 *
+	 * @return null terminated text, or NULL if value is null or not text
+	 */
+	const char* textForColumnIndex(int columnIdx);
+
+	/// get text in a column at current row without copy, valid until result set is released.
+	/// Numbers are not converted and give an empty view, use stringForColumnIndex for them
+	CCDataView textViewForColumnIndex(int columnIdx);
+
+	/// get blob in a column at current row without copy, valid until result set is released
+	CCDataView blobViewForColumnIndex(int columnIdx);
+
+	/**
+	 * get string value in a column at current row without copy if it is interned. If not
+	 * interned, returned reference is valid until next call
+	 */
+	const string& stringRefForColumn(string columnName);
+
+	/**
+	 * get string value in a column at current row without copy if it is interned. If not
+	 * interned, returned reference is valid until next call
+	 */
+	const string& stringRefForColumnIndex(int columnIdx);
+
+	/// get dictionary code of a text cell at current row, or -1 if it is not interned
+	int codeForColumn(string columnName);
+
+	/// get dictionary code of a text cell at current row, or -1 if it is not interned
+	int codeForColumnIndex(int columnIdx);
+
+	/// get blob value in a column at current row, caller should NOT release it.
+	/// It is valid until result set is released
+	const void* dataNoCopyForColumn(string columnName, size_t* outLen);
+
+	/// get blob value in a column at current row, caller should NOT release it.
+	/// It is valid until result set is released
+	const void* dataNoCopyForColumnIndex(int columnIdx, size_t* outLen);
+
+	/// get memory used by cells and arena, in bytes. Shared string pool is not counted
+	size_t getMemorySize();
+
+	/**
+	 * create a result set sharing rows with this one, it has its own cursor. Rows are not
+	 * copied so it is cheap, it is used to hand out a cached result to many readers
+	 *
+	 * @return autoreleased result set, cursor is before first row
+	 */
+	CCMaterializedResultSet* copy();
+
+	/// get string pool used for text cells, or NULL if text is not interned
+	CCStringPool* getStringPool() { return m_data->m_pool; }
+};
+
+NS_CC_END
+
+#endif // __CCMaterializedResultSet_h__
@@ -0,0 +1,110 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCQueryCache_h__
+#define __CCQueryCache_h__
+
+#include "cocos2d.h"
+#include <list>
+#include <set>
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCMaterializedResultSet;
+
+/**
+ * Cache of materialized query results, used by CCDatabase::executeCachedQuery. A result is
+ * keyed by final sql, which includes formatted arguments, and it depends on tables the
+ * query reads. Writing a table drops all results depending on it.
+ *
+ * Cache is bounded by entry count, least recently used result is dropped first. Tables a
+ * sql reads are kept with its result and dropped with it, so memory doesn't grow with
+ * distinct sql.
+ */
+class CC_DLL CCQueryCache : public CCObject {
+private:
+	typedef vector<string> StringList;
+	typedef list<string> SQLList;
+
+	/// a cached result
+	struct Entry {
+		CCMaterializedResultSet* rs;
+		SQLList::iterator lru;
+
+		/// tables read by sql, in lowercase
+		StringList tables;
+	};
+	typedef map<string, Entry> EntryMap;
+	EntryMap m_entries;
+
+	/// sql by recent use, most recent is at front
+	SQLList m_lru;
+
+	/// cached sql by table
+	typedef map<string, set<string> > TableMap;
+	TableMap m_tables;
+
+private:
+	/// remove an entry
+	void removeEntry(EntryMap::iterator iter);
+
+protected:
+	CCQueryCache();
+
+public:
+	virtual ~CCQueryCache();
+	static CCQueryCache* create();
+
+	/// get cached result, or NULL if not cached. It is moved to most recent
+	CCMaterializedResultSet* lookup(const string& sql);
+
+	/// cache a result with tables read by sql
+	void store(const string& sql, CCMaterializedResultSet* rs, const StringList& tables);
+
+	/// drop results which read a table
+	void invalidateTable(const string& table);
+
+	/// drop all results
+	void clear();
+
+	/// get cached result count
+	int getCount() { return (int)m_entries.size(); }
+
+	/// max cached results, default is 64
+	CC_SYNTHESIZE(int, m_maxEntries, MaxEntries);
+
+	/// hit count
+	CC_SYNTHESIZE_READONLY(int, m_hits, Hits);
+
+	/// miss count
+	CC_SYNTHESIZE_READONLY(int, m_misses, Misses);
+
+	/// dropped result count by table writes
+	CC_SYNTHESIZE_READONLY(int, m_invalidations, Invalidations);
+};
+
+NS_CC_END
+
+#endif // __CCQueryCache_h__
@@ -25,6 +25,7 @@
 #define __CCResultSet_h__
 
 #include "cocos2d.h"
+#include "CCRowBinding.h"
 
 using namespace std;
 
@@ -32,6 +33,45 @@ NS_CC_BEGIN
 
 class CCDatabase;
 class CCStatement;
+class CCColumnBatch;
+class CCMaterializedResultSet;
+class CCStringPool;
+class CCVariantRow;
+
+/**
+ * A non-owning view of text or blob in a result set. It points to buffer of sqlite so no
+ * copy is made, and it is only valid until cursor moves or result set is closed. Null value
+ * is a view whose isNull returns true, empty value is a non-null view with zero length.
+ * Text is not guaranteed to be null terminated.
+ */
+struct CC_DLL CCDataView {
+	/// bytes, never NULL for non-null value
+	const char* bytes;
+
+	/// byte length
+	size_t length;
+
+	/// true if value is null
+	bool null;
+
+	/// a null view
+	CCDataView() : bytes(NULL), length(0), null(true) {}
+
+	/// a non-null view
+	CCDataView(const char* b, size_t len) : bytes(b ? b : ""), length(len), null(false) {}
+
+	/// is value null?
+	bool isNull() const { return null; }
+
+	/// is value empty or null?
+	bool empty() const { return length == 0; }
+
+	/// copy to a string, null is empty string
+	string toString() const { return null ? string() : string(bytes, length); }
+
+	/// compare with a null terminated string, null view equals nothing
+	bool equals(const char* s) const { return !null && strlen(s) == length && memcmp(bytes, s, length) == 0; }
+};
 
 /**
  * result set
@@ -47,6 +87,40 @@ private:
     /// sql string which generates this result set
     string m_sql;
 
+	/// batch buffer reused by fetchBatch
+	CCColumnBatch* m_batch;
+
+	/// unique id of result set, a batch records it so decided types are kept only for its filler
+	unsigned int m_serial;
+
+	/// decoded current row, only created if row decoding is enabled
+	CCVariantRow* m_row;
+
+	/// columns of fields read by read or row, checked once
+	vector<int> m_fieldColumns;
+
+	/// row type of checked fields, see CCRowTypeKey. Fields are checked again only if it changes
+	const void* m_fieldType;
+
+	/// are checked fields matched with columns?
+	bool m_fieldsMatched;
+
+private:
+	/// step statement, close if no more rows
+	bool step();
+
+	/**
+	 * check typed fields against columns and map them to column indexes. Caller does it
+	 * only when row type differs from m_fieldType, mismatch is logged as error
+	 *
+	 * @param type row type key, see CCRowTypeKey
+	 * @param kinds field kinds, kCCFieldInteger, etc.
+	 * @param names field names, or NULL if fields are mapped by position
+	 * @param count field count
+	 * @return true if fields match columns
+	 */
+	bool prepareFields(const void* type, const int* kinds, const char* const* names, int count);
+
 protected:
     /// constructor
     CCResultSet(CCDatabase* db, CCStatement* statement);
@@ -80,6 +154,50 @@ public:
 	/// get column count in result set
     int columnCount();
 
+	/**
+	 * enable or disable row decoding. If enabled, next decodes all columns of row once,
+	 * and accessors read decoded values instead of calling sqlite per access. It is better
+	 * if columns are read more than once per row. Call it before first next
+	 */
+	void setDecodesRows(bool flag);
+
+	/// is row decoding enabled?
+	bool decodesRows() { return m_row != NULL; }
+
+	/// get decoded current row, or NULL if row decoding is not enabled
+	CCVariantRow* getRow() { return m_row; }
+
+	/**
+	 * fetch next rows into a column batch, cursor is moved to last fetched row. Column
+	 * values are read from sqlite once and stored in typed column arrays, so aggregating
+	 * a column is a loop over an array
+	 *
+	 * @param maxRows max rows to be fetched
+	 * @return internal batch which is reused by next fetchBatch, its row count is 0 if
+	 * 		no more rows. It is released when result set is released
+	 */
+	CCColumnBatch* fetchBatch(int maxRows);
+
+	/**
+	 * fetch next rows into a caller provided batch
+	 *
+	 * @param batch batch to be filled, its buffers are reused
+	 * @param maxRows max rows to be fetched
+	 * @return fetched row count, 0 means no more rows
+	 */
+	int fetchBatch(CCColumnBatch* batch, int maxRows);
+
+	/**
+	 * read all remaining rows into memory and close this result set, so statement and
+	 * connection are released immediately. Returned result set supports row count and
+	 * random access
+	 *
+	 * @param pool if not NULL, text values are interned in this pool and cells keep codes,
+	 * 		it saves memory when text values repeat a lot. Pool is retained by returned result set
+	 * @return autoreleased materialized result set, it is empty if this result set is closed
+	 */
+	CCMaterializedResultSet* materialize(CCStringPool* pool = NULL);
+
 	/// is type of a column is null?
     bool columnIndexIsNull(int columnIdx);
 
@@ -122,12 +240,113 @@ public:
 	/// get double value in a column at current cursor
     double doubleForColumnIndex(int columnIdx);
 
-	/// get string value in a column at current cursor
+	/// get string value in a column at current cursor, empty string if it is null
     string stringForColumn(string columnName);
 
-	/// get string value in a column at current cursor
+	/// get string value in a column at current cursor, empty string if it is null
     string stringForColumnIndex(int columnIdx);
 
+	/// get text in a column at current cursor without copy, valid until cursor moves
+	CCDataView textViewForColumn(string columnName);
+
+	/// get text in a column at current cursor without copy, valid until cursor moves
+	CCDataView textViewForColumnIndex(int columnIdx);
+
+	/// get blob in a column at current cursor without copy, valid until cursor moves
+	CCDataView blobViewForColumn(string columnName);
+
+	/// get blob in a column at current cursor without copy, valid until cursor moves
+	CCDataView blobViewForColumnIndex(int columnIdx);
+
+	/// read a column at current cursor into a typed value, used by typed row extraction
+	void readColumn(int columnIdx, bool& out) { out = boolForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, int& out) { out = intForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, long& out) { out = (long)int64ForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, long long& out) { out = int64ForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, float& out) { out = (float)doubleForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, double& out) { out = doubleForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, string& out) { out = stringForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, CCDataView& out) { out = blobViewForColumnIndex(columnIdx); }
+	void readColumn(int columnIdx, CCRowNone& out) {}
+
+	/**
+	 * read current row into a typed tuple by column position. Field count and types are
+	 * checked against the statement when first row is read, mismatch is logged and false
+	 * is returned
+	 */
+	template<typename T0, typename T1, typename T2, typename T3, typename T4, typename T5>
+	bool readRow(CCRowTuple<T0, T1, T2, T3, T4, T5>& t) {
+		const void* type = CCRowTypeKey<CCRowTuple<T0, T1, T2, T3, T4, T5> >::key();
+		if(type != m_fieldType) {
+			int kinds[6] = {
+				ccFieldKind(t.v0), ccFieldKind(t.v1), ccFieldKind(t.v2),
+				ccFieldKind(t.v3), ccFieldKind(t.v4), ccFieldKind(t.v5)
+			};
+			int count = 0;
+			while(count < 6 && kinds[count] != kCCFieldNone)
+				count++;
+			prepareFields(type, kinds, NULL, count);
+		}
+		if(!m_fieldsMatched)
+			return false;
+		readColumn(0, t.v0);
+		readColumn(1, t.v1);
+		readColumn(2, t.v2);
+		readColumn(3, t.v3);
+		readColumn(4, t.v4);
+		readColumn(5, t.v5);
+		return true;
+	}
+
+	/**
+	 * get current row as typed tuple, for example rs->row<int64_t, string, double>().
+	 * Values are default if types mismatch, see readRow
+	 */
+	template<typename T0>
+	CCRowTuple<T0> row() { CCRowTuple<T0> t; readRow(t); return t; }
+
+	/// get current row as typed tuple, see row<T0>
+	template<typename T0, typename T1>
+	CCRowTuple<T0, T1> row() { CCRowTuple<T0, T1> t; readRow(t); return t; }
+
+	/// get current row as typed tuple, see row<T0>
+	template<typename T0, typename T1, typename T2>
+	CCRowTuple<T0, T1, T2> row() { CCRowTuple<T0, T1, T2> t; readRow(t); return t; }
+
+	/// get current row as typed tuple, see row<T0>
+	template<typename T0, typename T1, typename T2, typename T3>
+	CCRowTuple<T0, T1, T2, T3> row() { CCRowTuple<T0, T1, T2, T3> t; readRow(t); return t; }
+
+	/// get current row as typed tuple, see row<T0>
+	template<typename T0, typename T1, typename T2, typename T3, typename T4>
+	CCRowTuple<T0, T1, T2, T3, T4> row() { CCRowTuple<T0, T1, T2, T3, T4> t; readRow(t); return t; }
+
+	/// get current row as typed tuple, see row<T0>
+	template<typename T0, typename T1, typename T2, typename T3, typename T4, typename T5>
+	CCRowTuple<T0, T1, T2, T3, T4, T5> row() { CCRowTuple<T0, T1, T2, T3, T4, T5> t; readRow(t); return t; }
+
+	/**
+	 * read current row into a struct bound by CC_DB_FIELDS_BEGIN. Fields are matched to
+	 * columns by name and checked when first row is read
+	 *
+	 * @return false if fields don't match columns, struct is not changed in that case
+	 */
+	template<typename T>
+	bool read(T& obj) {
+		// fields are collected only for first row of a type
+		const void* type = CCRowTypeKey<T>::key();
+		if(type != m_fieldType) {
+			CCRowFieldCollector c;
+			CCRowFields<T>::visit(c, obj);
+			prepareFields(type, c.kinds, c.names, c.count);
+		}
+		if(!m_fieldsMatched)
+			return false;
+		CCRowFieldReader<CCResultSet> r(this, &m_fieldColumns[0]);
+		CCRowFields<T>::visit(r, obj);
+		return true;
+	}
+
 	/// get blob value in a column at current cursor
 	/// returned data is copied from original data so caller should release it
     const void* dataForColumn(string columnName, size_t* outLen);
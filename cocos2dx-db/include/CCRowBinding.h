@@ -0,0 +1,155 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCRowBinding_h__
+#define __CCRowBinding_h__
+
+#include "cocos2d.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+struct CCDataView;
+
+/**
+ * kind of a typed field, used to check field types against declared column types
+ */
+enum {
+	kCCFieldNone = -1,
+	kCCFieldInteger,
+	kCCFieldFloat,
+	kCCFieldText,
+	kCCFieldBlob
+};
+
+/// placeholder of unused tuple element
+struct CCRowNone {};
+
+/**
+ * A typed row returned by CCResultSet::row, values are v0, v1, ... in column order. It
+ * supports up to 6 columns, unused elements are CCRowNone.
+ */
+template<typename T0, typename T1 = CCRowNone, typename T2 = CCRowNone, typename T3 = CCRowNone, typename T4 = CCRowNone, typename T5 = CCRowNone>
+struct CCRowTuple {
+	T0 v0;
+	T1 v1;
+	T2 v2;
+	T3 v3;
+	T4 v4;
+	T5 v5;
+
+	CCRowTuple() : v0(), v1(), v2(), v3(), v4(), v5() {}
+};
+
+/**
+ * Field list of a struct, it must be specialized by CC_DB_FIELDS_BEGIN macros before a
+ * struct can be read by CCResultSet::read. Reading an unbound struct fails to compile.
+ */
+template<typename T>
+struct CCRowFields;
+
+/// an address unique to a row type, so that checked fields can be recognized without collecting them again
+template<typename T>
+struct CCRowTypeKey {
+	static const void* key() {
+		static char k;
+		return &k;
+	}
+};
+
+/// field kind of C++ types, int64_t is one of long or long long
+inline int ccFieldKind(const CCRowNone&) { return kCCFieldNone; }
+inline int ccFieldKind(const bool&) { return kCCFieldInteger; }
+inline int ccFieldKind(const int&) { return kCCFieldInteger; }
+inline int ccFieldKind(const long&) { return kCCFieldInteger; }
+inline int ccFieldKind(const long long&) { return kCCFieldInteger; }
+inline int ccFieldKind(const float&) { return kCCFieldFloat; }
+inline int ccFieldKind(const double&) { return kCCFieldFloat; }
+inline int ccFieldKind(const string&) { return kCCFieldText; }
+inline int ccFieldKind(const CCDataView&) { return kCCFieldBlob; }
+
+/// max fields of a bound struct
+#define CC_DB_MAX_FIELDS 64
+
+/// collects field names and kinds of a struct
+struct CCRowFieldCollector {
+	int kinds[CC_DB_MAX_FIELDS];
+	const char* names[CC_DB_MAX_FIELDS];
+	int count;
+
+	CCRowFieldCollector() : count(0) {}
+
+	template<typename F>
+	void field(const char* name, F& value) {
+		if(count < CC_DB_MAX_FIELDS) {
+			kinds[count] = ccFieldKind(value);
+			names[count] = name;
+		}
+		count++;
+	}
+};
+
+/// reads fields of a struct from mapped columns
+template<typename RS>
+struct CCRowFieldReader {
+	RS* rs;
+	const int* columns;
+	int index;
+
+	CCRowFieldReader(RS* r, const int* c) : rs(r), columns(c), index(0) {}
+
+	template<typename F>
+	void field(const char* name, F& value) {
+		rs->readColumn(columns[index++], value);
+	}
+};
+
+NS_CC_END
+
+/**
+ * Bind fields of a struct to columns by name, it must be used at global scope and type
+ * should be fully qualified. Field names must match column names, case insensitive:
+ * \code
+ * CC_DB_FIELDS_BEGIN(Item)
+ *     CC_DB_FIELD(id)
+ *     CC_DB_FIELD(name)
+ *     CC_DB_FIELD(price)
+ * CC_DB_FIELDS_END()
+ * \endcode
+ */
+#define CC_DB_FIELDS_BEGIN(type) \
+	NS_CC_BEGIN \
+	template<> struct CCRowFields<type> { \
+		template<typename V> static void visit(V& v, type& o) {
+
+/// bind a field, see CC_DB_FIELDS_BEGIN
+#define CC_DB_FIELD(name) v.field(#name, o.name);
+
+/// end of field list, see CC_DB_FIELDS_BEGIN
+#define CC_DB_FIELDS_END() \
+		} \
+	}; \
+	NS_CC_END
+
+#endif // __CCRowBinding_h__
@@ -0,0 +1,171 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCSchemaCatalog_h__
+#define __CCSchemaCatalog_h__
+
+#include "cocos2d.h"
+
+struct sqlite3_stmt;
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+class CCStringPool;
+
+/**
+ * In-memory copy of main database schema, used by CCDatabase::tableExists and
+ * CCDatabase::columnExists so that they don't scan sqlite_master and run table_info
+ * every time. Tables and columns are loaded once, lookup is a hash lookup of lower
+ * case name.
+ *
+ * Before every lookup PRAGMA schema_version is read with a kept statement, it is cheap
+ * because it reads database header only. If version is changed, by this connection or
+ * another one, catalogue is loaded again.
+ *
+ * \note
+ * Catalogue is owned by CCDatabase, it is not thread safe.
+ */
+class CC_DLL CCSchemaCatalog : public CCObject {
+public:
+	/// a column of table, same as a row of PRAGMA table_info
+	struct Column {
+		/// name, in declared case
+		string name;
+
+		/// declared type, empty if not declared
+		string type;
+
+		/// default value expression, empty if no default value
+		string defaultValue;
+
+		/// has not null constraint
+		bool notNull;
+
+		/// is part of primary key
+		bool primaryKey;
+	};
+
+	/// a table
+	class Table {
+		friend class CCSchemaCatalog;
+
+	private:
+		/// lower case column names, code of name is column index
+		CCStringPool* m_columnNames;
+
+	public:
+		/// name, in declared case
+		string name;
+
+		/// columns in declared order
+		vector<Column> columns;
+
+	public:
+		Table();
+		Table(const Table& t);
+		~Table();
+		Table& operator=(const Table& t);
+
+		/// get index of a column, case insensitive, or -1 if not found
+		int columnIndex(string columnName) const;
+
+		/// get a column, or NULL if not found
+		const Column* findColumn(const string& columnName) const;
+	};
+
+private:
+	/// database
+	CCDatabase* m_db;
+
+	/// kept statement reading schema version
+	sqlite3_stmt* m_versionStmt;
+
+	/// schema version of loaded catalogue, -1 means not loaded
+	int m_version;
+
+	/// lower case table names, code of name is table index
+	CCStringPool* m_tableNames;
+
+	/// tables
+	vector<Table> m_tables;
+
+	/// times catalogue is loaded
+	CC_SYNTHESIZE_READONLY(int, m_loadCount, LoadCount);
+
+private:
+	/// read current schema version, or -1 if failed
+	int readVersion();
+
+	/// load tables and columns
+	bool load(int version);
+
+protected:
+	CCSchemaCatalog();
+
+	/// initialization
+	bool initWithDatabase(CCDatabase* db);
+
+public:
+	virtual ~CCSchemaCatalog();
+
+	/**
+	 * create a catalogue of a database, it doesn't retain database
+	 *
+	 * @param db database, should be opened before lookup
+	 * @return catalogue instance, autoreleased
+	 */
+	static CCSchemaCatalog* create(CCDatabase* db);
+
+	/**
+	 * make sure catalogue matches database schema, load it if schema is changed.
+	 * Lookup methods call it so normally it is not needed to be called
+	 *
+	 * @return false if schema can't be read
+	 */
+	bool validate();
+
+	/// drop loaded catalogue and kept statement, it must be called before database is closed
+	void reset();
+
+	/// get a table, case insensitive, or NULL if not found. Pointer is valid until schema is changed
+	const Table* findTable(string tableName);
+
+	/// check a table is existent or not
+	bool tableExists(const string& tableName) { return findTable(tableName) != NULL; }
+
+	/// check a column is existent or not
+	bool columnExists(const string& tableName, const string& columnName);
+
+	/// get table count
+	int getTableCount();
+
+	/// get table by index, index is in order of sqlite_master
+	const Table* getTableAt(int index);
+};
+
+NS_CC_END
+
+#endif // __CCSchemaCatalog_h__
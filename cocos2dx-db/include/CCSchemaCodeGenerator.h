@@ -0,0 +1,127 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCSchemaCodeGenerator_h__
+#define __CCSchemaCodeGenerator_h__
+
+#include "cocos2d.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * Generates C++ code from schema of a database. For every table, it emits a row struct,
+ * column index constants, a select statement whose column order matches indexes, a
+ * load function which reads a row by column index, and an entity table description so
+ * the row can be stored by CCEntityTable.
+ *
+ * It is meant to be run on host, by tools/schema2cpp or a desktop build of game, and the
+ * generated header is committed with content database so code stays in sync with it.
+ *
+ * \par type mapping
+ * Declared column type is mapped by sqlite affinity rules: INTEGER to int64_t, TEXT to
+ * std::string, REAL to double, BLOB to std::string which holds raw bytes, NUMERIC to
+ * double. Null values are loaded as zero or empty string. Column declared BLOB is
+ * described by CC_DB_BLOB_COLUMN, so CCEntityTable stores it back as blob. Column without
+ * declared type is std::string too, but it is stored back as text.
+ *
+ * \par names
+ * Column name which is not a valid identifier, such as "first name" or "class", is
+ * converted to member first_name or class_, and names in sql are quoted.
+ */
+class CC_DLL CCSchemaCodeGenerator : public CCObject {
+private:
+	/// a column
+	struct Column {
+		string name;
+		string type;
+		bool key;
+
+		/// C++ member name, unique in struct
+		string member;
+
+		/// suffix of index constant, unique in table
+		string index;
+	};
+	typedef vector<Column> ColumnList;
+
+	/// tables to generate, all tables if empty
+	typedef vector<string> StringList;
+	StringList m_tables;
+
+private:
+	/// read columns of a table, return false if table doesn't exist
+	bool readColumns(const string& table, ColumnList& columns);
+
+	/// generate code of a table
+	void generateTable(const string& table, const ColumnList& columns, string& out);
+
+	/// convert name to CamelCase identifier
+	static string camelName(const string& name);
+
+	/// convert name to a valid member name, keyword gets a suffix
+	static string memberName(const string& name);
+
+	/// is name a C++ keyword?
+	static bool isKeyword(const string& name);
+
+	/// escape string so that it can be put in C++ string literal
+	static string cString(const string& s);
+
+	/// map declared type to C++ type
+	static string cppType(const string& declType);
+
+	/// is declared type blob affinity?
+	static bool isBlob(const string& declType);
+
+protected:
+	CCSchemaCodeGenerator();
+
+public:
+	virtual ~CCSchemaCodeGenerator();
+	static CCSchemaCodeGenerator* create(CCDatabase* db);
+	virtual bool initWithDatabase(CCDatabase* db);
+
+	/// generate only given table, call it multiple times for more tables
+	void addTable(string table) { m_tables.push_back(table); }
+
+	/**
+	 * generate header code
+	 *
+	 * @param guard header guard macro name
+	 * @return generated code, or empty string if database has no table
+	 */
+	string generate(string guard);
+
+	/// generate header code and write it to a file, return false if failed
+	bool writeToFile(string path);
+
+	CC_SYNTHESIZE_READONLY(CCDatabase*, m_db, Database);
+};
+
+NS_CC_END
+
+#endif // __CCSchemaCodeGenerator_h__
@@ -0,0 +1,225 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCStaticTable_h__
+#define __CCStaticTable_h__
+
+#include "cocos2d.h"
+#include "CCResultSet.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * Immutable in-memory copy of a table which never changes at runtime, such as localization
+ * strings or item definitions. It is loaded once and lookup by key is a hash probe, no sql
+ * is run.
+ * \code
+ * CCStaticTable* strings = CCStaticTable::create(db, "strings", "key", "key, en, zh");
+ * strings->retain();
+ * string title = strings->stringForKey("title", 1); // en column
+ * \endcode
+ *
+ * \par key lookup
+ * A minimal perfect hash is built on key column when table is loaded. Keys are hashed into
+ * buckets, and every bucket finds a displacement which maps its keys to free slots, so n
+ * keys occupy exactly n slots with no collision. Lookup hashes key, reads displacement of
+ * its bucket and compares key of one row, a missing key costs same as an existing one.
+ *
+ * \par storage
+ * Rows are stored in slot order, so slot is row index. Cells are packed in one array and
+ * text or blob bytes in one arena, text is null terminated.
+ *
+ * \note
+ * Key column must be all integers or all text, and keys must be unique. Table is read only
+ * after loading so it can be read from any thread.
+ */
+class CC_DLL CCStaticTable : public CCObject {
+private:
+	/// a cell value
+	struct Cell {
+		union {
+			int64_t i;
+			double d;
+			struct {
+				uint32_t offset;
+				uint32_t length;
+			} bytes;
+		} v;
+
+		/// sqlite storage type
+		int type;
+	};
+
+	/// cells, row by row in slot order
+	vector<Cell> m_cells;
+
+	/// text and blob bytes
+	vector<char> m_arena;
+
+	/// displacement of every bucket
+	vector<uint32_t> m_displacements;
+
+	/// column names in lowercase
+	vector<string> m_columnNames;
+
+	/// column count
+	int m_columnCount;
+
+	/// row count
+	int m_rowCount;
+
+	/// key column index
+	int m_keyIndex;
+
+	/// true if keys are text, false if integers
+	bool m_textKeys;
+
+private:
+	/// hash bytes of text key
+	static uint64_t hashBytes(const char* p, size_t len);
+
+	/// hash integer key
+	static uint64_t hashInt(int64_t key);
+
+	/// bucket of a key hash
+	uint32_t bucketOf(uint64_t h) const { return (uint32_t)((h >> 32) % m_displacements.size()); }
+
+	/// slot of a key hash with displacement
+	static uint32_t slotOf(uint64_t h, uint32_t d, uint32_t n);
+
+	/// read rows of statement, key index is found by name if key column is not empty
+	bool loadRows(CCResultSet* rs, const string& keyColumn, vector<Cell>& cells);
+
+	/// build perfect hash and reorder rows by slot
+	bool buildHash(const vector<Cell>& cells);
+
+	/// get hash of key cell in unordered cells
+	uint64_t hashOfCell(const Cell& c) const;
+
+	/// get cell, or NULL if row or column is invalid
+	const Cell* cellAt(int row, int columnIdx) const;
+
+protected:
+	CCStaticTable();
+
+	/// load rows of a query, key index is found by name if key column is not empty
+	bool initWithQuery(CCDatabase* db, const string& sql, int keyIndex, const string& keyColumn);
+
+public:
+	virtual ~CCStaticTable();
+
+	/**
+	 * load a table
+	 *
+	 * @param db database
+	 * @param table table name
+	 * @param keyColumn key column name, it must be in selected columns
+	 * @param columns column list to select, default is all columns
+	 * @return static table, autoreleased, or NULL if failed
+	 */
+	static CCStaticTable* create(CCDatabase* db, const string& table, const string& keyColumn, const string& columns = "*");
+
+	/**
+	 * load rows of a query
+	 *
+	 * @param db database
+	 * @param sql select statement
+	 * @param keyIndex index of key column in result
+	 * @return static table, autoreleased, or NULL if failed
+	 */
+	static CCStaticTable* createWithQuery(CCDatabase* db, const string& sql, int keyIndex = 0);
+
+	/// get row of a text key, or -1 if not found
+	int rowForKey(const char* key, size_t len) const;
+
+	/// get row of a text key, or -1 if not found
+	int rowForKey(const string& key) const { return rowForKey(key.data(), key.length()); }
+
+	/// get row of an integer key, or -1 if not found
+	int rowForKey(int64_t key) const;
+
+	/// check a key exists
+	template<typename K>
+	bool containsKey(const K& key) const { return rowForKey(key) >= 0; }
+
+	/// get row count
+	int rowCount() const { return m_rowCount; }
+
+	/// get column count
+	int columnCount() const { return m_columnCount; }
+
+	/// get column index by name, or -1 if not found
+	int columnIndexForName(string columnName) const;
+
+	/// is a cell null, true if row or column is invalid
+	bool isNullAt(int row, int columnIdx) const;
+
+	/// get integer value of a cell, or 0 if it is null or invalid
+	int64_t int64At(int row, int columnIdx) const;
+
+	/// get float value of a cell, or 0 if it is null or invalid
+	double doubleAt(int row, int columnIdx) const;
+
+	/// get text of a cell without copy, integer and float cells are null views
+	CCDataView textAt(int row, int columnIdx) const;
+
+	/// get text value in a column of a key, or empty string if key is not found
+	template<typename K>
+	string stringForKey(const K& key, int columnIdx) const { return textAt(rowForKey(key), columnIdx).toString(); }
+
+	/// get text value in a column of a key without copy, null view if key is not found
+	template<typename K>
+	CCDataView textForKey(const K& key, int columnIdx) const { return textAt(rowForKey(key), columnIdx); }
+
+	/// get integer value in a column of a key, or default value if key is not found
+	template<typename K>
+	int intForKey(const K& key, int columnIdx, int def = 0) const {
+		int row = rowForKey(key);
+		return row < 0 ? def : (int)int64At(row, columnIdx);
+	}
+
+	/// get int64_t value in a column of a key, or default value if key is not found
+	template<typename K>
+	int64_t int64ForKey(const K& key, int columnIdx, int64_t def = 0) const {
+		int row = rowForKey(key);
+		return row < 0 ? def : int64At(row, columnIdx);
+	}
+
+	/// get float value in a column of a key, or default value if key is not found
+	template<typename K>
+	double doubleForKey(const K& key, int columnIdx, double def = 0) const {
+		int row = rowForKey(key);
+		return row < 0 ? def : doubleAt(row, columnIdx);
+	}
+
+	/// get memory used by cells, bytes and hash
+	size_t getMemorySize() const;
+};
+
+NS_CC_END
+
+#endif // __CCStaticTable_h__
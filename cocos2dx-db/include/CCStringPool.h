@@ -0,0 +1,102 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCStringPool_h__
+#define __CCStringPool_h__
+
+#include "cocos2d.h"
+#include <deque>
+
+using namespace std;
+
+NS_CC_BEGIN
+
+/**
+ * A pool of unique strings, every string gets an integer code in the order it is added.
+ * It is used by materialized result set to store repeated text once and keep a code per
+ * cell. A pool can be shared by many result sets, so same text from different queries has
+ * same code and can be compared as integers.
+ *
+ * \note
+ * Strings are never removed, reference returned by stringForCode is valid until pool is
+ * released. Pool is not thread safe.
+ */
+class CC_DLL CCStringPool : public CCObject {
+private:
+	/// strings by code, deque keeps references stable when it grows
+	deque<string> m_strings;
+
+	/// hash of strings by code
+	vector<uint32_t> m_hashes;
+
+	/// open addressing hash table of codes, -1 is empty slot
+	vector<int> m_slots;
+
+	/// total bytes of strings
+	size_t m_bytes;
+
+private:
+	/// hash bytes
+	static uint32_t hash(const char* p, size_t len);
+
+	/// find slot of a string, it is an empty slot if not found
+	int findSlot(const char* p, size_t len, uint32_t h);
+
+	/// double slot table
+	void grow();
+
+protected:
+	CCStringPool();
+
+public:
+	virtual ~CCStringPool();
+	static CCStringPool* create();
+
+	/**
+	 * add a string if not in pool
+	 *
+	 * @param p string bytes, not need to be null terminated
+	 * @param len byte length
+	 * @return code of string
+	 */
+	int intern(const char* p, size_t len);
+
+	/// add a string if not in pool, return its code
+	int intern(const string& s) { return intern(s.data(), s.length()); }
+
+	/// get code of a string, or -1 if it is not in pool
+	int codeForString(const string& s);
+
+	/// get string of a code, or empty string if code is invalid
+	const string& stringForCode(int code);
+
+	/// get unique string count
+	int getCount() { return (int)m_strings.size(); }
+
+	/// get total bytes of unique strings
+	size_t getByteSize() { return m_bytes; }
+};
+
+NS_CC_END
+
+#endif // __CCStringPool_h__
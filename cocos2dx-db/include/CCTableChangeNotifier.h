@@ -0,0 +1,197 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCTableChangeNotifier_h__
+#define __CCTableChangeNotifier_h__
+
+#include "cocos2d.h"
+#include <list>
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+
+/**
+ * Changed rows of a table in one committed transaction. Changes of a row are merged, so
+ * a row inserted and then updated is reported as inserted, a row inserted and then deleted
+ * is not reported.
+ */
+class CC_DLL CCTableChange : public CCObject {
+	friend class CCTableChangeNotifier;
+
+public:
+	typedef vector<int64_t> RowIdList;
+
+private:
+	/// merged operation of rows, sqlite operation code
+	typedef map<int64_t, int> RowOpMap;
+	RowOpMap m_ops;
+
+	/// lists built from merged operations
+	RowIdList m_inserted;
+	RowIdList m_updated;
+	RowIdList m_deleted;
+
+private:
+	/// merge an operation of a row
+	void record(int op, int64_t rowId);
+
+	/// build row lists from merged operations
+	void build();
+
+protected:
+	CCTableChange(const string& table);
+
+public:
+	virtual ~CCTableChange();
+
+	/// get inserted rowids
+	const RowIdList& getInserted() { return m_inserted; }
+
+	/// get updated rowids
+	const RowIdList& getUpdated() { return m_updated; }
+
+	/// get deleted rowids
+	const RowIdList& getDeleted() { return m_deleted; }
+
+	/// is a row changed in any way?
+	bool containsRow(int64_t rowId) { return m_ops.find(rowId) != m_ops.end(); }
+
+	/// is nothing changed?
+	bool isEmpty() { return m_inserted.empty() && m_updated.empty() && m_deleted.empty(); }
+
+	/// table name, as reported by sqlite
+	CC_SYNTHESIZE_READONLY_PASS_BY_REF(string, m_tableName, TableName);
+};
+
+/**
+ * Collects row changes reported by update hook and delivers them to observers on main
+ * thread after commit. It is owned by CCDatabase, use CCDatabase::addTableObserver.
+ *
+ * \par batching
+ * Changes are collected per table until transaction commits, then they become one batch.
+ * Batches are delivered in next scheduler tick, when no transaction is open, so an
+ * observer can query database safely. Rolled back changes are dropped.
+ *
+ * \note
+ * Only rollback of whole transaction is seen. sqlite has no hook for a statement which
+ * fails with ABORT conflict and undoes its own rows, or for ROLLBACK TO a savepoint, so
+ * rows changed by them are still delivered as committed. Observer should read rows again
+ * instead of trusting that every reported row exists.
+ */
+class CC_DLL CCTableChangeNotifier : public CCObject {
+private:
+	/// an observer
+	struct Observer {
+		CCObject* target;
+		SEL_CallFuncO selector;
+
+		/// table in lowercase
+		string table;
+
+		/// only rows with this rowid are observed, if hasRowId is true
+		int64_t rowId;
+		bool hasRowId;
+	};
+	typedef vector<Observer> ObserverList;
+	ObserverList m_observers;
+
+	/// changes by table, in lowercase
+	typedef map<string, CCTableChange*> ChangeMap;
+
+	/// changes of open transaction
+	ChangeMap m_pending;
+
+	/// batches sealed by commit hook, commit may still fail and transaction be rolled back
+	list<ChangeMap> m_sealed;
+
+	/// committed batches waiting for delivery
+	list<ChangeMap> m_committed;
+
+	/// database, not retained because it owns notifier
+	CCDatabase* m_db;
+
+	/// true if delivery is scheduled
+	bool m_scheduled;
+
+private:
+	/// release changes in a map
+	static void releaseChanges(ChangeMap& changes);
+
+	/// deliver committed batches
+	void deliver(float delta);
+
+	/// is any observer on a table?
+	bool isObserved(const string& table);
+
+	/// is observer still registered? It may be removed by an earlier callback
+	bool isRegistered(const Observer& o);
+
+protected:
+	CCTableChangeNotifier(CCDatabase* db);
+
+public:
+	virtual ~CCTableChangeNotifier();
+	static CCTableChangeNotifier* create(CCDatabase* db);
+
+	/**
+	 * add an observer
+	 *
+	 * @param target callback target, it is not retained
+	 * @param selector callback, its argument is CCTableChange
+	 * @param table table name, case insensitive
+	 * @param rowId only observe this row if it is not negative
+	 */
+	void addObserver(CCObject* target, SEL_CallFuncO selector, string table, int64_t rowId = -1);
+
+	/// remove observers of a target on a table, or on all tables if table is empty
+	void removeObserver(CCObject* target, string table = "");
+
+	/// has observers?
+	bool hasObservers() { return !m_observers.empty(); }
+
+	/// record a row change, called by update hook
+	void recordChange(int op, const char* table, int64_t rowId);
+
+	/// make pending changes a batch, called by commit hook
+	void commit();
+
+	/// drop pending changes and batches whose commit is not confirmed, called by rollback hook
+	void rollback();
+
+	/**
+	 * confirm sealed batches if no transaction is open, because they would be dropped by
+	 * rollback if commit failed. Called before database runs a statement, so that rollback
+	 * of next transaction doesn't drop them
+	 */
+	void confirm();
+
+	/// drop everything and stop delivery, called when database is closed
+	void reset();
+};
+
+NS_CC_END
+
+#endif // __CCTableChangeNotifier_h__
@@ -0,0 +1,233 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCTileChunkStore_h__
+#define __CCTileChunkStore_h__
+
+#include "cocos2d.h"
+#include "CCDatabaseWorker.h"
+
+using namespace std;
+
+NS_CC_BEGIN
+
+class CCDatabase;
+class CCTileChunkStoreDelegate;
+
+/**
+ * Tile layers persisted in fixed size chunks and streamed around camera. A chunk is a square
+ * of chunkSize x chunkSize tile gids, saved as a blob row keyed by (layer, cx, cy). Chunks
+ * near camera are loaded by a worker connection and fed to bound CCTMXLayer or delegate,
+ * chunks far from camera are unloaded, so memory is bounded by load radius instead of map size.
+ *
+ * \par table
+ * CREATE TABLE tile_chunks (layer TEXT, cx INTEGER, cy INTEGER, data BLOB, PRIMARY KEY(layer, cx, cy))
+ *
+ * \note
+ * Gids are saved in native byte order as unsigned 32 bits integer, row major, y axis is same
+ * as TMX tile coordinate. A chunk which has no row in database is empty, i.e. all gids are 0.
+ * All reading and writing are done by worker in posted order, so a chunk saved is always
+ * visible to next loading.
+ */
+class CC_DLL CCTileChunkStore : public CCObject {
+private:
+	class LoadJob;
+	class SaveJob;
+	class ImportJob;
+	friend class LoadJob;
+	friend class SaveJob;
+	friend class ImportJob;
+
+	/// chunk key
+	struct ChunkKey {
+		string layer;
+		int cx;
+		int cy;
+
+		ChunkKey(const string& l, int x, int y) : layer(l), cx(x), cy(y) {}
+		bool operator<(const ChunkKey& k) const {
+			if(cx != k.cx)
+				return cx < k.cx;
+			if(cy != k.cy)
+				return cy < k.cy;
+			return layer < k.layer;
+		}
+	};
+
+	/// a loaded chunk
+	struct Chunk {
+		vector<uint32_t> gids;
+		bool dirty;
+	};
+	typedef map<ChunkKey, Chunk*> ChunkMap;
+	ChunkMap m_chunks;
+
+	/// chunks in loading
+	typedef set<ChunkKey> ChunkKeySet;
+	ChunkKeySet m_loadingChunks;
+
+	/// streamed layers, mapped tmx layer may be NULL
+	typedef map<string, CCTMXLayer*> LayerMap;
+	LayerMap m_layers;
+
+	/// worker
+	CCDatabaseWorker* m_worker;
+
+	/// database whose caches are invalidated after saving
+	CCDatabase* m_db;
+
+	/// delegate, weak reference
+	CCTileChunkStoreDelegate* m_delegate;
+
+	/// table name
+	string m_table;
+
+	/// camera chunk
+	int m_cameraChunkX;
+	int m_cameraChunkY;
+	bool m_hasCamera;
+
+private:
+	/// chunk coordinate of a tile coordinate
+	int chunkCoord(int tile);
+
+	/// check a chunk is in a radius of camera chunk
+	bool isInRadius(int cx, int cy, int radius);
+
+	/// invoked when a chunk is loaded, takes ownership of gids
+	void onChunkLoaded(const ChunkKey& key, vector<uint32_t>* gids);
+
+	/// feed a chunk to tmx layer and delegate
+	void applyChunk(const ChunkKey& key, Chunk* chunk);
+
+	/// remove a chunk from tmx layer and delegate
+	void unapplyChunk(const ChunkKey& key, Chunk* chunk);
+
+	/// post a save job
+	void postSave(const ChunkKey& key, const uint32_t* gids);
+
+	/// copy saved gids to a chunk if it is loaded
+	void syncLoadedChunk(const ChunkKey& key, const uint32_t* gids);
+
+protected:
+	CCTileChunkStore();
+
+public:
+	virtual ~CCTileChunkStore();
+
+	/**
+	 * create a chunk store
+	 *
+	 * @param db database, table will be created in it if not existent. Database must be opened
+	 * 		from a file because chunks are loaded by another connection. It is retained
+	 * @param chunkSize tiles per side of a chunk
+	 * @param table table name
+	 * @return chunk store, or NULL if failed
+	 */
+	static CCTileChunkStore* create(CCDatabase* db, int chunkSize = 32, string table = "tile_chunks");
+
+	/// init chunk store, see create
+	virtual bool initWithDatabase(CCDatabase* db, int chunkSize, string table);
+
+	/**
+	 * add a layer to be streamed
+	 *
+	 * @param layer layer name in database
+	 * @param tmxLayer tmx layer which will be fed with loaded tiles, can be NULL if delegate
+	 * 		is used. The layer size should cover whole map, tiles outside it are ignored
+	 */
+	void bindLayer(string layer, CCTMXLayer* tmxLayer);
+
+	/// remove a streamed layer, its chunks are unloaded
+	void unbindLayer(string layer);
+
+	/**
+	 * update camera position, chunks in load radius will be loaded and chunks
+	 * out of unload radius will be unloaded
+	 *
+	 * @param tileCoord tile coordinate of camera center
+	 */
+	void updateCamera(const CCPoint& tileCoord);
+
+	/// get gid of a tile, or 0 if its chunk is not loaded
+	unsigned int tileGIDAt(string layer, int x, int y);
+
+	/**
+	 * set gid of a tile in a loaded chunk, the chunk will be saved when it is
+	 * unloaded or flush is called
+	 *
+	 * @return false if chunk is not loaded
+	 */
+	bool setTileGID(string layer, int x, int y, unsigned int gid);
+
+	/**
+	 * save a whole chunk
+	 *
+	 * @param gids chunkSize x chunkSize gids, row major
+	 */
+	void saveChunk(string layer, int cx, int cy, const uint32_t* gids);
+
+	/**
+	 * split a whole tmx layer to chunks and save them, used to convert TMX maps. Saved
+	 * rows of the layer are replaced in one transaction, so importing again leaves no
+	 * stale chunk
+	 */
+	void importLayer(string layer, CCTMXLayer* tmxLayer);
+
+	/// save all modified chunks
+	void flush();
+
+	/// get count of chunks in memory
+	int getLoadedChunkCount() { return (int)m_chunks.size(); }
+
+	/// delegate
+	void setDelegate(CCTileChunkStoreDelegate* delegate) { m_delegate = delegate; }
+	CCTileChunkStoreDelegate* getDelegate() { return m_delegate; }
+
+	/// tiles per side of a chunk
+	CC_SYNTHESIZE_READONLY(int, m_chunkSize, ChunkSize);
+
+	/// chunks within this radius of camera chunk are loaded, default is 1, i.e. 3x3 chunks
+	CC_SYNTHESIZE(int, m_loadRadius, LoadRadius);
+
+	/// chunks out of this radius of camera chunk are unloaded, default is 2
+	CC_SYNTHESIZE(int, m_unloadRadius, UnloadRadius);
+};
+
+/**
+ * delegate of CCTileChunkStore, used when chunks are not fed to CCTMXLayer
+ */
+class CC_DLL CCTileChunkStoreDelegate {
+public:
+	virtual ~CCTileChunkStoreDelegate() {}
+
+	/// a chunk is loaded, gids is valid until chunk is unloaded
+	virtual void onTileChunkLoaded(CCTileChunkStore* store, const string& layer, int cx, int cy, const uint32_t* gids) {}
+
+	/// a chunk is unloaded
+	virtual void onTileChunkUnloaded(CCTileChunkStore* store, const string& layer, int cx, int cy) {}
+};
+
+NS_CC_END
+
+#endif // __CCTileChunkStore_h__
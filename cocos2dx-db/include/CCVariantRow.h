@@ -0,0 +1,116 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#ifndef __CCVariantRow_h__
+#define __CCVariantRow_h__
+
+#include "cocos2d.h"
+#include "CCResultSet.h"
+
+struct sqlite3_stmt;
+
+using namespace std;
+
+NS_CC_BEGIN
+
+/**
+ * Current row of a result set decoded into tagged values. All columns are read from sqlite
+ * once per step, so reading a column many times is a memory read. Short text and blob are
+ * stored inline in the cell, longer ones in a spill buffer which is reused by next row, so
+ * decoding doesn't allocate after the first few rows.
+ *
+ * Cell types are sqlite storage types, from SQLITE_INTEGER to SQLITE_NULL.
+ */
+class CC_DLL CCVariantRow {
+	friend class CCResultSet;
+
+public:
+	/// max bytes stored inline, including null terminator of text
+	static const int INLINE_SIZE = 16;
+
+private:
+	/// a cell
+	struct Cell {
+		union {
+			int64_t i;
+			double d;
+			struct {
+				uint32_t offset;
+				uint32_t length;
+			} spill;
+			char bytes[INLINE_SIZE];
+		} v;
+
+		/// sqlite storage type
+		uint8_t type;
+
+		/// true if text or blob is in v.bytes
+		uint8_t isInline;
+
+		/// length of inline text or blob
+		uint8_t inlineLength;
+	};
+	typedef vector<Cell> CellList;
+
+	/// cells of row
+	CellList m_cells;
+
+	/// bytes of long text and blob, text is null terminated
+	vector<char> m_spill;
+
+private:
+	/// decode current row of statement
+	void decode(sqlite3_stmt* stmt);
+
+	/// clear row, after it no cell is valid
+	void clear();
+
+public:
+	CCVariantRow();
+	virtual ~CCVariantRow();
+
+	/// get column count, or 0 if no row is decoded
+	int columnCount() { return (int)m_cells.size(); }
+
+	/// get storage type of a cell, SQLITE_NULL if index is invalid
+	int typeAt(int columnIdx);
+
+	/// is a cell null? true if index is invalid
+	bool isNull(int columnIdx);
+
+	/// get integer value of a cell, converted like sqlite
+	int64_t int64At(int columnIdx);
+
+	/// get double value of a cell, converted like sqlite
+	double doubleAt(int columnIdx);
+
+	/**
+	 * get text or blob of a cell, it is valid until next row. Text is null terminated.
+	 * Numbers give a null view, read them by int64At or doubleAt
+	 */
+	CCDataView bytesAt(int columnIdx);
+};
+
+NS_CC_END
+
+#endif // __CCVariantRow_h__
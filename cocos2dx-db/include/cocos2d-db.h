@@ -27,6 +27,28 @@
 #include "CCDatabase.h"
 #include "CCResultSet.h"
 #include "CCStatement.h"
+#include "CCCursor.h"
+#include "CCRowBinding.h"
+#include "CCEntityTable.h"
+#include "CCEntityCache.h"
+#include "CCSchemaCodeGenerator.h"
+#include "CCSchemaCatalog.h"
+#include "CCColumnBatch.h"
+#include "CCColumnKernels.h"
+#include "CCMaterializedResultSet.h"
+#include "CCStringPool.h"
+#include "CCQueryCache.h"
+#include "CCStaticTable.h"
+#include "CCBloomIndex.h"
+#include "CCAggregateView.h"
+#include "CCKeyValueStore.h"
+#include "CCTableChangeNotifier.h"
+#include "CCVariantRow.h"
+#include "CCDatabaseWorker.h"
+#include "CCDatabaseTableDataSource.h"
+#include "CCTileChunkStore.h"
+#include "CCDatabaseWarmer.h"
+#include "CCDatabaseMaintenance.h"
 #if CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID
 	#include "platform/android/sqlite3.h"
 #endif
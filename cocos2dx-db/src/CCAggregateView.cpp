@@ -0,0 +1,241 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCAggregateView.h"
+#include "CCDatabase.h"
+#include "CCStatement.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+CCAggregateView::CCAggregateView() :
+		m_db(NULL) {
+}
+
+CCAggregateView::~CCAggregateView() {
+	CC_SAFE_RELEASE(m_db);
+}
+
+CCAggregateView* CCAggregateView::create(CCDatabase* db, const string& name, const string& table, const string& groupColumn, const string& valueColumn) {
+	CCAggregateView* v = new CCAggregateView();
+	if(v->initWithTable(db, name, table, groupColumn, valueColumn)) {
+		return (CCAggregateView*)v->autorelease();
+	}
+	v->release();
+	return NULL;
+}
+
+bool CCAggregateView::initWithTable(CCDatabase* db, const string& name, const string& table, const string& groupColumn, const string& valueColumn) {
+	if(!db || name.empty() || table.empty())
+		return false;
+	m_db = db;
+	CC_SAFE_RETAIN(m_db);
+	m_name = name;
+	m_table = table;
+	m_groupColumn = groupColumn;
+	m_valueColumn = valueColumn;
+	m_selectSQL = "SELECT cnt, sum, min, max FROM " + CCDatabase::quoteIdentifier(m_name) + " WHERE grp = ?";
+	return true;
+}
+
+string CCAggregateView::triggerSQL(const char* suffix, const char* event, const string& body) {
+	return "CREATE TRIGGER IF NOT EXISTS " + CCDatabase::quoteIdentifier(m_name + suffix) + " AFTER " + event +
+		" ON " + CCDatabase::quoteIdentifier(m_table) + " BEGIN " + body + "END";
+}
+
+string CCAggregateView::removeSQL() {
+	string name = CCDatabase::quoteIdentifier(m_name);
+	string key = m_groupColumn.empty() ? "0" : "OLD." + CCDatabase::quoteIdentifier(m_groupColumn);
+	string sql = "UPDATE " + name + " SET cnt = cnt - 1";
+	if(!m_valueColumn.empty()) {
+		string value = "OLD." + CCDatabase::quoteIdentifier(m_valueColumn);
+		sql += ", sum = sum - coalesce(" + value + ", 0) WHERE grp = " + key + "; ";
+
+		// min or max is recomputed from rows of group only if it is removed
+		string column = CCDatabase::quoteIdentifier(m_valueColumn);
+		string from = " FROM " + CCDatabase::quoteIdentifier(m_table);
+		if(!m_groupColumn.empty())
+			from += " WHERE " + CCDatabase::quoteIdentifier(m_groupColumn) + " = " + key;
+		sql += "UPDATE " + name + " SET min = (SELECT min(" + column + ")" + from + "), max = (SELECT max(" + column + ")" + from +
+			") WHERE grp = " + key + " AND (" + value + " = min OR " + value + " = max); ";
+	} else {
+		sql += " WHERE grp = " + key + "; ";
+	}
+	sql += "DELETE FROM " + name + " WHERE grp = " + key + " AND cnt <= 0; ";
+	return sql;
+}
+
+string CCAggregateView::addSQL() {
+	string name = CCDatabase::quoteIdentifier(m_name);
+	string key = m_groupColumn.empty() ? "0" : "NEW." + CCDatabase::quoteIdentifier(m_groupColumn);
+	// no OR IGNORE, conflict clause of outer INSERT OR REPLACE overrides it and would reset group
+	string sql = "INSERT INTO " + name + " (grp, cnt, sum) SELECT " + key + ", 0, 0 WHERE " + key + " IS NOT NULL AND NOT EXISTS (SELECT 1 FROM " +
+		name + " WHERE grp = " + key + "); ";
+	sql += "UPDATE " + name + " SET cnt = cnt + 1";
+	if(!m_valueColumn.empty()) {
+		string value = "NEW." + CCDatabase::quoteIdentifier(m_valueColumn);
+		sql += ", sum = sum + coalesce(" + value + ", 0)";
+		sql += ", min = CASE WHEN " + value + " IS NULL THEN min WHEN min IS NULL OR " + value + " < min THEN " + value + " ELSE min END";
+		sql += ", max = CASE WHEN " + value + " IS NULL THEN max WHEN max IS NULL OR " + value + " > max THEN " + value + " ELSE max END";
+	}
+	sql += " WHERE grp = " + key + "; ";
+	return sql;
+}
+
+bool CCAggregateView::executeAll(const vector<string>& sqls) {
+	bool own = !m_db->isInTransaction();
+	if(own && !m_db->beginTransaction())
+		return false;
+
+	// generated sql can be longer than format buffer of executeUpdate
+	bool ok = true;
+	for(vector<string>::const_iterator iter = sqls.begin(); ok && iter != sqls.end(); iter++)
+		ok = m_db->_executeUpdate(iter->c_str());
+
+	if(own) {
+		if(ok)
+			ok = m_db->commit();
+		else
+			m_db->rollback();
+	}
+	return ok;
+}
+
+bool CCAggregateView::install() {
+	// row deleted by REPLACE conflict fires delete trigger only if recursive triggers are on
+	if(!m_db->executeUpdate("PRAGMA recursive_triggers = ON")) {
+		CCLOGERROR("CCAggregateView: failed to enable recursive triggers");
+		return false;
+	}
+
+	vector<string> sqls;
+
+	// fill summary by one grouped scan if it is new
+	if(!m_db->tableExists(m_name)) {
+		string value = m_valueColumn.empty() ? "NULL" : CCDatabase::quoteIdentifier(m_valueColumn);
+		sqls.push_back("CREATE TABLE " + CCDatabase::quoteIdentifier(m_name) +
+			" (grp PRIMARY KEY, cnt INTEGER NOT NULL, sum REAL NOT NULL DEFAULT 0, min, max)");
+		string fill = "INSERT INTO " + CCDatabase::quoteIdentifier(m_name) + " (grp, cnt, sum, min, max) SELECT ";
+		if(m_groupColumn.empty()) {
+			fill += "0, count(*), total(" + value + "), min(" + value + "), max(" + value + ") FROM " +
+				CCDatabase::quoteIdentifier(m_table) + " HAVING count(*) > 0";
+		} else {
+			string group = CCDatabase::quoteIdentifier(m_groupColumn);
+			fill += group + ", count(*), total(" + value + "), min(" + value + "), max(" + value + ") FROM " +
+				CCDatabase::quoteIdentifier(m_table) + " WHERE " + group + " IS NOT NULL GROUP BY " + group;
+		}
+		sqls.push_back(fill);
+	}
+
+	// triggers, recreated so that ones installed by older version are replaced
+	// update is not needed if no watched column
+	sqls.push_back("DROP TRIGGER IF EXISTS " + CCDatabase::quoteIdentifier(m_name + "_insert"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + CCDatabase::quoteIdentifier(m_name + "_delete"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + CCDatabase::quoteIdentifier(m_name + "_update"));
+	sqls.push_back(triggerSQL("_insert", "INSERT", addSQL()));
+	sqls.push_back(triggerSQL("_delete", "DELETE", removeSQL()));
+	string columns = CCDatabase::quoteIdentifier(m_groupColumn);
+	if(m_groupColumn.empty())
+		columns = CCDatabase::quoteIdentifier(m_valueColumn);
+	else if(!m_valueColumn.empty())
+		columns += ", " + CCDatabase::quoteIdentifier(m_valueColumn);
+	if(!m_groupColumn.empty() || !m_valueColumn.empty())
+		sqls.push_back(triggerSQL("_update", ("UPDATE OF " + columns).c_str(), removeSQL() + addSQL()));
+
+	return executeAll(sqls);
+}
+
+bool CCAggregateView::uninstall() {
+	vector<string> sqls;
+	sqls.push_back("DROP TRIGGER IF EXISTS " + CCDatabase::quoteIdentifier(m_name + "_insert"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + CCDatabase::quoteIdentifier(m_name + "_delete"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + CCDatabase::quoteIdentifier(m_name + "_update"));
+	sqls.push_back("DROP TABLE IF EXISTS " + CCDatabase::quoteIdentifier(m_name));
+	return executeAll(sqls);
+}
+
+bool CCAggregateView::rebuild() {
+	// dropping summary makes install fill it again
+	vector<string> sqls;
+	sqls.push_back("DROP TABLE IF EXISTS " + CCDatabase::quoteIdentifier(m_name));
+	if(!executeAll(sqls))
+		return false;
+	return install();
+}
+
+sqlite3_stmt* CCAggregateView::beginLookup(const string& sql) {
+	if(!m_db->databaseOpened())
+		return NULL;
+	if(m_db->m_inUse) {
+		m_db->warnInUse();
+		return NULL;
+	}
+	CCStatement* statement = m_db->prepareStatement(sql.c_str());
+	return statement ? statement->getStatement() : NULL;
+}
+
+bool CCAggregateView::endLookup(const string& sql, sqlite3_stmt* stmt, Aggregate& out) {
+	bool found = m_db->stepStatement(stmt) == SQLITE_ROW;
+	out = Aggregate();
+	if(found) {
+		out.count = sqlite3_column_int64(stmt, 0);
+		out.sum = sqlite3_column_double(stmt, 1);
+		out.hasValue = sqlite3_column_type(stmt, 2) != SQLITE_NULL;
+		out.min = sqlite3_column_double(stmt, 2);
+		out.max = sqlite3_column_double(stmt, 3);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	m_db->releaseStatement(sql);
+	return found;
+}
+
+bool CCAggregateView::getAggregate(const string& key, Aggregate& out) {
+	sqlite3_stmt* stmt = beginLookup(m_selectSQL);
+	if(!stmt)
+		return false;
+	sqlite3_bind_text(stmt, 1, key.data(), (int)key.length(), SQLITE_TRANSIENT);
+	return endLookup(m_selectSQL, stmt, out);
+}
+
+bool CCAggregateView::getAggregate(int64_t key, Aggregate& out) {
+	sqlite3_stmt* stmt = beginLookup(m_selectSQL);
+	if(!stmt)
+		return false;
+	sqlite3_bind_int64(stmt, 1, key);
+	return endLookup(m_selectSQL, stmt, out);
+}
+
+bool CCAggregateView::getTotal(Aggregate& out) {
+	// whole table is group zero
+	if(m_groupColumn.empty())
+		return getAggregate((int64_t)0, out);
+
+	string sql = "SELECT total(cnt), total(sum), min(min), max(max) FROM " + CCDatabase::quoteIdentifier(m_name);
+	sqlite3_stmt* stmt = beginLookup(sql);
+	if(!stmt)
+		return false;
+	return endLookup(sql, stmt, out);
+}
+
+NS_CC_END
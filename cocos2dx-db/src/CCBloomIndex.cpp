@@ -0,0 +1,471 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCBloomIndex.h"
+#include "CCDatabase.h"
+#include "CCSchemaCatalog.h"
+#include "CCUtils.h"
+#include "sqlite3.h"
+#include <math.h>
+#include <errno.h>
+
+// max hash function count
+#define MAX_HASH_COUNT 16
+
+// min value count filter is sized for
+#define MIN_CAPACITY 64
+
+NS_CC_BEGIN
+
+CCBloomIndex::CCBloomIndex() :
+		m_db(NULL),
+		m_bitCount(0),
+		m_hashCount(0),
+		m_targetRate(0.01),
+		m_expectedCount(0),
+		m_capacity(0),
+		m_count(0),
+		m_deletedCount(0),
+		m_stale(true),
+		m_unsupported(false),
+		m_numeric(false),
+		m_rowStmt(NULL),
+		m_existsStmt(NULL),
+		m_lookups(0),
+		m_negatives(0),
+		m_checks(0),
+		m_falsePositives(0),
+		m_buildCount(0) {
+}
+
+CCBloomIndex::~CCBloomIndex() {
+	reset();
+}
+
+CCBloomIndex* CCBloomIndex::create(CCDatabase* db, const string& table, const string& column, int expectedCount, double falsePositiveRate) {
+	CCBloomIndex* b = new CCBloomIndex();
+	if(b->initWithDatabase(db, table, column, expectedCount, falsePositiveRate)) {
+		return (CCBloomIndex*)b->autorelease();
+	}
+	b->release();
+	return NULL;
+}
+
+bool CCBloomIndex::initWithDatabase(CCDatabase* db, const string& table, const string& column, int expectedCount, double falsePositiveRate) {
+	if(!db || table.empty() || column.empty())
+		return false;
+	if(falsePositiveRate <= 0 || falsePositiveRate >= 1) {
+		CCLOGERROR("CCBloomIndex: false positive rate %f is out of range", falsePositiveRate);
+		return false;
+	}
+	m_db = db;
+	m_table = table;
+	m_column = column;
+	m_expectedCount = MAX(0, expectedCount);
+	m_targetRate = falsePositiveRate;
+	return true;
+}
+
+void CCBloomIndex::reset() {
+	if(m_rowStmt) {
+		sqlite3_finalize(m_rowStmt);
+		m_rowStmt = NULL;
+	}
+	if(m_existsStmt) {
+		sqlite3_finalize(m_existsStmt);
+		m_existsStmt = NULL;
+	}
+	m_pendingRows.clear();
+	m_stale = true;
+	m_unsupported = false;
+}
+
+uint64_t CCBloomIndex::hash(const char* p, size_t len) {
+	// FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	for(size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)p[i];
+		h *= 1099511628211ULL;
+	}
+
+	// mix so both halves are usable
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+string CCBloomIndex::textOf(int64_t value) {
+	char buf[32];
+	sprintf(buf, "%lld", (long long)value);
+	return buf;
+}
+
+string CCBloomIndex::textOf(double value) {
+	// integral float equals integer in sql
+	if(value == floor(value) && fabs(value) < 9.2e18)
+		return textOf((int64_t)value);
+	char buf[32];
+	sprintf(buf, "%.17g", value);
+	return buf;
+}
+
+bool CCBloomIndex::normalizeNumber(const string& text, string& out) {
+	// same form sqlite accepts when it applies numeric affinity, spaces around are allowed
+	const char* p = text.c_str();
+	const char* end = p + text.length();
+	while(p < end && isspace((unsigned char)*p))
+		p++;
+	const char* start = p;
+	if(p < end && (*p == '+' || *p == '-'))
+		p++;
+	int digits = 0;
+	bool real = false;
+	while(p < end && isdigit((unsigned char)*p)) {
+		p++;
+		digits++;
+	}
+	if(p < end && *p == '.') {
+		real = true;
+		p++;
+		while(p < end && isdigit((unsigned char)*p)) {
+			p++;
+			digits++;
+		}
+	}
+	if(digits == 0)
+		return false;
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		real = true;
+		p++;
+		if(p < end && (*p == '+' || *p == '-'))
+			p++;
+		if(p >= end || !isdigit((unsigned char)*p))
+			return false;
+		while(p < end && isdigit((unsigned char)*p))
+			p++;
+	}
+	while(p < end && isspace((unsigned char)*p))
+		p++;
+	if(p != end)
+		return false;
+
+	// integer out of range becomes float
+	if(!real) {
+		errno = 0;
+		long long v = strtoll(start, NULL, 10);
+		if(errno != ERANGE) {
+			out = textOf((int64_t)v);
+			return true;
+		}
+	}
+	out = textOf(strtod(start, NULL));
+	return true;
+}
+
+bool CCBloomIndex::isBinaryCollation(const string& createSQL, const string& column) {
+	// split into words, quoted names are unquoted, string literals keep quote so they never match a name
+	vector<string> tokens;
+	const char* p = createSQL.c_str();
+	while(*p) {
+		if(isspace((unsigned char)*p)) {
+			p++;
+		} else if(*p == '"' || *p == '`' || *p == '[' || *p == '\'') {
+			char close = *p == '[' ? ']' : *p;
+			string t = *p == '\'' ? "'" : "";
+			for(p++; *p; p++) {
+				if(*p == close) {
+					if(close != ']' && p[1] == close) {
+						t += *p++;
+						continue;
+					}
+					p++;
+					break;
+				}
+				t += *p;
+			}
+			tokens.push_back(t);
+		} else if(isalnum((unsigned char)*p) || *p == '_') {
+			const char* start = p;
+			while(isalnum((unsigned char)*p) || *p == '_' || *p == '$')
+				p++;
+			tokens.push_back(string(start, p - start));
+		} else {
+			tokens.push_back(string(p, 1));
+			p++;
+		}
+	}
+
+	// column definitions are separated by top level comma, first word is column name
+	int depth = 0;
+	bool atStart = false;
+	bool matched = false;
+	for(size_t i = 0; i < tokens.size(); i++) {
+		const string& t = tokens[i];
+		if(t == "(") {
+			if(++depth == 1)
+				atStart = true;
+			continue;
+		} else if(t == ")") {
+			if(--depth == 0)
+				break;
+			continue;
+		} else if(depth != 1) {
+			continue;
+		} else if(t == ",") {
+			atStart = true;
+			matched = false;
+		} else if(atStart) {
+			matched = !strcasecmp(t.c_str(), column.c_str());
+			atStart = false;
+		} else if(matched && !strcasecmp(t.c_str(), "collate") && i + 1 < tokens.size()) {
+			return !strcasecmp(tokens[i + 1].c_str(), "binary");
+		}
+	}
+	return true;
+}
+
+bool CCBloomIndex::checkColumn() {
+	// collation is only in create sql, table_info doesn't have it
+	sqlite3_stmt* stmt = NULL;
+	if(!prepare(&stmt, "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = ? COLLATE NOCASE"))
+		return false;
+	sqlite3_bind_text(stmt, 1, m_table.c_str(), -1, SQLITE_TRANSIENT);
+	string sql;
+	if(m_db->stepStatement(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) == SQLITE_TEXT)
+		sql = (const char*)sqlite3_column_text(stmt, 0);
+	sqlite3_finalize(stmt);
+	if(!isBinaryCollation(sql, m_column)) {
+		CCLOGERROR("CCBloomIndex: collation of %s.%s is not BINARY, filter is not used", m_table.c_str(), m_column.c_str());
+		m_unsupported = true;
+		return false;
+	}
+
+	// affinity rules of sqlite, by declared type
+	m_numeric = false;
+	const CCSchemaCatalog::Table* t = m_db->getSchemaCatalog()->findTable(m_table);
+	const CCSchemaCatalog::Column* col = t ? t->findColumn(m_column) : NULL;
+	if(col) {
+		string type = col->type;
+		CCUtils::toLowercase(type);
+		if(type.find("int") != string::npos)
+			m_numeric = true;
+		else if(type.find("char") != string::npos || type.find("clob") != string::npos || type.find("text") != string::npos)
+			m_numeric = false;
+		else if(type.find("blob") != string::npos || type.empty())
+			m_numeric = false;
+		else
+			m_numeric = true;
+	}
+	return true;
+}
+
+bool CCBloomIndex::textOf(sqlite3_stmt* stmt, int columnIdx, string& out) {
+	switch(sqlite3_column_type(stmt, columnIdx)) {
+		case SQLITE_NULL:
+			return false;
+		case SQLITE_INTEGER:
+			out = textOf((int64_t)sqlite3_column_int64(stmt, columnIdx));
+			return true;
+		case SQLITE_FLOAT:
+			out = textOf(sqlite3_column_double(stmt, columnIdx));
+			return true;
+		default:
+		{
+			const char* p = (const char*)sqlite3_column_blob(stmt, columnIdx);
+			int len = sqlite3_column_bytes(stmt, columnIdx);
+			out.assign(p ? p : "", len);
+			return true;
+		}
+	}
+}
+
+void CCBloomIndex::addText(const string& text) {
+	uint64_t h = hash(text.data(), text.length());
+	uint32_t h1 = (uint32_t)h;
+	uint32_t h2 = (uint32_t)(h >> 32) | 1;
+	for(int i = 0; i < m_hashCount; i++) {
+		uint32_t bit = (h1 + i * h2) % m_bitCount;
+		m_bits[bit >> 5] |= 1u << (bit & 31);
+	}
+	m_count++;
+}
+
+bool CCBloomIndex::testText(const string& text) {
+	uint64_t h = hash(text.data(), text.length());
+	uint32_t h1 = (uint32_t)h;
+	uint32_t h2 = (uint32_t)(h >> 32) | 1;
+	for(int i = 0; i < m_hashCount; i++) {
+		uint32_t bit = (h1 + i * h2) % m_bitCount;
+		if(!(m_bits[bit >> 5] & (1u << (bit & 31))))
+			return false;
+	}
+	return true;
+}
+
+bool CCBloomIndex::prepare(sqlite3_stmt** stmt, const string& sql) {
+	if(*stmt)
+		return true;
+	if(sqlite3_prepare_v2(m_db->sqliteHandle(), sql.c_str(), -1, stmt, NULL) != SQLITE_OK) {
+		CCLOGERROR("CCBloomIndex: DB Error: %d \"%s\"", m_db->lastErrorCode(), m_db->lastErrorMessage().c_str());
+		sqlite3_finalize(*stmt);
+		*stmt = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool CCBloomIndex::rebuild() {
+	m_db->waitForOpen();
+	if(!m_db->databaseOpened() || m_unsupported)
+		return false;
+	if(!checkColumn())
+		return false;
+
+	// size by row count, leave room for growth
+	int rows = m_db->intForQuery("SELECT count(*) FROM %s", CCDatabase::quoteIdentifier(m_table).c_str());
+	m_capacity = MAX(MIN_CAPACITY, MAX(m_expectedCount, rows * 2));
+	double ln2 = log(2.0);
+	double bits = ceil(-m_capacity * log(m_targetRate) / (ln2 * ln2));
+	m_bitCount = (uint32_t)MIN(bits, 4294967264.0);
+	m_bitCount = (m_bitCount + 31) & ~31u;
+	m_hashCount = (int)floor(m_bitCount / (double)m_capacity * ln2 + 0.5);
+	m_hashCount = MAX(1, MIN(MAX_HASH_COUNT, m_hashCount));
+	m_bits.assign(m_bitCount / 32, 0);
+	m_count = 0;
+	m_deletedCount = 0;
+	m_pendingRows.clear();
+
+	// add all values
+	sqlite3_stmt* stmt = NULL;
+	string sql = "SELECT " + CCDatabase::quoteIdentifier(m_column) + " FROM " + CCDatabase::quoteIdentifier(m_table);
+	if(!prepare(&stmt, sql))
+		return false;
+	string text;
+	int rc;
+	while((rc = m_db->stepStatement(stmt)) == SQLITE_ROW) {
+		if(textOf(stmt, 0, text))
+			addText(text);
+	}
+	sqlite3_finalize(stmt);
+	if(rc != SQLITE_DONE) {
+		CCLOGERROR("CCBloomIndex: failed to read %s.%s", m_table.c_str(), m_column.c_str());
+		return false;
+	}
+
+	m_stale = false;
+	m_buildCount++;
+	return true;
+}
+
+bool CCBloomIndex::addPendingRows() {
+	string sql = "SELECT " + CCDatabase::quoteIdentifier(m_column) + " FROM " + CCDatabase::quoteIdentifier(m_table) + " WHERE rowid = ?";
+	if(!prepare(&m_rowStmt, sql))
+		return false;
+	string text;
+	for(vector<int64_t>::iterator iter = m_pendingRows.begin(); iter != m_pendingRows.end(); iter++) {
+		sqlite3_bind_int64(m_rowStmt, 1, *iter);
+		if(m_db->stepStatement(m_rowStmt) == SQLITE_ROW && textOf(m_rowStmt, 0, text))
+			addText(text);
+		sqlite3_reset(m_rowStmt);
+	}
+	m_pendingRows.clear();
+	return true;
+}
+
+bool CCBloomIndex::update() {
+	// rebuild if filter is full or has too many deleted values
+	if(!m_stale) {
+		int changes = m_count + (int)m_pendingRows.size();
+		if(changes > m_capacity || m_deletedCount > m_capacity / 2)
+			m_stale = true;
+	}
+	if(m_stale)
+		return rebuild();
+	if(!m_pendingRows.empty())
+		return addPendingRows();
+	return true;
+}
+
+void CCBloomIndex::rowChanged(int op, int64_t rowId) {
+	if(m_stale)
+		return;
+	if(op == SQLITE_DELETE)
+		m_deletedCount++;
+	else
+		m_pendingRows.push_back(rowId);
+}
+
+bool CCBloomIndex::checkTable(const string& text, int64_t* intValue) {
+	string sql = "SELECT 1 FROM " + CCDatabase::quoteIdentifier(m_table) + " WHERE " + CCDatabase::quoteIdentifier(m_column) + " = ? LIMIT 1";
+	if(!prepare(&m_existsStmt, sql))
+		return false;
+	if(intValue)
+		sqlite3_bind_int64(m_existsStmt, 1, *intValue);
+	else
+		sqlite3_bind_text(m_existsStmt, 1, text.data(), (int)text.length(), SQLITE_TRANSIENT);
+	bool found = m_db->stepStatement(m_existsStmt) == SQLITE_ROW;
+	sqlite3_reset(m_existsStmt);
+	sqlite3_clear_bindings(m_existsStmt);
+	return found;
+}
+
+bool CCBloomIndex::lookup(const string& text, int64_t* intValue, bool exact) {
+	m_lookups++;
+
+	// if filter can't be used, it can't say no
+	if(update()) {
+		// text of numeric column is stored as number if it looks like one, so test that form
+		string number;
+		const string& key = !intValue && m_numeric && normalizeNumber(text, number) ? number : text;
+		if(!testText(key)) {
+			m_negatives++;
+			return false;
+		}
+	}
+	if(!exact)
+		return true;
+
+	// confirm by sql
+	m_checks++;
+	bool found = checkTable(text, intValue);
+	if(!found)
+		m_falsePositives++;
+	return found;
+}
+
+float CCBloomIndex::getEstimatedFalsePositiveRate() {
+	if(m_bitCount == 0)
+		return 0;
+	uint32_t set = 0;
+	for(vector<uint32_t>::iterator iter = m_bits.begin(); iter != m_bits.end(); iter++) {
+		uint32_t v = *iter;
+		while(v) {
+			v &= v - 1;
+			set++;
+		}
+	}
+	return (float)pow((double)set / m_bitCount, m_hashCount);
+}
+
+NS_CC_END
@@ -0,0 +1,216 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCColumnBatch.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+CCColumnBatch::CCColumnBatch() :
+		m_rowCount(0),
+		m_filler(0) {
+}
+
+CCColumnBatch::~CCColumnBatch() {
+}
+
+void CCColumnBatch::reset(sqlite3_stmt* stmt, bool keepTypes) {
+	// new columns are undecided, forced types are kept
+	size_t old = m_columns.size();
+	m_columns.resize(sqlite3_column_count(stmt));
+	for(size_t i = old; i < m_columns.size(); i++) {
+		m_columns[i].type = kCCColumnUnknown;
+		m_columns[i].forced = false;
+	}
+
+	// clear but keep capacity
+	for(ColumnList::iterator iter = m_columns.begin(); iter != m_columns.end(); iter++) {
+		if(!keepTypes && !iter->forced)
+			iter->type = kCCColumnUnknown;
+		iter->ints.clear();
+		iter->doubles.clear();
+		iter->offsets.clear();
+		iter->bytes.clear();
+		iter->nulls.clear();
+		if(iter->type == kCCColumnText || iter->type == kCCColumnBlob)
+			iter->offsets.push_back(0);
+	}
+	m_rowCount = 0;
+}
+
+int CCColumnBatch::decideType(sqlite3_stmt* stmt, int columnIdx) {
+	// by value
+	int type = sqlite3_column_type(stmt, columnIdx);
+	if(type != SQLITE_NULL)
+		return type;
+
+	// by declared type affinity
+	const char* decl = sqlite3_column_decltype(stmt, columnIdx);
+	if(!decl)
+		return kCCColumnUnknown;
+	string d = decl;
+	for(string::iterator iter = d.begin(); iter != d.end(); iter++)
+		*iter = toupper(*iter);
+	if(d.find("INT") != string::npos)
+		return kCCColumnInteger;
+	if(d.find("CHAR") != string::npos || d.find("CLOB") != string::npos || d.find("TEXT") != string::npos)
+		return kCCColumnText;
+	if(d.find("BLOB") != string::npos)
+		return kCCColumnBlob;
+	if(d.find("REAL") != string::npos || d.find("FLOA") != string::npos || d.find("DOUB") != string::npos)
+		return kCCColumnFloat;
+	return kCCColumnUnknown;
+}
+
+void CCColumnBatch::appendRow(sqlite3_stmt* stmt) {
+	int row = m_rowCount;
+	int count = (int)m_columns.size();
+	for(int i = 0; i < count; i++) {
+		Column& c = m_columns[i];
+
+		// decide type when first value comes
+		if(c.type == kCCColumnUnknown) {
+			c.type = decideType(stmt, i);
+
+			// all nulls so far, fill previous rows with zero value
+			if(c.type != kCCColumnUnknown) {
+				if(c.type == kCCColumnInteger)
+					c.ints.assign(row, 0);
+				else if(c.type == kCCColumnFloat)
+					c.doubles.assign(row, 0);
+				else
+					c.offsets.assign(row + 1, 0);
+			}
+		}
+
+		// null bit
+		bool isNull = sqlite3_column_type(stmt, i) == SQLITE_NULL;
+		if((row & 7) == 0)
+			c.nulls.push_back(0);
+		if(isNull)
+			c.nulls.back() |= 1 << (row & 7);
+
+		// value
+		switch(c.type) {
+			case kCCColumnInteger:
+				c.ints.push_back(isNull ? 0 : sqlite3_column_int64(stmt, i));
+				break;
+			case kCCColumnFloat:
+				c.doubles.push_back(isNull ? 0 : sqlite3_column_double(stmt, i));
+				break;
+			case kCCColumnText:
+			case kCCColumnBlob:
+			{
+				if(!isNull) {
+					const char* p = c.type == kCCColumnText ? (const char*)sqlite3_column_text(stmt, i) : (const char*)sqlite3_column_blob(stmt, i);
+					int len = sqlite3_column_bytes(stmt, i);
+					if(p && len > 0)
+						c.bytes.insert(c.bytes.end(), p, p + len);
+				}
+				c.offsets.push_back((uint32_t)c.bytes.size());
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	m_rowCount++;
+}
+
+int CCColumnBatch::columnType(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size())
+		return kCCColumnUnknown;
+	return m_columns[columnIdx].type;
+}
+
+void CCColumnBatch::setColumnType(int columnIdx, int type) {
+	if(columnIdx < 0)
+		return;
+	if(columnIdx >= m_columns.size()) {
+		size_t old = m_columns.size();
+		m_columns.resize(columnIdx + 1);
+		for(size_t i = old; i < m_columns.size(); i++) {
+			m_columns[i].type = kCCColumnUnknown;
+			m_columns[i].forced = false;
+		}
+	}
+	m_columns[columnIdx].type = type;
+	m_columns[columnIdx].forced = type != kCCColumnUnknown;
+}
+
+bool CCColumnBatch::isNull(int columnIdx, int row) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || row < 0 || row >= m_rowCount)
+		return true;
+	return (m_columns[columnIdx].nulls[row >> 3] & (1 << (row & 7))) != 0;
+}
+
+const uint8_t* CCColumnBatch::nullBitmap(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || m_columns[columnIdx].nulls.empty())
+		return NULL;
+	return &m_columns[columnIdx].nulls.front();
+}
+
+const int64_t* CCColumnBatch::int64Column(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || m_columns[columnIdx].type != kCCColumnInteger || m_columns[columnIdx].ints.empty())
+		return NULL;
+	return &m_columns[columnIdx].ints.front();
+}
+
+const double* CCColumnBatch::doubleColumn(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || m_columns[columnIdx].type != kCCColumnFloat || m_columns[columnIdx].doubles.empty())
+		return NULL;
+	return &m_columns[columnIdx].doubles.front();
+}
+
+const uint32_t* CCColumnBatch::offsets(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || m_columns[columnIdx].offsets.empty())
+		return NULL;
+	return &m_columns[columnIdx].offsets.front();
+}
+
+const char* CCColumnBatch::bytes(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || m_columns[columnIdx].bytes.empty())
+		return NULL;
+	return &m_columns[columnIdx].bytes.front();
+}
+
+const char* CCColumnBatch::bytesAt(int columnIdx, int row, size_t* outLen) {
+	*outLen = 0;
+	if(columnIdx < 0 || columnIdx >= m_columns.size() || row < 0 || row >= m_rowCount)
+		return NULL;
+
+	Column& c = m_columns[columnIdx];
+	if(c.type != kCCColumnText && c.type != kCCColumnBlob)
+		return NULL;
+
+	*outLen = c.offsets[row + 1] - c.offsets[row];
+	return c.bytes.empty() ? "" : &c.bytes.front() + c.offsets[row];
+}
+
+string CCColumnBatch::stringAt(int columnIdx, int row) {
+	size_t len;
+	const char* p = bytesAt(columnIdx, row, &len);
+	return p ? string(p, len) : "";
+}
+
+NS_CC_END
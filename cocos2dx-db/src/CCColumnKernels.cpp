@@ -0,0 +1,417 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCColumnKernels.h"
+#include "CCColumnBatch.h"
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+	#define CC_KERNEL_SSE2 1
+#elif defined(__aarch64__)
+	#include <arm_neon.h>
+	#define CC_KERNEL_NEON 1
+	#define CC_KERNEL_NEON64 1
+#elif defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define CC_KERNEL_NEON 1
+#elif defined(__ANDROID__) && defined(__arm__)
+	// armeabi-v7a doesn't require NEON, NEON variants are in CCColumnKernelsNeon.cpp
+	#include <cpu-features.h>
+	#define CC_KERNEL_NEON_DISPATCH 1
+#endif
+
+NS_CC_BEGIN
+
+#if CC_KERNEL_NEON_DISPATCH
+/// defined in CCColumnKernelsNeon.cpp
+int64_t ccColumnSumInt64Neon(const int64_t* values, int count);
+
+/// true if cpu has NEON, checked once
+static bool hasNeon() {
+	static bool s_hasNeon = android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM &&
+		(android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON) != 0;
+	return s_hasNeon;
+}
+#endif
+
+/// evaluate a compare operator, branch free for selection loops
+template<typename T>
+static inline bool compareValue(T a, int op, T b) {
+	switch(op) {
+		case kCCCompareEqual:
+			return a == b;
+		case kCCCompareNotEqual:
+			return a != b;
+		case kCCCompareLess:
+			return a < b;
+		case kCCCompareLessEqual:
+			return a <= b;
+		case kCCCompareGreater:
+			return a > b;
+		default:
+			return a >= b;
+	}
+}
+
+/// scalar selection, index is written always and output cursor moves only if matched
+template<typename T>
+static int selectScalar(const T* values, int start, int count, int op, T value, uint32_t* outSel, int n) {
+	switch(op) {
+		case kCCCompareEqual:
+			for(int i = start; i < count; i++) { outSel[n] = i; n += values[i] == value; }
+			break;
+		case kCCCompareNotEqual:
+			for(int i = start; i < count; i++) { outSel[n] = i; n += values[i] != value; }
+			break;
+		case kCCCompareLess:
+			for(int i = start; i < count; i++) { outSel[n] = i; n += values[i] < value; }
+			break;
+		case kCCCompareLessEqual:
+			for(int i = start; i < count; i++) { outSel[n] = i; n += values[i] <= value; }
+			break;
+		case kCCCompareGreater:
+			for(int i = start; i < count; i++) { outSel[n] = i; n += values[i] > value; }
+			break;
+		default:
+			for(int i = start; i < count; i++) { outSel[n] = i; n += values[i] >= value; }
+			break;
+	}
+	return n;
+}
+
+/// refine a selection, outSel can be same as sel because n never passes i
+template<typename T>
+static int refineScalar(const T* values, int op, T value, const uint32_t* sel, int selCount, uint32_t* outSel) {
+	int n = 0;
+	for(int i = 0; i < selCount; i++) {
+		uint32_t row = sel[i];
+		outSel[n] = row;
+		n += compareValue(values[row], op, value);
+	}
+	return n;
+}
+
+int CCColumnKernels::selectNotNull(const uint8_t* nullBitmap, int count, uint32_t* outSel) {
+	int n = 0;
+	if(!nullBitmap) {
+		for(int i = 0; i < count; i++)
+			outSel[n++] = i;
+		return n;
+	}
+
+	// skip whole bytes quickly
+	for(int i = 0; i < count; i += 8) {
+		uint8_t bits = nullBitmap[i >> 3];
+		int end = MIN(count, i + 8);
+		if(bits == 0) {
+			for(int j = i; j < end; j++)
+				outSel[n++] = j;
+		} else if(bits != 0xff) {
+			for(int j = i; j < end; j++) {
+				outSel[n] = j;
+				n += !(bits & (1 << (j - i)));
+			}
+		}
+	}
+	return n;
+}
+
+int CCColumnKernels::selectInt64(const int64_t* values, int count, int op, int64_t value, const uint32_t* sel, int selCount, uint32_t* outSel) {
+	// neither SSE2 nor ARMv7 NEON has 64 bits integer compare, branch free scalar is fast enough
+	if(sel)
+		return refineScalar(values, op, value, sel, selCount, outSel);
+	return selectScalar(values, 0, count, op, value, outSel, 0);
+}
+
+int CCColumnKernels::selectDouble(const double* values, int count, int op, double value, const uint32_t* sel, int selCount, uint32_t* outSel) {
+	if(sel)
+		return refineScalar(values, op, value, sel, selCount, outSel);
+
+	int n = 0;
+	int i = 0;
+#if CC_KERNEL_SSE2
+	// compare two values at once, mask bit i is set if lane i matches
+	__m128d v = _mm_set1_pd(value);
+	for(; i + 2 <= count; i += 2) {
+		__m128d x = _mm_loadu_pd(values + i);
+		__m128d c;
+		switch(op) {
+			case kCCCompareEqual: c = _mm_cmpeq_pd(x, v); break;
+			case kCCCompareNotEqual: c = _mm_cmpneq_pd(x, v); break;
+			case kCCCompareLess: c = _mm_cmplt_pd(x, v); break;
+			case kCCCompareLessEqual: c = _mm_cmple_pd(x, v); break;
+			case kCCCompareGreater: c = _mm_cmpgt_pd(x, v); break;
+			default: c = _mm_cmpge_pd(x, v); break;
+		}
+		int mask = _mm_movemask_pd(c);
+		outSel[n] = i;
+		n += mask & 1;
+		outSel[n] = i + 1;
+		n += (mask >> 1) & 1;
+	}
+#elif CC_KERNEL_NEON64
+	float64x2_t v = vdupq_n_f64(value);
+	for(; i + 2 <= count; i += 2) {
+		float64x2_t x = vld1q_f64(values + i);
+		uint64x2_t c;
+		switch(op) {
+			case kCCCompareEqual: c = vceqq_f64(x, v); break;
+			case kCCCompareNotEqual: c = vreinterpretq_u64_u8(vmvnq_u8(vreinterpretq_u8_u64(vceqq_f64(x, v)))); break;
+			case kCCCompareLess: c = vcltq_f64(x, v); break;
+			case kCCCompareLessEqual: c = vcleq_f64(x, v); break;
+			case kCCCompareGreater: c = vcgtq_f64(x, v); break;
+			default: c = vcgeq_f64(x, v); break;
+		}
+		outSel[n] = i;
+		n += vgetq_lane_u64(c, 0) & 1;
+		outSel[n] = i + 1;
+		n += vgetq_lane_u64(c, 1) & 1;
+	}
+#endif
+
+	// tail
+	return selectScalar(values, i, count, op, value, outSel, n);
+}
+
+int64_t CCColumnKernels::sumInt64(const int64_t* values, int count, const uint32_t* sel, int selCount) {
+	int64_t sum = 0;
+	if(sel) {
+		for(int i = 0; i < selCount; i++)
+			sum += values[sel[i]];
+		return sum;
+	}
+
+#if CC_KERNEL_NEON_DISPATCH
+	if(hasNeon())
+		return ccColumnSumInt64Neon(values, count);
+#endif
+
+	int i = 0;
+#if CC_KERNEL_SSE2
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+	for(; i + 4 <= count; i += 4) {
+		acc0 = _mm_add_epi64(acc0, _mm_loadu_si128((const __m128i*)(values + i)));
+		acc1 = _mm_add_epi64(acc1, _mm_loadu_si128((const __m128i*)(values + i + 2)));
+	}
+	int64_t lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+	sum = lanes[0] + lanes[1];
+#elif CC_KERNEL_NEON
+	int64x2_t acc0 = vdupq_n_s64(0);
+	int64x2_t acc1 = vdupq_n_s64(0);
+	for(; i + 4 <= count; i += 4) {
+		acc0 = vaddq_s64(acc0, vld1q_s64((const int64_t*)(values + i)));
+		acc1 = vaddq_s64(acc1, vld1q_s64((const int64_t*)(values + i + 2)));
+	}
+	int64x2_t acc = vaddq_s64(acc0, acc1);
+	sum = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+#endif
+	for(; i < count; i++)
+		sum += values[i];
+	return sum;
+}
+
+double CCColumnKernels::sumDouble(const double* values, int count, const uint32_t* sel, int selCount) {
+	double sum = 0;
+	if(sel) {
+		for(int i = 0; i < selCount; i++)
+			sum += values[sel[i]];
+		return sum;
+	}
+
+	int i = 0;
+#if CC_KERNEL_SSE2
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	for(; i + 4 <= count; i += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_loadu_pd(values + i));
+		acc1 = _mm_add_pd(acc1, _mm_loadu_pd(values + i + 2));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+	sum = lanes[0] + lanes[1];
+#elif CC_KERNEL_NEON64
+	float64x2_t acc0 = vdupq_n_f64(0);
+	float64x2_t acc1 = vdupq_n_f64(0);
+	for(; i + 4 <= count; i += 4) {
+		acc0 = vaddq_f64(acc0, vld1q_f64(values + i));
+		acc1 = vaddq_f64(acc1, vld1q_f64(values + i + 2));
+	}
+	float64x2_t acc = vaddq_f64(acc0, acc1);
+	sum = vgetq_lane_f64(acc, 0) + vgetq_lane_f64(acc, 1);
+#else
+	// two accumulators so that additions don't wait each other
+	double sum1 = 0;
+	for(; i + 2 <= count; i += 2) {
+		sum += values[i];
+		sum1 += values[i + 1];
+	}
+	sum += sum1;
+#endif
+	for(; i < count; i++)
+		sum += values[i];
+	return sum;
+}
+
+bool CCColumnKernels::minMaxInt64(const int64_t* values, int count, int64_t* outMin, int64_t* outMax, const uint32_t* sel, int selCount) {
+	int n = sel ? selCount : count;
+	if(n <= 0)
+		return false;
+
+	// no 64 bits integer min/max in SSE2 or NEON, scalar with conditional moves
+	int64_t mn = values[sel ? sel[0] : 0];
+	int64_t mx = mn;
+	if(sel) {
+		for(int i = 1; i < selCount; i++) {
+			int64_t v = values[sel[i]];
+			mn = v < mn ? v : mn;
+			mx = v > mx ? v : mx;
+		}
+	} else {
+		for(int i = 1; i < count; i++) {
+			int64_t v = values[i];
+			mn = v < mn ? v : mn;
+			mx = v > mx ? v : mx;
+		}
+	}
+	*outMin = mn;
+	*outMax = mx;
+	return true;
+}
+
+bool CCColumnKernels::minMaxDouble(const double* values, int count, double* outMin, double* outMax, const uint32_t* sel, int selCount) {
+	int n = sel ? selCount : count;
+	if(n <= 0)
+		return false;
+
+	double mn = values[sel ? sel[0] : 0];
+	double mx = mn;
+	if(sel) {
+		for(int i = 1; i < selCount; i++) {
+			double v = values[sel[i]];
+			mn = v < mn ? v : mn;
+			mx = v > mx ? v : mx;
+		}
+		*outMin = mn;
+		*outMax = mx;
+		return true;
+	}
+
+	int i = 1;
+#if CC_KERNEL_SSE2
+	__m128d vmin = _mm_set1_pd(mn);
+	__m128d vmax = vmin;
+	for(; i + 2 <= count; i += 2) {
+		__m128d x = _mm_loadu_pd(values + i);
+		vmin = _mm_min_pd(vmin, x);
+		vmax = _mm_max_pd(vmax, x);
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, vmin);
+	mn = MIN(lanes[0], lanes[1]);
+	_mm_storeu_pd(lanes, vmax);
+	mx = MAX(lanes[0], lanes[1]);
+#elif CC_KERNEL_NEON64
+	float64x2_t vmin = vdupq_n_f64(mn);
+	float64x2_t vmax = vmin;
+	for(; i + 2 <= count; i += 2) {
+		float64x2_t x = vld1q_f64(values + i);
+		vmin = vminq_f64(vmin, x);
+		vmax = vmaxq_f64(vmax, x);
+	}
+	mn = MIN(vgetq_lane_f64(vmin, 0), vgetq_lane_f64(vmin, 1));
+	mx = MAX(vgetq_lane_f64(vmax, 0), vgetq_lane_f64(vmax, 1));
+#endif
+	for(; i < count; i++) {
+		double v = values[i];
+		mn = v < mn ? v : mn;
+		mx = v > mx ? v : mx;
+	}
+	*outMin = mn;
+	*outMax = mx;
+	return true;
+}
+
+void CCColumnKernels::histogramDouble(const double* values, int count, double minValue, double maxValue, int bins, uint32_t* outCounts, const uint32_t* sel, int selCount) {
+	if(bins <= 0)
+		return;
+	memset(outCounts, 0, bins * sizeof(uint32_t));
+
+	// scatter can't be vectorized, but multiply is cheaper than divide
+	double scale = maxValue > minValue ? bins / (maxValue - minValue) : 0;
+	int n = sel ? selCount : count;
+	for(int i = 0; i < n; i++) {
+		double v = values[sel ? sel[i] : i];
+		int bin = (int)((v - minValue) * scale);
+		bin = bin < 0 ? 0 : (bin >= bins ? bins - 1 : bin);
+		outCounts[bin]++;
+	}
+}
+
+void CCColumnKernels::histogramInt64(const int64_t* values, int count, int64_t minValue, int64_t maxValue, int bins, uint32_t* outCounts, const uint32_t* sel, int selCount) {
+	if(bins <= 0)
+		return;
+	memset(outCounts, 0, bins * sizeof(uint32_t));
+
+	// range is inclusive for integers
+	double scale = maxValue >= minValue ? (double)bins / ((double)(maxValue - minValue) + 1) : 0;
+	int n = sel ? selCount : count;
+	for(int i = 0; i < n; i++) {
+		int64_t v = values[sel ? sel[i] : i];
+		int bin = (int)((double)(v - minValue) * scale);
+		bin = v < minValue ? 0 : (bin >= bins ? bins - 1 : bin);
+		outCounts[bin]++;
+	}
+}
+
+double CCColumnKernels::sum(CCColumnBatch* batch, int columnIdx) {
+	switch(batch->columnType(columnIdx)) {
+		case kCCColumnInteger:
+			return (double)sumInt64(batch->int64Column(columnIdx), batch->rowCount());
+		case kCCColumnFloat:
+			return sumDouble(batch->doubleColumn(columnIdx), batch->rowCount());
+		default:
+			return 0;
+	}
+}
+
+int CCColumnKernels::countNotNull(CCColumnBatch* batch, int columnIdx) {
+	const uint8_t* bitmap = batch->nullBitmap(columnIdx);
+	int count = batch->rowCount();
+	if(!bitmap)
+		return count;
+
+	// count set bits of whole bytes, last byte has no bits beyond row count
+	int nulls = 0;
+	for(int i = 0; i < (count + 7) / 8; i++) {
+		uint8_t b = bitmap[i];
+		while(b) {
+			b &= b - 1;
+			nulls++;
+		}
+	}
+	return count - nulls;
+}
+
+NS_CC_END
@@ -0,0 +1,51 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCColumnKernels.h"
+
+// NEON variants for armeabi-v7a, Android.mk builds this file with -mfpu=neon and
+// CCColumnKernels picks them only if cpu has NEON. Other targets compile nothing here
+#if defined(__ARM_NEON__) && !defined(__aarch64__)
+
+#include <arm_neon.h>
+
+NS_CC_BEGIN
+
+int64_t ccColumnSumInt64Neon(const int64_t* values, int count) {
+	int i = 0;
+	int64x2_t acc0 = vdupq_n_s64(0);
+	int64x2_t acc1 = vdupq_n_s64(0);
+	for(; i + 4 <= count; i += 4) {
+		acc0 = vaddq_s64(acc0, vld1q_s64((const int64_t*)(values + i)));
+		acc1 = vaddq_s64(acc1, vld1q_s64((const int64_t*)(values + i + 2)));
+	}
+	int64x2_t acc = vaddq_s64(acc0, acc1);
+	int64_t sum = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+	for(; i < count; i++)
+		sum += values[i];
+	return sum;
+}
+
+NS_CC_END
+
+#endif
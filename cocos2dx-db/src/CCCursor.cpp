@@ -0,0 +1,165 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCCursor.h"
+#include "CCDatabase.h"
+#include "CCStatement.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+CCCursor::CCCursor() :
+		m_db(NULL),
+		m_statement(NULL),
+		m_stmt(NULL),
+		m_hasRow(false) {
+}
+
+CCCursor::CCCursor(CCDatabase* db, CCStatement* statement) :
+		m_db(db),
+		m_statement(statement),
+		m_stmt(statement->getStatement()),
+		m_hasRow(false) {
+}
+
+CCCursor::CCCursor(CCDatabase* db, sqlite3_stmt* stmt) :
+		m_db(db),
+		m_statement(NULL),
+		m_stmt(stmt),
+		m_hasRow(false) {
+}
+
+CCCursor::CCCursor(const CCCursor& c) :
+		m_db(c.m_db),
+		m_statement(c.m_statement),
+		m_stmt(c.m_stmt),
+		m_hasRow(c.m_hasRow) {
+	// take over statement
+	c.m_db = NULL;
+	c.m_statement = NULL;
+	c.m_stmt = NULL;
+}
+
+CCCursor::~CCCursor() {
+	close();
+}
+
+void CCCursor::close() {
+	if(m_statement) {
+		CCStatement* statement = m_statement;
+		m_statement = NULL;
+		m_stmt = NULL;
+		m_hasRow = false;
+
+		// reset and give back, statement may be released by database
+		statement->reset();
+		if(m_db)
+			m_db->releaseStatement(statement->getQuery());
+	} else if(m_stmt) {
+		// statement owned by cursor
+		sqlite3_finalize(m_stmt);
+		m_stmt = NULL;
+		m_hasRow = false;
+	}
+}
+
+bool CCCursor::next() {
+	if(!m_stmt)
+		return false;
+
+	// step with same retry policy as result set
+	if(m_db->stepStatement(m_stmt) != SQLITE_ROW) {
+		close();
+		return false;
+	}
+
+	m_hasRow = true;
+	return true;
+}
+
+int CCCursor::columnCount() {
+	return m_stmt ? sqlite3_column_count(m_stmt) : 0;
+}
+
+int CCCursor::columnIndexForName(const char* columnName) {
+	if(!m_stmt)
+		return -1;
+
+	// compare in place so no string is created
+	sqlite3_stmt* stmt = m_stmt;
+	int count = sqlite3_column_count(stmt);
+	for(int i = 0; i < count; i++) {
+		const char* name = sqlite3_column_name(stmt, i);
+		if(name && !strcasecmp(name, columnName))
+			return i;
+	}
+
+	CCLOGWARN("Can't find column index for name: %s", columnName);
+	return -1;
+}
+
+bool CCCursor::columnIndexIsNull(int columnIdx) {
+	if(!m_hasRow || !m_stmt)
+		return true;
+	return sqlite3_column_type(m_stmt, columnIdx) == SQLITE_NULL;
+}
+
+int CCCursor::intForColumnIndex(int columnIdx) {
+	if(!m_hasRow || !m_stmt)
+		return 0;
+	return sqlite3_column_int(m_stmt, columnIdx);
+}
+
+int64_t CCCursor::int64ForColumnIndex(int columnIdx) {
+	if(!m_hasRow || !m_stmt)
+		return 0;
+	return (int64_t)sqlite3_column_int64(m_stmt, columnIdx);
+}
+
+double CCCursor::doubleForColumnIndex(int columnIdx) {
+	if(!m_hasRow || !m_stmt)
+		return 0;
+	return sqlite3_column_double(m_stmt, columnIdx);
+}
+
+CCDataView CCCursor::textViewForColumnIndex(int columnIdx) {
+	if(!m_hasRow || !m_stmt)
+		return CCDataView();
+	sqlite3_stmt* stmt = m_stmt;
+	if(columnIdx < 0 || columnIdx >= sqlite3_column_count(stmt) || sqlite3_column_type(stmt, columnIdx) == SQLITE_NULL)
+		return CCDataView();
+	const char* p = (const char*)sqlite3_column_text(stmt, columnIdx);
+	return CCDataView(p, sqlite3_column_bytes(stmt, columnIdx));
+}
+
+CCDataView CCCursor::blobViewForColumnIndex(int columnIdx) {
+	if(!m_hasRow || !m_stmt)
+		return CCDataView();
+	sqlite3_stmt* stmt = m_stmt;
+	if(columnIdx < 0 || columnIdx >= sqlite3_column_count(stmt) || sqlite3_column_type(stmt, columnIdx) == SQLITE_NULL)
+		return CCDataView();
+	const char* p = (const char*)sqlite3_column_blob(stmt, columnIdx);
+	return CCDataView(p, sqlite3_column_bytes(stmt, columnIdx));
+}
+
+NS_CC_END
@@ -22,25 +22,252 @@
  THE SOFTWARE.
  ****************************************************************************/
 #include "CCDatabase.h"
+#include "CCQueryCache.h"
+#include "CCTableChangeNotifier.h"
+#include "CCSchemaCatalog.h"
+#include "CCEntityTable.h"
+#include "CCBloomIndex.h"
+#include "CCMaterializedResultSet.h"
 #include "sqlite3.h"
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <algorithm>
 #include "CCUtils.h"
+#include "CCDatabaseWorker.h"
 
 NS_CC_BEGIN
 
+/// open a sqlite3 connection, path is mapped already
+static int openConnection(const string& path, sqlite3** db, int flags, bool sharedCache = false) {
+	int err = SQLITE_OK;
+#ifdef SQLITE_OPEN_SHAREDCACHE
+	// per-connection shared cache flag
+	if(sharedCache) {
+		if(flags == 0)
+			flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+		flags |= SQLITE_OPEN_SHAREDCACHE;
+		sharedCache = false;
+	}
+#endif
+
+	// old sqlite only has process-wide switch, it affects connections opened after it
+	if(sharedCache)
+		sqlite3_enable_shared_cache(1);
+#if SQLITE_VERSION_NUMBER >= 3005000
+	if(flags != 0)
+		err = sqlite3_open_v2(path.c_str(), db, flags, NULL);
+	else
+#endif
+		err = sqlite3_open(path.c_str(), db);
+	if(sharedCache)
+		sqlite3_enable_shared_cache(0);
+	return err;
+}
+
+/// copy main database of a connection to another one
+static bool backupConnection(sqlite3* from, sqlite3* to) {
+#if SQLITE_VERSION_NUMBER >= 3006011
+	sqlite3_backup* backup = sqlite3_backup_init(to, "main", from, "main");
+	if(!backup)
+		return false;
+	int rc = sqlite3_backup_step(backup, -1);
+	sqlite3_backup_finish(backup);
+	return rc == SQLITE_DONE;
+#else
+	return false;
+#endif
+}
+
+/**
+ * job of memory-resident write-back, it writes a snapshot to a temporary file and then
+ * renames it to database file
+ */
+class CCDatabase::WriteBackJob : public CCDatabaseWorker::Job {
+private:
+	CCDatabase* m_owner;
+	sqlite3* m_snapshot;
+	string m_path;
+
+public:
+	/// true if file is written
+	bool m_ok;
+
+public:
+	WriteBackJob(CCDatabase* owner, sqlite3* snapshot, const string& path) :
+			m_owner(owner),
+			m_snapshot(snapshot),
+			m_path(path),
+			m_ok(false) {
+	}
+
+	virtual ~WriteBackJob() {
+		sqlite3_close(m_snapshot);
+	}
+
+	virtual void run(sqlite3* db) {
+		string tmp = m_path + "-writeback";
+		remove(tmp.c_str());
+		sqlite3* out = NULL;
+		bool ok = openConnection(tmp, &out, 0) == SQLITE_OK && backupConnection(m_snapshot, out);
+		sqlite3_close(out);
+
+		// journal of old file must not be applied to new file
+		if(ok) {
+			string journal = m_path + "-journal";
+			remove(journal.c_str());
+			ok = rename(tmp.c_str(), m_path.c_str()) == 0;
+		}
+		if(!ok) {
+			CCLOGERROR("CCDatabase: failed to write back %s", m_path.c_str());
+			remove(tmp.c_str());
+		}
+		m_ok = ok;
+	}
+
+	virtual void done() {
+		// not delivered after worker is stopped, so owner is alive
+		if(!m_ok)
+			m_owner->m_writeBackChanges = -1;
+	}
+};
+
+/**
+ * job of async opening, it does everything open does and then checks database
+ */
+class CCDatabase::OpenJob : public CCDatabaseWorker::Job {
+public:
+	CCDatabase* m_owner;
+	string m_path;
+	int m_flags;
+	bool m_sharedCache;
+	int m_checkMode;
+	StringList m_requiredTables;
+
+	/// result
+	sqlite3* m_db;
+	int m_state;
+	string m_message;
+
+public:
+	OpenJob(CCDatabase* owner, string path, int flags, bool sharedCache, int checkMode, const StringList& requiredTables) :
+			m_owner(owner),
+			m_path(path),
+			m_flags(flags),
+			m_sharedCache(sharedCache),
+			m_checkMode(checkMode),
+			m_requiredTables(requiredTables),
+			m_db(NULL),
+			m_state(kCCDatabaseOpenPending) {
+	}
+
+	virtual ~OpenJob() {
+		// connection is not taken by database
+		if(m_db)
+			sqlite3_close(m_db);
+	}
+
+	virtual void run(sqlite3* unused) {
+		// path is mapped by caller thread
+		int err = openConnection(m_path, &m_db, m_flags, m_sharedCache);
+		if(err != SQLITE_OK) {
+			char buf[64];
+			sprintf(buf, "error opening: %d", err);
+			m_state = kCCDatabaseOpenFailed;
+			m_message = buf;
+			sqlite3_close(m_db);
+			m_db = NULL;
+			return;
+		}
+		m_state = kCCDatabaseOpenOK;
+
+		// integrity check, the first row is "ok" if no error
+		if(m_checkMode != kCCDatabaseCheckNone) {
+			sqlite3_stmt* pStmt = NULL;
+			const char* sql = m_checkMode == kCCDatabaseCheckFull ? "PRAGMA integrity_check" : "PRAGMA quick_check";
+			if(sqlite3_prepare_v2(m_db, sql, -1, &pStmt, 0) != SQLITE_OK) {
+				m_state = kCCDatabaseOpenCorrupted;
+				m_message = sqlite3_errmsg(m_db);
+			} else {
+				int rc = sqlite3_step(pStmt);
+				if(rc == SQLITE_ROW) {
+					const char* result = (const char*)sqlite3_column_text(pStmt, 0);
+					if(!result || strcmp(result, "ok")) {
+						m_state = kCCDatabaseOpenCorrupted;
+						m_message = result ? result : "";
+					}
+				} else {
+					m_state = kCCDatabaseOpenCorrupted;
+					m_message = sqlite3_errmsg(m_db);
+				}
+			}
+			sqlite3_finalize(pStmt);
+			if(m_state != kCCDatabaseOpenOK)
+				return;
+		}
+
+		// schema validation
+		if(!m_requiredTables.empty()) {
+			sqlite3_stmt* pStmt = NULL;
+			if(sqlite3_prepare_v2(m_db, "SELECT count() FROM sqlite_master WHERE type = 'table' AND lower(name) = lower(?)", -1, &pStmt, 0) != SQLITE_OK) {
+				m_state = kCCDatabaseOpenCorrupted;
+				m_message = sqlite3_errmsg(m_db);
+			} else {
+				for(StringList::iterator iter = m_requiredTables.begin(); iter != m_requiredTables.end(); iter++) {
+					sqlite3_bind_text(pStmt, 1, iter->c_str(), -1, SQLITE_TRANSIENT);
+					bool exists = sqlite3_step(pStmt) == SQLITE_ROW && sqlite3_column_int(pStmt, 0) > 0;
+					sqlite3_reset(pStmt);
+					if(!exists) {
+						m_state = kCCDatabaseOpenSchemaMismatch;
+						m_message = "missing table: " + *iter;
+						break;
+					}
+				}
+			}
+			sqlite3_finalize(pStmt);
+		}
+	}
+
+	virtual void done() {
+		m_owner->onOpenJobDone();
+	}
+};
+
 CCDatabase::CCDatabase(string path) :
 		m_db(NULL),
 		m_databasePath(path),
 		m_inUse(false),
 		m_inTransaction(false),
 		m_shouldCacheStatements(false),
-		m_busyRetryTimeout(0) {
+		m_busyRetryTimeout(0),
+		m_openWorker(NULL),
+		m_openJob(NULL),
+		m_opening(false),
+		m_openTarget(NULL),
+		m_openSelector(NULL),
+		m_integrityCheck(kCCDatabaseCheckQuick),
+		m_openState(kCCDatabaseOpenFailed),
+		m_failedUpdateCount(0),
+		m_tracksTableChanges(false),
+		m_queryCache(NULL),
+		m_changeNotifier(NULL),
+		m_schemaCatalog(NULL),
+		m_writeBackWorker(NULL),
+		m_writeBackInterval(0),
+		m_writeBackChanges(0),
+		m_writeBackSchema(0),
+		m_sharedCache(false),
+		m_sharedCacheLockCount(0),
+		m_sharedCacheRetryTimeout(5000) {
 }
 
 CCDatabase::~CCDatabase() {
 	close();
+	CC_SAFE_RELEASE(m_queryCache);
+	CC_SAFE_RELEASE(m_changeNotifier);
+	CC_SAFE_RELEASE(m_schemaCatalog);
+	for(BloomIndexList::iterator iter = m_bloomIndexes.begin(); iter != m_bloomIndexes.end(); iter++)
+		(*iter)->release();
 	
 	// release statements
 	for(StatementMap::iterator iter = m_cachedStatements.begin(); iter != m_cachedStatements.end(); iter++) {
@@ -61,7 +288,21 @@ string CCDatabase::sqliteLibVersion() {
 	return sqlite3_libversion();
 }
 
+string CCDatabase::quoteIdentifier(const string& name) {
+	// double quote, embedded quote is doubled
+	string quoted = "\"";
+	for(string::const_iterator c = name.begin(); c != name.end(); c++) {
+		quoted += *c;
+		if(*c == '"')
+			quoted += '"';
+	}
+	return quoted + "\"";
+}
+
 bool CCDatabase::open(int flags) {
+	// async opening may be in progress
+	waitForOpen();
+
     if(m_db) {
         return true;
     }
@@ -84,13 +325,7 @@ bool CCDatabase::open(int flags) {
 	}
 	
 	// create database
-    int err = SQLITE_OK;
-#if SQLITE_VERSION_NUMBER >= 3005000
-    if(flags != 0)
-		err = sqlite3_open_v2(path.c_str(), &m_db, flags, NULL);
-    else
-#endif
-    	err = sqlite3_open(path.c_str(), &m_db);
+    int err = openConnection(path, &m_db, flags, m_sharedCache);
 	
 	// check error
     if(err != SQLITE_OK) {
@@ -99,12 +334,295 @@ bool CCDatabase::open(int flags) {
         return false;
     }
 
+	// hooks
+	installHooks();
+
     return true;
 }
 
+bool CCDatabase::openResident(float writeBackInterval, int flags) {
+	// async opening may be in progress
+	waitForOpen();
+
+	if(m_db) {
+		return true;
+	}
+
+	// no file, it is an in-memory database already
+	string path = m_databasePath;
+	if(path.empty())
+		return open(flags);
+#if SQLITE_VERSION_NUMBER < 3006011
+	CCLOGWARN("CCDatabase::openResident: backup api is not available, open file directly");
+	return open(flags);
+#endif
+
+	// map path
+	if(!CCUtils::createIntermediateFolders(path)) {
+		CCLOGERROR("failed to create containing directory for database");
+		return false;
+	}
+	path = CCUtils::mapLocalPath(path);
+
+	// in-memory connection
+	sqlite3* mem = NULL;
+	int err = sqlite3_open(":memory:", &mem);
+	if(err != SQLITE_OK) {
+		CCLOGERROR("CCDatabase::openResident: error opening: %d", err);
+		sqlite3_close(mem);
+		return false;
+	}
+
+	// load file if it exists, start empty only if it doesn't, otherwise write-back would overwrite it
+	if(CCUtils::isPathExistent(path)) {
+		sqlite3* file = NULL;
+#if SQLITE_VERSION_NUMBER >= 3005000
+		err = sqlite3_open_v2(path.c_str(), &file, flags != 0 ? flags : SQLITE_OPEN_READONLY, NULL);
+#else
+		err = sqlite3_open(path.c_str(), &file);
+#endif
+		if(err != SQLITE_OK || !backupConnection(file, mem)) {
+			CCLOGERROR("CCDatabase::openResident: failed to load %s: %d \"%s\"", path.c_str(), err, sqlite3_errmsg(err != SQLITE_OK ? file : mem));
+			sqlite3_close(file);
+			sqlite3_close(mem);
+			return false;
+		}
+		sqlite3_close(file);
+	}
+
+	m_db = mem;
+	m_residentPath = path;
+	m_writeBackChanges = sqlite3_total_changes(m_db);
+	m_writeBackSchema = readSchemaVersion();
+	m_writeBackWorker = CCDatabaseWorker::create();
+	m_writeBackWorker->retain();
+	m_writeBackInterval = MAX(0, writeBackInterval);
+	if(m_writeBackInterval > 0)
+		CCDirector::sharedDirector()->getScheduler()->scheduleSelector(schedule_selector(CCDatabase::onWriteBackTimer), this, m_writeBackInterval, false);
+
+	// hooks
+	installHooks();
+
+	return true;
+}
+
+int CCDatabase::readSchemaVersion() {
+	sqlite3_stmt* stmt = NULL;
+	int version = -1;
+	if(sqlite3_prepare_v2(m_db, "PRAGMA schema_version", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+		version = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return version;
+}
+
+bool CCDatabase::isResidentDirty() {
+	if(!isResident() || !m_db)
+		return false;
+	return sqlite3_total_changes(m_db) != m_writeBackChanges || readSchemaVersion() != m_writeBackSchema;
+}
+
+bool CCDatabase::writeBack(bool wait) {
+	if(!isResident() || !m_db)
+		return false;
+
+	// snapshot must be committed state
+	if(m_inTransaction || !sqlite3_get_autocommit(m_db)) {
+		CCLOGWARN("CCDatabase::writeBack: transaction is in progress, skip");
+		return false;
+	}
+
+	// copy to another in-memory connection, worker writes it to file
+	if(isResidentDirty()) {
+		sqlite3* snapshot = NULL;
+		if(sqlite3_open(":memory:", &snapshot) != SQLITE_OK || !backupConnection(m_db, snapshot)) {
+			CCLOGERROR("CCDatabase::writeBack: failed to take snapshot");
+			sqlite3_close(snapshot);
+			return false;
+		}
+		m_writeBackChanges = sqlite3_total_changes(m_db);
+		m_writeBackSchema = readSchemaVersion();
+		WriteBackJob* job = new WriteBackJob(this, snapshot, m_residentPath);
+
+		// waiting caller needs result, so run it here after earlier snapshots
+		if(wait) {
+			m_writeBackWorker->waitUntilIdle();
+			job->run(NULL);
+			bool ok = job->m_ok;
+			if(!ok)
+				m_writeBackChanges = -1;
+			delete job;
+			return ok;
+		}
+		m_writeBackWorker->post(job);
+	}
+
+	if(wait)
+		m_writeBackWorker->waitUntilIdle();
+	return true;
+}
+
+void CCDatabase::onWriteBackTimer(float dt) {
+	// skipped if a transaction is in progress, next tick will do it
+	if(isResidentDirty() && !m_inTransaction && sqlite3_get_autocommit(m_db))
+		writeBack(false);
+}
+
+bool CCDatabase::openAsync(CCObject* target, SEL_CallFuncO selector, int flags) {
+	// already opened or opening
+	if(m_db) {
+		if(target && selector)
+			(target->*selector)(this);
+		return true;
+	}
+	if(m_opening) {
+		CCLOGWARN("CCDatabase::openAsync: database is already in opening");
+		return false;
+	}
+
+	// map path here, file utils may not be used in worker thread
+	// if null, create it in memory
+	// if not null, create intermediate directory
+	string path = m_databasePath;
+	if(path.empty())
+		path = ":memory:";
+	else {
+		if(!CCUtils::createIntermediateFolders(path)) {
+			CCLOGERROR("failed to create containing directory for database");
+			m_openState = kCCDatabaseOpenFailed;
+			m_openMessage = "failed to create containing directory for database";
+			return false;
+		}
+		path = CCUtils::mapLocalPath(path);
+	}
+
+	// save callback
+	m_openTarget = target;
+	m_openSelector = selector;
+	CC_SAFE_RETAIN(m_openTarget);
+
+	// post opening job to a worker without connection
+	m_opening = true;
+	m_openState = kCCDatabaseOpenPending;
+	m_openMessage = "";
+	m_failedUpdateCount = 0;
+	m_openWorker = CCDatabaseWorker::create();
+	m_openWorker->retain();
+	m_openJob = new OpenJob(this, path, flags, m_sharedCache, m_integrityCheck, m_requiredTables);
+	m_openWorker->post(m_openJob);
+
+	return true;
+}
+
+void CCDatabase::addRequiredTable(string tableName) {
+	m_requiredTables.push_back(tableName);
+}
+
+void CCDatabase::attachOpenedConnection() {
+	if(!m_opening || !m_openJob)
+		return;
+
+	// take connection and result
+	m_opening = false;
+	m_db = m_openJob->m_db;
+	m_openJob->m_db = NULL;
+	if(m_db)
+		installHooks();
+	m_openState = m_openJob->m_state;
+	m_openMessage = m_openJob->m_message;
+	if(m_openState != kCCDatabaseOpenOK) {
+		CCLOGWARN("CCDatabase::openAsync: %d \"%s\"", m_openState, m_openMessage.c_str());
+	}
+
+	// run queued updates, failed ones are reported to callback by failed update count
+	// they are written for expected schema, so they are discarded if database is not usable as it is
+	StringList updates;
+	updates.swap(m_pendingUpdates);
+	if(m_db && m_openState == kCCDatabaseOpenOK) {
+		for(StringList::iterator iter = updates.begin(); iter != updates.end(); iter++) {
+			if(!_executeUpdate(iter->c_str()))
+				m_failedUpdateCount++;
+		}
+		if(m_failedUpdateCount > 0)
+			CCLOGWARN("CCDatabase::openAsync: %d queued updates failed", m_failedUpdateCount);
+	} else if(!updates.empty()) {
+		m_failedUpdateCount = (int)updates.size();
+		CCLOGWARN("CCDatabase::openAsync: %d queued updates are discarded", m_failedUpdateCount);
+	}
+}
+
+void CCDatabase::onOpenJobDone() {
+	attachOpenedConnection();
+
+	// job will be deleted by worker after done
+	m_openJob = NULL;
+
+	// release worker, we are in its dispatching and it keeps itself alive
+	m_openWorker->stop();
+	CC_SAFE_RELEASE_NULL(m_openWorker);
+
+	// callback
+	CCObject* target = m_openTarget;
+	SEL_CallFuncO selector = m_openSelector;
+	m_openTarget = NULL;
+	m_openSelector = NULL;
+	if(target && selector)
+		(target->*selector)(this);
+	CC_SAFE_RELEASE(target);
+}
+
+void CCDatabase::waitForOpen() {
+	if(!m_opening)
+		return;
+
+	// connection is ready when worker is idle, callback is still delivered in next tick
+	m_openWorker->waitUntilIdle();
+	attachOpenedConnection();
+}
+
 bool CCDatabase::close() {
+	// finish async opening, its callback won't be invoked
+	if(m_openWorker) {
+		waitForOpen();
+		m_openJob = NULL;
+		m_openWorker->stop();
+		CC_SAFE_RELEASE_NULL(m_openWorker);
+		CC_SAFE_RELEASE_NULL(m_openTarget);
+		m_openSelector = NULL;
+	}
+
+	// last write-back of memory-resident database, pending snapshots are all written
+	// uncommitted changes can't be kept, so roll back and write committed state
+	if(isResident()) {
+		if(m_db && (m_inTransaction || !sqlite3_get_autocommit(m_db))) {
+			CCLOGWARN("CCDatabase::close: transaction is in progress, roll back it");
+			rollback();
+			if(sqlite3_get_autocommit(m_db))
+				m_inTransaction = false;
+		}
+		if(m_db && !writeBack(true))
+			CCLOGERROR("CCDatabase::close: changes after last write-back are lost");
+		if(m_writeBackInterval > 0)
+			CCDirector::sharedDirector()->getScheduler()->unscheduleSelector(schedule_selector(CCDatabase::onWriteBackTimer), this);
+		m_writeBackWorker->waitUntilIdle();
+		m_writeBackWorker->stop();
+		CC_SAFE_RELEASE_NULL(m_writeBackWorker);
+		m_residentPath.clear();
+		m_writeBackInterval = 0;
+	}
+
 	clearCachedStatements();
 
+	// results and changes are of this connection
+	clearResultCaches();
+	if(m_changeNotifier)
+		m_changeNotifier->reset();
+
+	// catalogue and filters keep statements, finalize them before closing
+	if(m_schemaCatalog)
+		m_schemaCatalog->reset();
+	for(BloomIndexList::iterator iter = m_bloomIndexes.begin(); iter != m_bloomIndexes.end(); iter++)
+		(*iter)->reset();
+
 	// check db
 	if(!m_db) {
 		return true;
@@ -165,6 +683,9 @@ void CCDatabase::clearCachedStatements() {
 }
 
 bool CCDatabase::databaseOpened() {
+	// async opening may be in progress
+	waitForOpen();
+
     if (!m_db) {
         CCLOGWARN("The CCDatabase %d is not open.", this);
         return false;
@@ -186,11 +707,21 @@ bool CCDatabase::executeUpdate(string sql, ...) {
 }
 
 bool CCDatabase::_executeUpdate(const char* sql) {
+	// queue it if async opening is in progress
+	if(m_opening) {
+		m_pendingUpdates.push_back(sql);
+		return true;
+	}
+
 	// database check
     if (!databaseOpened()) {
         return false;
     }
 
+	// last commit is done if no transaction is open, it may begin a new one
+	if(m_changeNotifier)
+		m_changeNotifier->confirm();
+
     // is in use?
     if (m_inUse) {
         warnInUse();
@@ -225,7 +756,7 @@ bool CCDatabase::_executeUpdate(const char* sql) {
 				retry = true;
 				usleep(20);
 
-				if(m_busyRetryTimeout && (numberOfRetries++ > m_busyRetryTimeout)) {
+				if(shouldStopRetry(rc, numberOfRetries)) {
 					CCLOGWARN("CCDatabase:_executeUpdate: Database busy");
 					sqlite3_finalize(pStmt);
 					setInUse(false);
@@ -258,6 +789,7 @@ bool CCDatabase::_executeUpdate(const char* sql) {
 			// this will happen if the db is locked, like if we are doing an update or insert.
 			// in that case, retry the step... and maybe wait just 10 milliseconds.
 			retry = true;
+			bool giveUp = shouldStopRetry(rc, numberOfRetries);
 			if(SQLITE_LOCKED == rc) {
 				rc = sqlite3_reset(pStmt);
 				if(rc != SQLITE_LOCKED) {
@@ -266,7 +798,7 @@ bool CCDatabase::_executeUpdate(const char* sql) {
 			}
 			usleep(20);
 
-			if(m_busyRetryTimeout && (numberOfRetries++ > m_busyRetryTimeout)) {
+			if(giveUp) {
 				CCLOGWARN("CCDatabase:_executeUpdate: Database busy 2");
 				retry = false;
 			}
@@ -301,6 +833,15 @@ bool CCDatabase::_executeUpdate(const char* sql) {
 		rc = sqlite3_finalize(pStmt);
 	}
 
+    // truncate and schema changes don't go through update hook
+    if((m_queryCache || !m_entityCaches.empty()) && rc == SQLITE_OK) {
+    	const char* p = sql;
+    	while(isspace(*p))
+    		p++;
+    	if(!strncasecmp(p, "delete", 6) || !strncasecmp(p, "drop", 4) || !strncasecmp(p, "alter", 5))
+    		clearResultCaches();
+    }
+
     // release usage
     setInUse(false);
 
@@ -335,50 +876,58 @@ CCResultSet* CCDatabase::_executeQuery(const char* sql) {
     // use it now
     setInUse(true);
 
-    // variables
+    // prepare and query
     CCResultSet* rs = NULL;
-	int rc = 0;
-	sqlite3_stmt* pStmt = NULL;
-	CCStatement* statement = NULL;
+    CCStatement* statement = prepareStatement(sql);
+    if(statement)
+    	rs = CCResultSet::create(this, statement);
 
-	// get cached statement
-	statement = getCachedStatement(sql);
-	pStmt = statement ? statement->getStatement() : NULL;
+    // set in use flag
+    setInUse(false);
 
-    // retry flags
-    int numberOfRetries = 0;
-	bool retry = false;
+    // return
+    return rs;
+}
 
-	// compile statement until success or fail
-    if(!pStmt) {
-		do {
-			// prepare statement
-			retry = false;
-			rc = sqlite3_prepare_v2(m_db, sql, -1, &pStmt, 0);
+CCCursor CCDatabase::query(const char* sql, ...) {
+	// generate final sql string
+    va_list args;
+    va_start(args, sql);
+    char buf[512];
+    vsprintf(buf, sql, args);
+    va_end(args);
 
-			// wait if busy
-			if(SQLITE_BUSY == rc || SQLITE_LOCKED == rc) {
-				retry = true;
-				usleep(20);
+	// same checks as query, but no result set object
+	if(!databaseOpened())
+		return CCCursor();
+	if(m_inUse) {
+		warnInUse();
+		return CCCursor();
+	}
+	setInUse(true);
 
-				if(m_busyRetryTimeout && (numberOfRetries++ > m_busyRetryTimeout)) {
-					CCLOGWARN("CCDatabase:_executeQuery: Database busy");
-					sqlite3_finalize(pStmt);
-					setInUse(false);
-					return NULL;
-				}
-			} else if(SQLITE_OK != rc) {
-				// log error
-				CCLOGERROR("CCDatabase:_executeQuery: DB Error: %d \"%s\"", lastErrorCode(), lastErrorMessage().c_str());
+	// without statement cache, cursor owns statement so no CCStatement is allocated
+	if(!m_shouldCacheStatements) {
+		sqlite3_stmt* stmt = compileStatement(buf);
+		setInUse(false);
+		return stmt ? CCCursor(this, stmt) : CCCursor();
+	}
 
-				// release statement
-				sqlite3_finalize(pStmt);
+	CCStatement* statement = prepareStatement(buf);
+	setInUse(false);
+	return statement ? CCCursor(this, statement) : CCCursor();
+}
 
-				// set in use
-				setInUse(false);
-				return NULL;
-			}
-		} while(retry);
+CCStatement* CCDatabase::prepareStatement(const char* sql) {
+	// get cached statement
+	CCStatement* statement = getCachedStatement(sql);
+	sqlite3_stmt* pStmt = statement ? statement->getStatement() : NULL;
+
+	// compile statement
+	if(!pStmt) {
+		pStmt = compileStatement(sql);
+		if(!pStmt)
+			return NULL;
 	}
 
     // create CCStatement
@@ -392,19 +941,54 @@ CCResultSet* CCDatabase::_executeQuery(const char* sql) {
     	statement->m_useCount++;
     }
 
-    // now query
-    rs = CCResultSet::create(this, statement);
+    return statement;
+}
 
-    // set in use flag
-    setInUse(false);
+sqlite3_stmt* CCDatabase::compileStatement(const char* sql) {
+    // variables
+	int rc = 0;
+	sqlite3_stmt* pStmt = NULL;
 
-    // return
-    return rs;
+    // retry flags
+    int numberOfRetries = 0;
+	bool retry = false;
+
+	// compile statement until success or fail
+	do {
+		// prepare statement
+		retry = false;
+		rc = sqlite3_prepare_v2(m_db, sql, -1, &pStmt, 0);
+
+		// wait if busy
+		if(SQLITE_BUSY == rc || SQLITE_LOCKED == rc) {
+			retry = true;
+			usleep(20);
+
+			if(shouldStopRetry(rc, numberOfRetries)) {
+				CCLOGWARN("CCDatabase:_executeQuery: Database busy");
+				sqlite3_finalize(pStmt);
+				return NULL;
+			}
+		} else if(SQLITE_OK != rc) {
+			// log error
+			CCLOGERROR("CCDatabase:_executeQuery: DB Error: %d \"%s\"", lastErrorCode(), lastErrorMessage().c_str());
+
+			// release statement
+			sqlite3_finalize(pStmt);
+			return NULL;
+		}
+	} while(retry);
+
+	return pStmt;
 }
 
 void CCDatabase::postResultSetClosed(CCResultSet* rs) {
+	releaseStatement(rs->m_sql);
+}
+
+void CCDatabase::releaseStatement(const string& sql) {
 	// find related statement
-	StatementMap::iterator iter = m_cachedStatements.find(rs->m_sql);
+	StatementMap::iterator iter = m_cachedStatements.find(sql);
 	if(iter != m_cachedStatements.end()) {
 		// decrease use count and release it if it is zero as well as cache flag is false
 		iter->second->m_useCount--;
@@ -415,6 +999,255 @@ void CCDatabase::postResultSetClosed(CCResultSet* rs) {
 	}
 }
 
+bool CCDatabase::shouldStopRetry(int rc, int& numberOfRetries) {
+	int limit = m_busyRetryTimeout;
+
+	// in shared-cache mode, locked may mean a table is locked by another connection of same cache
+	if(m_sharedCache && SQLITE_LOCKED == rc) {
+#ifdef SQLITE_LOCKED_SHAREDCACHE
+		if(sqlite3_extended_errcode(m_db) == SQLITE_LOCKED_SHAREDCACHE)
+#endif
+		{
+			if(numberOfRetries == 0)
+				m_sharedCacheLockCount++;
+
+			// owner may be on this thread, so never wait forever
+			if(m_sharedCacheRetryTimeout && (!limit || m_sharedCacheRetryTimeout < limit))
+				limit = m_sharedCacheRetryTimeout;
+		}
+	}
+
+	return limit && numberOfRetries++ > limit;
+}
+
+int CCDatabase::stepStatement(sqlite3_stmt* stmt) {
+	if(m_changeNotifier)
+		m_changeNotifier->confirm();
+
+	int numberOfRetries = 0;
+	int rc;
+	while(true) {
+		rc = sqlite3_step(stmt);
+		if(SQLITE_BUSY != rc && SQLITE_LOCKED != rc)
+			break;
+
+		// locked statement must be reset before retry
+		bool giveUp = shouldStopRetry(rc, numberOfRetries);
+		if(SQLITE_LOCKED == rc)
+			sqlite3_reset(stmt);
+		usleep(20);
+		if(giveUp) {
+			CCLOGWARN("CCDatabase::stepStatement: Database busy");
+			break;
+		}
+	}
+
+	if(rc != SQLITE_ROW && rc != SQLITE_DONE)
+		CCLOGERROR("Error calling sqlite3_step (%d: %s)", rc, lastErrorMessage().c_str());
+	return rc;
+}
+
+void CCDatabase::updateHook(void* arg, int op, const char* dbName, const char* tableName, long long rowId) {
+	CCDatabase* db = (CCDatabase*)arg;
+	if(db->m_tracksTableChanges)
+		db->m_tableChanges[tableName]++;
+	if(db->m_queryCache)
+		db->m_queryCache->invalidateTable(tableName);
+	if(db->m_changeNotifier)
+		db->m_changeNotifier->recordChange(op, tableName, rowId);
+	for(EntityTableList::iterator iter = db->m_entityCaches.begin(); iter != db->m_entityCaches.end(); iter++) {
+		if(!strcasecmp((*iter)->getTableName().c_str(), tableName))
+			(*iter)->invalidateRow(rowId);
+	}
+	for(BloomIndexList::iterator iter = db->m_bloomIndexes.begin(); iter != db->m_bloomIndexes.end(); iter++) {
+		if(!strcasecmp((*iter)->getTableName().c_str(), tableName))
+			(*iter)->rowChanged(op, rowId);
+	}
+}
+
+void CCDatabase::rollbackHook(void* arg) {
+	// results and entities may have read rows which are rolled back
+	CCDatabase* db = (CCDatabase*)arg;
+	db->clearResultCaches();
+	if(db->m_changeNotifier)
+		db->m_changeNotifier->rollback();
+}
+
+void CCDatabase::clearResultCaches() {
+	if(m_queryCache)
+		m_queryCache->clear();
+	for(EntityTableList::iterator iter = m_entityCaches.begin(); iter != m_entityCaches.end(); iter++)
+		(*iter)->invalidateAll();
+}
+
+int CCDatabase::commitHook(void* arg) {
+	CCDatabase* db = (CCDatabase*)arg;
+	if(db->m_changeNotifier)
+		db->m_changeNotifier->commit();
+
+	// zero lets commit go on
+	return 0;
+}
+
+void CCDatabase::installHooks() {
+	if(!m_db)
+		return;
+
+	// update hook is only needed when someone cares about changes
+	bool observed = m_changeNotifier && m_changeNotifier->hasObservers();
+	bool caching = m_queryCache || !m_entityCaches.empty();
+	if(m_tracksTableChanges || caching || observed || !m_bloomIndexes.empty())
+		sqlite3_update_hook(m_db, updateHook, this);
+	else
+		sqlite3_update_hook(m_db, NULL, NULL);
+	bool rollback = caching || observed;
+	sqlite3_rollback_hook(m_db, rollback ? rollbackHook : NULL, rollback ? this : NULL);
+	sqlite3_commit_hook(m_db, observed ? commitHook : NULL, observed ? this : NULL);
+}
+
+void CCDatabase::addTableObserver(CCObject* target, SEL_CallFuncO selector, string table, int64_t rowId) {
+	if(!m_changeNotifier) {
+		m_changeNotifier = CCTableChangeNotifier::create(this);
+		m_changeNotifier->retain();
+	}
+	m_changeNotifier->addObserver(target, selector, table, rowId);
+	installHooks();
+}
+
+void CCDatabase::removeTableObserver(CCObject* target, string table) {
+	if(m_changeNotifier) {
+		m_changeNotifier->removeObserver(target, table);
+		installHooks();
+	}
+}
+
+CCBloomIndex* CCDatabase::addBloomIndex(string table, string column, int expectedCount, double falsePositiveRate) {
+	CCBloomIndex* index = getBloomIndex(table, column);
+	if(index)
+		return index;
+	index = CCBloomIndex::create(this, table, column, expectedCount, falsePositiveRate);
+	if(!index)
+		return NULL;
+	index->retain();
+	m_bloomIndexes.push_back(index);
+	installHooks();
+	return index;
+}
+
+CCBloomIndex* CCDatabase::getBloomIndex(string table, string column) {
+	for(BloomIndexList::iterator iter = m_bloomIndexes.begin(); iter != m_bloomIndexes.end(); iter++) {
+		CCBloomIndex* index = *iter;
+		if(!strcasecmp(index->getTableName().c_str(), table.c_str()) && !strcasecmp(index->getColumnName().c_str(), column.c_str()))
+			return index;
+	}
+	return NULL;
+}
+
+void CCDatabase::removeBloomIndex(string table, string column) {
+	CCBloomIndex* index = getBloomIndex(table, column);
+	if(index) {
+		m_bloomIndexes.erase(find(m_bloomIndexes.begin(), m_bloomIndexes.end(), index));
+		index->reset();
+		index->release();
+		installHooks();
+	}
+}
+
+void CCDatabase::invalidateTable(const string& tableName) {
+	if(m_queryCache)
+		m_queryCache->invalidateTable(tableName);
+	for(EntityTableList::iterator iter = m_entityCaches.begin(); iter != m_entityCaches.end(); iter++) {
+		if(!strcasecmp((*iter)->getTableName().c_str(), tableName.c_str()))
+			(*iter)->invalidateAll();
+	}
+}
+
+void CCDatabase::setCachesQueryResults(bool value) {
+	if(value && !m_queryCache) {
+		m_queryCache = CCQueryCache::create();
+		m_queryCache->retain();
+	} else if(!value) {
+		CC_SAFE_RELEASE_NULL(m_queryCache);
+	}
+	installHooks();
+}
+
+int CCDatabase::readTablesAuthorizer(void* arg, int action, const char* arg1, const char* arg2, const char* dbName, const char* trigger) {
+	if(action == SQLITE_READ && arg1) {
+		StringList* tables = (StringList*)arg;
+		if(find(tables->begin(), tables->end(), arg1) == tables->end())
+			tables->push_back(arg1);
+	}
+	return SQLITE_OK;
+}
+
+bool CCDatabase::collectReadTables(const char* sql, StringList& outTables) {
+	// compile once with authorizer, tables are reported while compiling
+	sqlite3_stmt* pStmt = NULL;
+	sqlite3_set_authorizer(m_db, readTablesAuthorizer, &outTables);
+	int rc = sqlite3_prepare_v2(m_db, sql, -1, &pStmt, 0);
+	sqlite3_set_authorizer(m_db, NULL, NULL);
+	sqlite3_finalize(pStmt);
+	if(rc != SQLITE_OK)
+		CCLOGERROR("CCDatabase::executeCachedQuery: DB Error: %d \"%s\"", lastErrorCode(), lastErrorMessage().c_str());
+	return rc == SQLITE_OK;
+}
+
+CCMaterializedResultSet* CCDatabase::executeCachedQuery(string sql, ...) {
+	// generate final sql string
+    va_list args;
+    va_start(args, sql);
+    char buf[512];
+    vsprintf(buf, sql.c_str(), args);
+    va_end(args);
+
+	// from cache, every caller gets its own cursor
+	if(m_queryCache) {
+		CCMaterializedResultSet* cached = m_queryCache->lookup(buf);
+		if(cached)
+			return cached->copy();
+	}
+
+	// find tables read by sql
+	StringList tables;
+	if(m_queryCache && databaseOpened()) {
+		if(!collectReadTables(buf, tables))
+			return NULL;
+	}
+
+	// query
+	CCResultSet* rs = _executeQuery(buf);
+	if(!rs)
+		return NULL;
+	CCMaterializedResultSet* mrs = rs->materialize();
+	if(!m_queryCache)
+		return mrs;
+
+	// cached one is never handed out so its cursor stays still
+	m_queryCache->store(buf, mrs, tables);
+	return mrs->copy();
+}
+
+void CCDatabase::setTracksTableChanges(bool value) {
+	m_tracksTableChanges = value;
+	installHooks();
+}
+
+int64_t CCDatabase::getTableChangeCount(string tableName) {
+	// exact match first, then case insensitive
+	TableChangeMap::iterator iter = m_tableChanges.find(tableName);
+	if(iter != m_tableChanges.end())
+		return iter->second;
+	CCUtils::toLowercase(tableName);
+	for(iter = m_tableChanges.begin(); iter != m_tableChanges.end(); iter++) {
+		string name = iter->first;
+		CCUtils::toLowercase(name);
+		if(name == tableName)
+			return iter->second;
+	}
+	return 0;
+}
+
 void CCDatabase::warnInUse() {
     CCLOGWARN("The CCDatabase %d is currently in use.", this);
 }
@@ -439,6 +1272,7 @@ bool CCDatabase::hadError() {
 }
 
 int64_t CCDatabase::lastInsertRowId() {
+	waitForOpen();
     if(m_inUse) {
     	warnInUse();
         return false;
@@ -460,6 +1294,7 @@ void CCDatabase::setShouldCacheStatements(bool value) {
 }
 
 int CCDatabase::changes() {
+	waitForOpen();
     if (m_inUse) {
         warnInUse();
         return 0;
@@ -526,19 +1361,7 @@ bool CCDatabase::beginTransaction() {
 }
 
 bool CCDatabase::tableExists(string tableName) {
-    bool returnBool;
-
-    // search in sqlite_master table if table exists
-	CCUtils::toLowercase(tableName);
-    CCResultSet* rs = executeQuery("select [sql] from sqlite_master where [type] = 'table' and lower(name) = '%s'", tableName.c_str());
-
-    // if at least one next exists, table exists
-    returnBool = rs->next();
-
-    // close and free object
-    rs->close();
-
-    return returnBool;
+	return getSchemaCatalog()->tableExists(tableName);
 }
 
 int CCDatabase::getVersion() {
@@ -549,6 +1372,42 @@ void CCDatabase::setVersion(int v) {
 	executeUpdate("PRAGMA user_version = %d;", v);
 }
 
+bool CCDatabase::setReadUncommitted(bool flag) {
+	return executeUpdate("PRAGMA read_uncommitted = %d;", flag ? 1 : 0);
+}
+
+int CCDatabase::getCacheMemoryUsed() {
+	waitForOpen();
+	if(!m_db)
+		return -1;
+
+	int current = -1;
+#if defined(SQLITE_DBSTATUS_CACHE_USED_SHARED)
+	int highwater = 0;
+	if(sqlite3_db_status(m_db, SQLITE_DBSTATUS_CACHE_USED_SHARED, &current, &highwater, 0) != SQLITE_OK)
+		current = -1;
+#elif defined(SQLITE_DBSTATUS_CACHE_USED)
+	int highwater = 0;
+	if(sqlite3_db_status(m_db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0) != SQLITE_OK)
+		current = -1;
+#endif
+	return current;
+}
+
+int64_t CCDatabase::getCacheMemoryLimit() {
+	int64_t pageSize = intForQuery("PRAGMA page_size;");
+	int64_t cacheSize = intForQuery("PRAGMA cache_size;");
+
+	// negative cache size is in KiB
+	if(cacheSize < 0)
+		return -cacheSize * 1024;
+	else
+		return cacheSize * pageSize;
+}
+
+// single value queries below close result set after reading first row, so that statement
+// doesn't hold lock until result set is released
+
 int CCDatabase::intForQuery(string sql, ...) {
 	// generate final sql string
     va_list args;
@@ -558,8 +1417,12 @@ int CCDatabase::intForQuery(string sql, ...) {
     va_end(args);
 
     CCResultSet* rs = _executeQuery(buf);
-    rs->next();
-    return rs->intForColumnIndex(0);
+    if(!rs)
+    	return 0;
+
+    int ret = rs->next() ? rs->intForColumnIndex(0) : 0;
+    rs->close();
+    return ret;
 }
 
 long CCDatabase::longForQuery(string sql, ...) {
@@ -571,8 +1434,12 @@ long CCDatabase::longForQuery(string sql, ...) {
     va_end(args);
 
     CCResultSet* rs = _executeQuery(buf);
-    rs->next();
-    return rs->longForColumnIndex(0);
+    if(!rs)
+    	return 0;
+
+    long ret = rs->next() ? rs->longForColumnIndex(0) : 0;
+    rs->close();
+    return ret;
 }
 
 int64_t CCDatabase::int64ForQuery(string sql, ...) {
@@ -584,8 +1451,12 @@ int64_t CCDatabase::int64ForQuery(string sql, ...) {
     va_end(args);
 
     CCResultSet* rs = _executeQuery(buf);
-    rs->next();
-    return rs->int64ForColumnIndex(0);
+    if(!rs)
+    	return 0;
+
+    int64_t ret = rs->next() ? rs->int64ForColumnIndex(0) : 0;
+    rs->close();
+    return ret;
 }
 
 bool CCDatabase::boolForQuery(string sql, ...) {
@@ -597,8 +1468,12 @@ bool CCDatabase::boolForQuery(string sql, ...) {
     va_end(args);
 
     CCResultSet* rs = _executeQuery(buf);
-    rs->next();
-    return rs->boolForColumnIndex(0);
+    if(!rs)
+    	return false;
+
+    bool ret = rs->next() ? rs->boolForColumnIndex(0) : false;
+    rs->close();
+    return ret;
 }
 
 double CCDatabase::doubleForQuery(string sql, ...) {
@@ -610,8 +1485,12 @@ double CCDatabase::doubleForQuery(string sql, ...) {
     va_end(args);
 
     CCResultSet* rs = _executeQuery(buf);
-    rs->next();
-    return rs->doubleForColumnIndex(0);
+    if(!rs)
+    	return 0;
+
+    double ret = rs->next() ? rs->doubleForColumnIndex(0) : 0;
+    rs->close();
+    return ret;
 }
 
 string CCDatabase::stringForQuery(string sql, ...) {
@@ -623,8 +1502,12 @@ string CCDatabase::stringForQuery(string sql, ...) {
     va_end(args);
 
     CCResultSet* rs = _executeQuery(buf);
-    rs->next();
-    return rs->stringForColumnIndex(0);
+    if(!rs)
+    	return "";
+
+    string ret = rs->next() ? rs->stringForColumnIndex(0) : "";
+    rs->close();
+    return ret;
 }
 
 const void* CCDatabase::dataForQuery(string sql, size_t* outLen, ...) {
@@ -667,6 +1550,9 @@ string CCDatabase::validateSQL(string sql, ...) {
 	int numberOfRetries = 0;
 	string ret;
 
+	// async opening may be in progress
+	waitForOpen();
+
 	// set in use flag
 	setInUse(true);
 
@@ -708,26 +1594,15 @@ CCResultSet* CCDatabase::getTableSchema(string tableName) {
 }
 
 bool CCDatabase::columnExists(string tableName, string columnName) {
-    bool existent = false;
-
-    // lower case
-	CCUtils::toLowercase(tableName);
-	CCUtils::toLowercase(columnName);
-
-    // get table schema
-    CCResultSet* rs = getTableSchema(tableName);
-
-    // check if column is present in table schema
-    while(rs->next()) {
-    	string column = rs->stringForColumn("name");
-		CCUtils::toLowercase(column);
-    	if(column == columnName) {
-    		existent = true;
-    		break;
-    	}
-    }
+	return getSchemaCatalog()->columnExists(tableName, columnName);
+}
 
-    return existent;
+CCSchemaCatalog* CCDatabase::getSchemaCatalog() {
+	if(!m_schemaCatalog) {
+		m_schemaCatalog = CCSchemaCatalog::create(this);
+		m_schemaCatalog->retain();
+	}
+	return m_schemaCatalog;
 }
 
 bool CCDatabase::executeSQL(string path) {
@@ -0,0 +1,248 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCDatabaseMaintenance.h"
+#include "CCDatabase.h"
+#include "sqlite3.h"
+#include <sys/time.h>
+
+NS_CC_BEGIN
+
+/// auto vacuum modes
+#define AUTO_VACUUM_NONE 0
+#define AUTO_VACUUM_INCREMENTAL 2
+
+/// seconds since a time
+static float secondsSince(const struct timeval& start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1000000.0f;
+}
+
+CCDatabaseMaintenance::CCDatabaseMaintenance() :
+		m_idle(false),
+		m_waitTime(0),
+		m_autoVacuum(-1),
+		m_db(NULL),
+		m_sliceBudget(0.004f),
+		m_analyzeThreshold(500),
+		m_analysisLimit(400),
+		m_vacuumPagesPerSlice(32),
+		m_vacuumThreshold(0.25f),
+		m_prefersIncrementalVacuum(false),
+		m_checkInterval(5),
+		m_analyzeRuns(0),
+		m_vacuumedPages(0),
+		m_fullVacuumRuns(0) {
+}
+
+CCDatabaseMaintenance::~CCDatabaseMaintenance() {
+	CC_SAFE_RELEASE(m_db);
+}
+
+CCDatabaseMaintenance* CCDatabaseMaintenance::create(CCDatabase* db) {
+	CCDatabaseMaintenance* m = new CCDatabaseMaintenance();
+	if(m->initWithDatabase(db)) {
+		return (CCDatabaseMaintenance*)m->autorelease();
+	}
+	m->release();
+	return NULL;
+}
+
+bool CCDatabaseMaintenance::initWithDatabase(CCDatabase* db) {
+	m_db = db;
+	CC_SAFE_RETAIN(m_db);
+
+	// changes since now are tracked
+	m_db->setTracksTableChanges(true);
+	m_analyzedChanges = m_db->getTableChangeCounts();
+
+	return true;
+}
+
+void CCDatabaseMaintenance::setIdle(bool idle) {
+	if(m_idle == idle)
+		return;
+	m_idle = idle;
+
+	// tick only when idle, scheduler retains us while scheduled
+	CCScheduler* scheduler = CCDirector::sharedDirector()->getScheduler();
+	if(m_idle) {
+		m_waitTime = 0;
+		scheduler->scheduleSelector(schedule_selector(CCDatabaseMaintenance::tick), this, 0, false);
+	} else {
+		scheduler->unscheduleSelector(schedule_selector(CCDatabaseMaintenance::tick), this);
+	}
+}
+
+bool CCDatabaseMaintenance::isDatabaseAvailable() {
+	return !m_db->isOpening() && m_db->getSqlite3Handle() && !m_db->isInUse();
+}
+
+void CCDatabaseMaintenance::tick(float dt) {
+	// nothing to do last time, wait for a while
+	if(m_waitTime > 0) {
+		m_waitTime -= dt;
+		return;
+	}
+
+	// run
+	if(!runSlices(m_sliceBudget, false)) {
+		m_waitTime = m_checkInterval;
+		m_autoVacuum = -1;
+	}
+}
+
+bool CCDatabaseMaintenance::runSlices(float budget, bool background) {
+	// skip if database is busy
+	if(!isDatabaseAvailable())
+		return true;
+
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	do {
+		if(!runSlice(background))
+			return false;
+	} while(secondsSince(start) < budget);
+	return true;
+}
+
+bool CCDatabaseMaintenance::canLimitAnalysis() {
+	// runtime version, system sqlite may differ from header
+	return sqlite3_libversion_number() >= 3032000;
+}
+
+bool CCDatabaseMaintenance::runSlice(bool background) {
+	// analyze a changed table, in a frame only if it is bounded
+	bool bounded = m_analysisLimit > 0 && canLimitAnalysis();
+	string table = (background || bounded) ? nextTableToAnalyze() : "";
+	if(!table.empty()) {
+		if(canLimitAnalysis())
+			m_db->executeUpdate("PRAGMA analysis_limit = %d", MAX(0, m_analysisLimit));
+		m_db->executeUpdate("ANALYZE %s", CCDatabase::quoteIdentifier(table).c_str());
+		m_analyzedChanges[table] = m_db->getTableChangeCount(table);
+		m_analyzeRuns++;
+		return true;
+	}
+
+	// free pages in incremental mode
+	if(m_autoVacuum < 0)
+		m_autoVacuum = pragmaInt("auto_vacuum");
+	if(m_autoVacuum == AUTO_VACUUM_INCREMENTAL && pragmaInt("freelist_count") > 0) {
+		incrementalVacuum(m_vacuumPagesPerSlice);
+		return true;
+	}
+
+	return false;
+}
+
+string CCDatabaseMaintenance::nextTableToAnalyze() {
+	const map<string, int64_t>& changes = m_db->getTableChangeCounts();
+	for(map<string, int64_t>::const_iterator iter = changes.begin(); iter != changes.end(); iter++) {
+		// skip internal tables, sqlite_stat1 is changed by ANALYZE itself
+		if(iter->first.compare(0, 7, "sqlite_") == 0)
+			continue;
+
+		if(iter->second - m_analyzedChanges[iter->first] >= m_analyzeThreshold)
+			return iter->first;
+	}
+	return "";
+}
+
+int CCDatabaseMaintenance::pragmaInt(const char* name) {
+	return m_db->intForQuery("PRAGMA %s", name);
+}
+
+void CCDatabaseMaintenance::incrementalVacuum(int pages) {
+	// incremental vacuum frees a page per step, so step until done
+	// executeUpdate only steps once so sqlite api is used directly
+	sqlite3* db = m_db->getSqlite3Handle();
+	sqlite3_stmt* pStmt = NULL;
+	char sql[64];
+	sprintf(sql, "PRAGMA incremental_vacuum(%d)", pages);
+	if(sqlite3_prepare_v2(db, sql, -1, &pStmt, 0) != SQLITE_OK) {
+		CCLOGERROR("CCDatabaseMaintenance: DB Error: %d \"%s\"", m_db->lastErrorCode(), m_db->lastErrorMessage().c_str());
+	} else {
+		int before = pragmaInt("freelist_count");
+		m_db->setInUse(true);
+		while(sqlite3_step(pStmt) == SQLITE_ROW)
+			;
+		m_db->setInUse(false);
+		m_vacuumedPages += MAX(0, before - pragmaInt("freelist_count"));
+	}
+	sqlite3_finalize(pStmt);
+}
+
+void CCDatabaseMaintenance::runInBackground(float budget) {
+	if(!isDatabaseAvailable() || m_db->isInTransaction())
+		return;
+
+	// sliced tasks
+	m_autoVacuum = -1;
+	runSlices(budget, true);
+
+	// full vacuum if too many free pages
+	if(m_vacuumThreshold > 0 && m_autoVacuum != AUTO_VACUUM_INCREMENTAL) {
+		int pageCount = pragmaInt("page_count");
+		int freeCount = pragmaInt("freelist_count");
+		if(pageCount > 0 && (float)freeCount / pageCount >= m_vacuumThreshold) {
+			// auto vacuum mode only takes effect after VACUUM
+			if(m_prefersIncrementalVacuum)
+				m_db->executeUpdate("PRAGMA auto_vacuum = INCREMENTAL");
+			if(m_db->executeUpdate("VACUUM"))
+				m_fullVacuumRuns++;
+			m_autoVacuum = -1;
+		}
+	}
+}
+
+bool CCDatabaseMaintenance::isOverdue() {
+	if(!isDatabaseAvailable())
+		return false;
+
+	// analyze
+	if(!nextTableToAnalyze().empty())
+		return true;
+
+	// vacuum
+	int autoVacuum = pragmaInt("auto_vacuum");
+	int freeCount = pragmaInt("freelist_count");
+	if(autoVacuum == AUTO_VACUUM_INCREMENTAL)
+		return freeCount > 0;
+	int pageCount = pragmaInt("page_count");
+	return m_vacuumThreshold > 0 && pageCount > 0 && (float)freeCount / pageCount >= m_vacuumThreshold;
+}
+
+int CCDatabaseMaintenance::getOverdueAnalyzeCount() {
+	int count = 0;
+	const map<string, int64_t>& changes = m_db->getTableChangeCounts();
+	for(map<string, int64_t>::const_iterator iter = changes.begin(); iter != changes.end(); iter++) {
+		if(iter->first.compare(0, 7, "sqlite_") == 0)
+			continue;
+		if(iter->second - m_analyzedChanges[iter->first] >= m_analyzeThreshold)
+			count++;
+	}
+	return count;
+}
+
+NS_CC_END
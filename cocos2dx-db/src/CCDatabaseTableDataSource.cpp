@@ -0,0 +1,451 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCDatabaseTableDataSource.h"
+#include "CCDatabase.h"
+#include "sqlite3.h"
+#include <algorithm>
+
+USING_NS_CC_EXT;
+
+NS_CC_BEGIN
+
+/// seek mode of page loading
+enum {
+	SEEK_FIRST,
+	SEEK_AFTER,
+	SEEK_BEFORE,
+	SEEK_OFFSET
+};
+
+///////////////////////////////////////////////////
+// jobs
+
+class CCDatabaseTableDataSource::CountJob : public CCDatabaseWorker::Job {
+private:
+	CCDatabaseTableDataSource* m_owner;
+	int m_generation;
+	string m_sql;
+	int m_count;
+
+public:
+	CountJob(CCDatabaseTableDataSource* owner, int generation, string sql) :
+			m_owner(owner),
+			m_generation(generation),
+			m_sql(sql),
+			m_count(0) {
+	}
+
+	virtual void run(sqlite3* db) {
+		if(!db)
+			return;
+
+		sqlite3_stmt* pStmt = NULL;
+		if(sqlite3_prepare_v2(db, m_sql.c_str(), -1, &pStmt, 0) != SQLITE_OK) {
+			CCLOGERROR("CCDatabaseTableDataSource: DB Error: \"%s\"", sqlite3_errmsg(db));
+		} else if(sqlite3_step(pStmt) == SQLITE_ROW) {
+			m_count = sqlite3_column_int(pStmt, 0);
+		}
+		sqlite3_finalize(pStmt);
+	}
+
+	virtual void done() {
+		m_owner->onRowCountLoaded(m_generation, m_count);
+	}
+};
+
+class CCDatabaseTableDataSource::PageJob : public CCDatabaseWorker::Job {
+private:
+	CCDatabaseTableDataSource* m_owner;
+	int m_generation;
+	int m_page;
+	string m_sql;
+	int m_mode;
+	int64_t m_seekKey;
+	int m_limit;
+	int m_offset;
+	RowList* m_rows;
+
+public:
+	PageJob(CCDatabaseTableDataSource* owner, int generation, int page, string sql, int mode, int64_t seekKey, int limit, int offset) :
+			m_owner(owner),
+			m_generation(generation),
+			m_page(page),
+			m_sql(sql),
+			m_mode(mode),
+			m_seekKey(seekKey),
+			m_limit(limit),
+			m_offset(offset),
+			m_rows(NULL) {
+	}
+
+	virtual ~PageJob() {
+		delete m_rows;
+	}
+
+	virtual void run(sqlite3* db) {
+		if(!db)
+			return;
+
+		// prepare
+		sqlite3_stmt* pStmt = NULL;
+		if(sqlite3_prepare_v2(db, m_sql.c_str(), -1, &pStmt, 0) != SQLITE_OK) {
+			CCLOGERROR("CCDatabaseTableDataSource: DB Error: \"%s\"", sqlite3_errmsg(db));
+			sqlite3_finalize(pStmt);
+			return;
+		}
+
+		// bind
+		int param = 1;
+		if(m_mode == SEEK_AFTER || m_mode == SEEK_BEFORE)
+			sqlite3_bind_int64(pStmt, param++, m_seekKey);
+		sqlite3_bind_int(pStmt, param++, m_limit);
+		if(m_mode == SEEK_OFFSET)
+			sqlite3_bind_int(pStmt, param++, m_offset);
+
+		// read rows, first column is key
+		m_rows = new RowList();
+		m_rows->reserve(m_limit);
+		int columnCount = sqlite3_column_count(pStmt);
+		while(sqlite3_step(pStmt) == SQLITE_ROW) {
+			m_rows->push_back(Row());
+			Row& row = m_rows->back();
+			row.m_key = sqlite3_column_int64(pStmt, 0);
+			row.m_values.resize(columnCount - 1);
+			for(int i = 1; i < columnCount; i++) {
+				Row::Value& v = row.m_values[i - 1];
+				v.type = sqlite3_column_type(pStmt, i);
+				switch(v.type) {
+					case SQLITE_INTEGER:
+						v.i = sqlite3_column_int64(pStmt, i);
+						v.d = (double)v.i;
+						break;
+					case SQLITE_FLOAT:
+						v.d = sqlite3_column_double(pStmt, i);
+						v.i = (int64_t)v.d;
+						break;
+					case SQLITE_NULL:
+						v.i = 0;
+						v.d = 0;
+						break;
+					default:
+						v.i = sqlite3_column_int64(pStmt, i);
+						v.d = sqlite3_column_double(pStmt, i);
+						v.s.assign((const char*)sqlite3_column_blob(pStmt, i), sqlite3_column_bytes(pStmt, i));
+						break;
+				}
+			}
+		}
+		sqlite3_finalize(pStmt);
+
+		// seeking before gets rows in reverse order
+		if(m_mode == SEEK_BEFORE)
+			reverse(m_rows->begin(), m_rows->end());
+	}
+
+	virtual void done() {
+		m_owner->onPageLoaded(m_generation, m_page, m_rows);
+		m_rows = NULL;
+	}
+};
+
+///////////////////////////////////////////////////
+// row
+
+bool CCDatabaseTableDataSource::Row::columnIndexIsNull(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_values.size())
+		return true;
+	return m_values[columnIdx].type == SQLITE_NULL;
+}
+
+int CCDatabaseTableDataSource::Row::intForColumnIndex(int columnIdx) {
+	return (int)int64ForColumnIndex(columnIdx);
+}
+
+int64_t CCDatabaseTableDataSource::Row::int64ForColumnIndex(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_values.size())
+		return 0;
+	return m_values[columnIdx].i;
+}
+
+bool CCDatabaseTableDataSource::Row::boolForColumnIndex(int columnIdx) {
+	return intForColumnIndex(columnIdx) != 0;
+}
+
+double CCDatabaseTableDataSource::Row::doubleForColumnIndex(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_values.size())
+		return 0;
+	return m_values[columnIdx].d;
+}
+
+string CCDatabaseTableDataSource::Row::stringForColumnIndex(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_values.size())
+		return "";
+
+	Value& v = m_values[columnIdx];
+	char buf[64];
+	switch(v.type) {
+		case SQLITE_INTEGER:
+			sprintf(buf, "%lld", (long long)v.i);
+			return buf;
+		case SQLITE_FLOAT:
+			sprintf(buf, "%g", v.d);
+			return buf;
+		case SQLITE_NULL:
+			return "";
+		default:
+			return v.s;
+	}
+}
+
+///////////////////////////////////////////////////
+// data source
+
+CCDatabaseTableDataSource::CCDatabaseTableDataSource() :
+		m_worker(NULL),
+		m_tableView(NULL),
+		m_delegate(NULL),
+		m_rowCount(-1),
+		m_generation(0),
+		m_lastIndex(0),
+		m_direction(1),
+		m_updatingCells(false),
+		m_pageSize(32),
+		m_prefetchPages(2),
+		m_maxPages(6),
+		m_descending(false) {
+}
+
+CCDatabaseTableDataSource::~CCDatabaseTableDataSource() {
+	if(m_worker) {
+		m_worker->stop();
+		m_worker->release();
+	}
+	clearPages();
+}
+
+CCDatabaseTableDataSource* CCDatabaseTableDataSource::create(CCDatabase* db, string table, string keyColumn, string columns, string where) {
+	CCDatabaseTableDataSource* ds = new CCDatabaseTableDataSource();
+	if(ds->initWithDatabase(db, table, keyColumn, columns, where)) {
+		return (CCDatabaseTableDataSource*)ds->autorelease();
+	}
+	ds->release();
+	return NULL;
+}
+
+bool CCDatabaseTableDataSource::initWithDatabase(CCDatabase* db, string table, string keyColumn, string columns, string where) {
+	// in-memory or resident database can't be shared with worker
+	if(!db->isFileShared()) {
+		CCLOGERROR("CCDatabaseTableDataSource: in-memory or resident database can't be paged by worker");
+		return false;
+	}
+
+	m_table = table;
+	m_keyColumn = keyColumn;
+	m_columns = columns.empty() ? "*" : columns;
+	m_where = where;
+
+	// worker only reads
+#if SQLITE_VERSION_NUMBER >= 3005000
+	m_worker = CCDatabaseWorker::create(db->getDatabasePath(), SQLITE_OPEN_READONLY);
+#else
+	m_worker = CCDatabaseWorker::create(db->getDatabasePath());
+#endif
+	m_worker->retain();
+
+	// count rows
+	reload();
+
+	return true;
+}
+
+void CCDatabaseTableDataSource::setTableView(CCTableView* tableView) {
+	m_tableView = tableView;
+	if(m_tableView)
+		m_tableView->setDataSource(this);
+}
+
+void CCDatabaseTableDataSource::clearPages() {
+	for(PageMap::iterator iter = m_pages.begin(); iter != m_pages.end(); iter++) {
+		delete iter->second;
+	}
+	m_pages.clear();
+	m_loadingPages.clear();
+}
+
+void CCDatabaseTableDataSource::reload() {
+	// discard everything of old generation
+	m_generation++;
+	m_worker->cancelPendingJobs();
+	clearPages();
+	m_rowCount = -1;
+
+	// count in worker
+	string sql = "SELECT count() FROM " + m_table;
+	if(!m_where.empty())
+		sql += " WHERE " + m_where;
+	m_worker->post(new CountJob(this, m_generation, sql));
+}
+
+void CCDatabaseTableDataSource::onRowCountLoaded(int generation, int count) {
+	if(generation != m_generation)
+		return;
+
+	m_rowCount = count;
+
+	// load first pages before cells ask for them
+	ensureWindow(0);
+
+	// refresh table
+	if(m_tableView)
+		m_tableView->reloadData();
+}
+
+void CCDatabaseTableDataSource::onPageLoaded(int generation, int page, RowList* rows) {
+	if(generation != m_generation) {
+		delete rows;
+		return;
+	}
+
+	// save page
+	m_loadingPages.erase(page);
+	if(!rows)
+		return;
+	m_pages[page] = rows;
+
+	// refresh visible cells of this page, refreshing doesn't mean scrolling
+	if(m_tableView) {
+		m_updatingCells = true;
+		int start = page * m_pageSize;
+		int end = start + (int)rows->size();
+		for(int i = start; i < end; i++) {
+			if(m_tableView->cellAtIndex(i))
+				m_tableView->updateCellAtIndex(i);
+		}
+		m_updatingCells = false;
+	}
+}
+
+void CCDatabaseTableDataSource::requestPage(int page) {
+	// validate page
+	if(page < 0 || m_rowCount < 0 || page * m_pageSize >= m_rowCount)
+		return;
+	if(m_pages.find(page) != m_pages.end() || m_loadingPages.find(page) != m_loadingPages.end())
+		return;
+
+	// decide seek mode from neighbour pages
+	int mode = SEEK_OFFSET;
+	int64_t seekKey = 0;
+	PageMap::iterator prev = m_pages.find(page - 1);
+	PageMap::iterator next = m_pages.find(page + 1);
+	if(page == 0) {
+		mode = SEEK_FIRST;
+	} else if(prev != m_pages.end() && !prev->second->empty()) {
+		mode = SEEK_AFTER;
+		seekKey = prev->second->back().m_key;
+	} else if(next != m_pages.end() && !next->second->empty()) {
+		mode = SEEK_BEFORE;
+		seekKey = next->second->front().m_key;
+	}
+
+	// forward means the order rows are displayed
+	bool forward = mode != SEEK_BEFORE;
+	bool ascending = forward != m_descending;
+
+	// build sql
+	string sql = "SELECT " + m_keyColumn + ", " + m_columns + " FROM " + m_table;
+	string cond = m_where.empty() ? "" : "(" + m_where + ")";
+	if(mode == SEEK_AFTER || mode == SEEK_BEFORE) {
+		if(!cond.empty())
+			cond += " AND ";
+		cond += m_keyColumn + (ascending ? " > ?" : " < ?");
+	}
+	if(!cond.empty())
+		sql += " WHERE " + cond;
+	sql += " ORDER BY " + m_keyColumn + (ascending ? " ASC" : " DESC") + " LIMIT ?";
+	if(mode == SEEK_OFFSET)
+		sql += " OFFSET ?";
+
+	// post
+	m_loadingPages.insert(page);
+	m_worker->post(new PageJob(this, m_generation, page, sql, mode, seekKey, m_pageSize, page * m_pageSize));
+}
+
+void CCDatabaseTableDataSource::ensureWindow(int idx) {
+	// update direction
+	if(idx > m_lastIndex)
+		m_direction = 1;
+	else if(idx < m_lastIndex)
+		m_direction = -1;
+	m_lastIndex = idx;
+
+	// current page first, then pages ahead, then one page behind
+	int page = idx / m_pageSize;
+	requestPage(page);
+	for(int i = 1; i <= m_prefetchPages; i++)
+		requestPage(page + m_direction * i);
+	requestPage(page - m_direction);
+
+	// evict farthest pages
+	while((int)m_pages.size() > MAX(m_maxPages, m_prefetchPages + 2)) {
+		PageMap::iterator farthest = m_pages.begin();
+		PageMap::reverse_iterator last = m_pages.rbegin();
+		if(abs(last->first - page) > abs(farthest->first - page)) {
+			farthest = m_pages.find(last->first);
+		}
+		delete farthest->second;
+		m_pages.erase(farthest);
+	}
+}
+
+CCDatabaseTableDataSource::Row* CCDatabaseTableDataSource::rowAtIndex(unsigned int idx) {
+	PageMap::iterator iter = m_pages.find(idx / m_pageSize);
+	if(iter == m_pages.end())
+		return NULL;
+
+	unsigned int offset = idx % m_pageSize;
+	RowList* rows = iter->second;
+	if(offset >= rows->size())
+		return NULL;
+	return &rows->at(offset);
+}
+
+CCSize CCDatabaseTableDataSource::cellSizeForTable(CCTableView* table) {
+	if(m_delegate)
+		return m_delegate->cellSizeForTable(table);
+	return CCSizeZero;
+}
+
+CCTableViewCell* CCDatabaseTableDataSource::tableCellAtIndex(CCTableView* table, unsigned int idx) {
+	if(!m_updatingCells)
+		ensureWindow(idx);
+	if(m_delegate)
+		return m_delegate->tableCellForRow(this, table, idx, rowAtIndex(idx));
+	return NULL;
+}
+
+unsigned int CCDatabaseTableDataSource::numberOfCellsInTableView(CCTableView* table) {
+	return m_rowCount < 0 ? 0 : m_rowCount;
+}
+
+NS_CC_END
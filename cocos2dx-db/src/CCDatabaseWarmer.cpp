@@ -0,0 +1,321 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCDatabaseWarmer.h"
+#include "CCDatabase.h"
+#include "sqlite3.h"
+#include "CCUtils.h"
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+NS_CC_BEGIN
+
+/// b-tree page types
+#define PAGE_INDEX_INTERIOR 0x02
+#define PAGE_TABLE_INTERIOR 0x05
+#define PAGE_INDEX_LEAF 0x0a
+#define PAGE_TABLE_LEAF 0x0d
+
+/// buffer size of sequential reading
+#define SEQUENTIAL_BUFFER_SIZE (64 * 1024)
+
+class CCDatabaseWarmer::WarmJob : public CCDatabaseWorker::Job {
+private:
+	CCDatabaseWarmer* m_owner;
+	CCDatabaseWorker* m_worker;
+	string m_path;
+	StringList m_tables;
+	StringList m_indexTables;
+	StringList m_indexes;
+
+	/// result
+	int64_t m_bytes;
+	int m_pages;
+	float m_duration;
+
+private:
+	/// cancel stops worker, flag is read under worker lock
+	bool isCancelled() {
+		return m_worker->isStopped();
+	}
+
+	/// read whole file sequentially
+	void warmFile(int fd) {
+		char* buf = (char*)malloc(SEQUENTIAL_BUFFER_SIZE);
+		ssize_t len;
+		while(!isCancelled() && (len = read(fd, buf, SEQUENTIAL_BUFFER_SIZE)) > 0) {
+			m_bytes += len;
+		}
+		free(buf);
+	}
+
+	/// read pages of a b-tree, returns false if file looks corrupted
+	bool warmBTree(int fd, int rootPage, int pageSize, int pageCount, vector<bool>& visited) {
+		vector<int> stack;
+		stack.push_back(rootPage);
+		unsigned char* page = (unsigned char*)malloc(pageSize);
+		bool ok = true;
+		while(!stack.empty() && !isCancelled()) {
+			int pgno = stack.back();
+			stack.pop_back();
+
+			// validate
+			if(pgno < 1 || pgno > pageCount) {
+				ok = false;
+				break;
+			}
+			if(visited[pgno])
+				continue;
+			visited[pgno] = true;
+
+			// read page
+			if(pread(fd, page, pageSize, (off_t)(pgno - 1) * pageSize) != pageSize) {
+				ok = false;
+				break;
+			}
+			m_bytes += pageSize;
+			m_pages++;
+
+			// page 1 has database header before b-tree header
+			unsigned char* hdr = page + (pgno == 1 ? 100 : 0);
+			int type = hdr[0];
+			if(type == PAGE_TABLE_LEAF || type == PAGE_INDEX_LEAF)
+				continue;
+			if(type != PAGE_TABLE_INTERIOR && type != PAGE_INDEX_INTERIOR) {
+				ok = false;
+				break;
+			}
+
+			// children are left pointer of every cell and right most pointer
+			// cell pointer array must fit in page, or it is read past buffer
+			int cellCount = (hdr[3] << 8) | hdr[4];
+			if((hdr - page) + 12 + cellCount * 2 > pageSize) {
+				ok = false;
+				break;
+			}
+			stack.push_back((hdr[8] << 24) | (hdr[9] << 16) | (hdr[10] << 8) | hdr[11]);
+			unsigned char* cellPointers = hdr + 12;
+			for(int i = 0; i < cellCount; i++) {
+				int offset = (cellPointers[i * 2] << 8) | cellPointers[i * 2 + 1];
+				if(offset + 4 > pageSize) {
+					ok = false;
+					break;
+				}
+				unsigned char* cell = page + offset;
+				stack.push_back((cell[0] << 24) | (cell[1] << 16) | (cell[2] << 8) | cell[3]);
+			}
+		}
+		free(page);
+		return ok;
+	}
+
+	/// query root pages of named b-trees
+	void findRootPages(sqlite3* db, const char* sql, const StringList& names, vector<int>& rootPages) {
+		if(names.empty())
+			return;
+
+		sqlite3_stmt* pStmt = NULL;
+		if(sqlite3_prepare_v2(db, sql, -1, &pStmt, 0) != SQLITE_OK) {
+			CCLOGERROR("CCDatabaseWarmer: DB Error: \"%s\"", sqlite3_errmsg(db));
+		} else {
+			for(StringList::const_iterator iter = names.begin(); iter != names.end(); iter++) {
+				sqlite3_bind_text(pStmt, 1, iter->c_str(), -1, SQLITE_TRANSIENT);
+				while(sqlite3_step(pStmt) == SQLITE_ROW)
+					rootPages.push_back(sqlite3_column_int(pStmt, 0));
+				sqlite3_reset(pStmt);
+			}
+		}
+		sqlite3_finalize(pStmt);
+	}
+
+public:
+	WarmJob(CCDatabaseWarmer* owner, CCDatabaseWorker* worker, string path, const StringList& tables, const StringList& indexTables, const StringList& indexes) :
+			m_owner(owner),
+			m_worker(worker),
+			m_path(path),
+			m_tables(tables),
+			m_indexTables(indexTables),
+			m_indexes(indexes),
+			m_bytes(0),
+			m_pages(0),
+			m_duration(0) {
+	}
+
+	virtual void run(sqlite3* db) {
+		struct timeval start, end;
+		gettimeofday(&start, NULL);
+
+		// find root pages
+		vector<int> rootPages;
+		if(db) {
+			findRootPages(db, "SELECT rootpage FROM sqlite_master WHERE type = 'table' AND lower(name) = lower(?)", m_tables, rootPages);
+			findRootPages(db, "SELECT rootpage FROM sqlite_master WHERE type = 'index' AND lower(tbl_name) = lower(?)", m_indexTables, rootPages);
+			findRootPages(db, "SELECT rootpage FROM sqlite_master WHERE type = 'index' AND lower(name) = lower(?)", m_indexes, rootPages);
+		}
+
+		// open file
+		int fd = open(m_path.c_str(), O_RDONLY);
+		if(fd < 0) {
+			CCLOGERROR("CCDatabaseWarmer: failed to open %s", m_path.c_str());
+			return;
+		}
+
+		// page size is big endian at offset 16, 1 means 65536
+		int pageSize = 0;
+		unsigned char header[100];
+		if(pread(fd, header, sizeof(header), 0) == sizeof(header)) {
+			pageSize = (header[16] << 8) | header[17];
+			if(pageSize == 1)
+				pageSize = 65536;
+		}
+
+		// whole file or b-trees
+		if(m_tables.empty() && m_indexes.empty()) {
+			warmFile(fd);
+			if(pageSize > 0)
+				m_pages = (int)(m_bytes / pageSize);
+		} else if(pageSize >= 512) {
+			off_t fileSize = lseek(fd, 0, SEEK_END);
+			int pageCount = (int)(fileSize / pageSize);
+			vector<bool> visited(pageCount + 1, false);
+			for(vector<int>::iterator iter = rootPages.begin(); iter != rootPages.end() && !isCancelled(); iter++) {
+				if(!warmBTree(fd, *iter, pageSize, pageCount, visited)) {
+					CCLOGWARN("CCDatabaseWarmer: unexpected page in b-tree %d, skipped", *iter);
+				}
+			}
+		}
+		close(fd);
+
+		// duration
+		gettimeofday(&end, NULL);
+		m_duration = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0f;
+	}
+
+	virtual void done() {
+		m_owner->onWarmJobDone(m_bytes, m_pages, m_duration);
+	}
+};
+
+CCDatabaseWarmer::CCDatabaseWarmer() :
+		m_worker(NULL),
+		m_target(NULL),
+		m_selector(NULL),
+		m_running(false),
+		m_bytesWarmed(0),
+		m_pagesWarmed(0),
+		m_duration(0) {
+}
+
+CCDatabaseWarmer::~CCDatabaseWarmer() {
+	cancel();
+	CC_SAFE_RELEASE(m_worker);
+}
+
+CCDatabaseWarmer* CCDatabaseWarmer::create(CCDatabase* db) {
+	CCDatabaseWarmer* w = new CCDatabaseWarmer();
+	if(w->initWithDatabase(db)) {
+		return (CCDatabaseWarmer*)w->autorelease();
+	}
+	w->release();
+	return NULL;
+}
+
+bool CCDatabaseWarmer::initWithDatabase(CCDatabase* db) {
+	if(!db->isFileShared()) {
+		CCLOGERROR("CCDatabaseWarmer: in-memory or resident database doesn't need warming");
+		return false;
+	}
+
+	// raw file reading needs mapped path
+	m_databasePath = db->getDatabasePath();
+	m_path = CCUtils::mapLocalPath(m_databasePath);
+	return true;
+}
+
+void CCDatabaseWarmer::addTable(string tableName, bool withIndexes) {
+	m_tables.push_back(tableName);
+	if(withIndexes)
+		m_indexTables.push_back(tableName);
+}
+
+void CCDatabaseWarmer::addIndex(string indexName) {
+	m_indexes.push_back(indexName);
+}
+
+void CCDatabaseWarmer::start(CCObject* target, SEL_CallFuncO selector) {
+	if(m_running) {
+		CCLOGWARN("CCDatabaseWarmer::start: warming is in progress");
+		return;
+	}
+
+	// save callback
+	m_target = target;
+	m_selector = selector;
+	CC_SAFE_RETAIN(m_target);
+
+	// worker connection is only used to read sqlite_master
+	if(!m_worker) {
+#if SQLITE_VERSION_NUMBER >= 3005000
+		m_worker = CCDatabaseWorker::create(m_databasePath, SQLITE_OPEN_READONLY);
+#else
+		m_worker = CCDatabaseWorker::create(m_databasePath);
+#endif
+		m_worker->retain();
+	}
+
+	// post
+	m_running = true;
+	m_worker->post(new WarmJob(this, m_worker, m_path, m_tables, m_indexTables, m_indexes));
+}
+
+void CCDatabaseWarmer::cancel() {
+	if(!m_running)
+		return;
+
+	// job checks worker state between reads, so stopping is quick
+	m_worker->stop();
+	CC_SAFE_RELEASE_NULL(m_worker);
+	CC_SAFE_RELEASE_NULL(m_target);
+	m_selector = NULL;
+	m_running = false;
+}
+
+void CCDatabaseWarmer::onWarmJobDone(int64_t bytes, int pages, float duration) {
+	m_running = false;
+	m_bytesWarmed = bytes;
+	m_pagesWarmed = pages;
+	m_duration = duration;
+	CCLOGINFO("CCDatabaseWarmer: warmed %lld bytes in %f seconds", (long long)bytes, duration);
+
+	// callback
+	CCObject* target = m_target;
+	SEL_CallFuncO selector = m_selector;
+	m_target = NULL;
+	m_selector = NULL;
+	if(target && selector)
+		(target->*selector)(this);
+	CC_SAFE_RELEASE(target);
+}
+
+NS_CC_END
@@ -0,0 +1,250 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCDatabaseWorker.h"
+#include "sqlite3.h"
+#include "CCUtils.h"
+
+NS_CC_BEGIN
+
+CCDatabaseWorker::CCDatabaseWorker(string path, int flags) :
+		m_running(false),
+		m_started(false),
+		m_quit(false),
+		m_scheduled(false),
+		m_outstandingJobs(0),
+		m_flags(flags),
+		m_detached(false),
+		m_db(NULL) {
+	// map path in main thread
+	if(path.empty())
+		m_path = ":memory:";
+	else
+		m_path = CCUtils::mapLocalPath(path);
+
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+	pthread_cond_init(&m_idleCond, NULL);
+}
+
+CCDatabaseWorker::~CCDatabaseWorker() {
+	stop();
+	pthread_cond_destroy(&m_cond);
+	pthread_cond_destroy(&m_idleCond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+CCDatabaseWorker* CCDatabaseWorker::create(string path, int flags) {
+	CCDatabaseWorker* w = new CCDatabaseWorker(path, flags);
+	return (CCDatabaseWorker*)w->autorelease();
+}
+
+CCDatabaseWorker* CCDatabaseWorker::create() {
+	CCDatabaseWorker* w = new CCDatabaseWorker("", 0);
+	w->m_detached = true;
+	return (CCDatabaseWorker*)w->autorelease();
+}
+
+void* CCDatabaseWorker::threadEntry(void* arg) {
+	CCDatabaseWorker* w = (CCDatabaseWorker*)arg;
+	w->threadLoop();
+	return NULL;
+}
+
+void CCDatabaseWorker::threadLoop() {
+	// open worker connection, detached worker has no connection
+	if(!m_detached) {
+		int err = SQLITE_OK;
+#if SQLITE_VERSION_NUMBER >= 3005000
+		if(m_flags != 0)
+			err = sqlite3_open_v2(m_path.c_str(), &m_db, m_flags, NULL);
+		else
+#endif
+			err = sqlite3_open(m_path.c_str(), &m_db);
+		if(err != SQLITE_OK) {
+			CCLOGERROR("CCDatabaseWorker: error opening: %d", err);
+			sqlite3_close(m_db);
+			m_db = NULL;
+		} else {
+			// main connection may hold the lock for a while, wait instead of failing
+			sqlite3_busy_timeout(m_db, 2000);
+		}
+	}
+
+	// run jobs until quit
+	while(true) {
+		pthread_mutex_lock(&m_mutex);
+		while(!m_quit && m_pendingJobs.empty())
+			pthread_cond_wait(&m_cond, &m_mutex);
+		if(m_quit) {
+			pthread_mutex_unlock(&m_mutex);
+			break;
+		}
+		Job* job = m_pendingJobs.front();
+		m_pendingJobs.pop_front();
+		m_running = true;
+		pthread_mutex_unlock(&m_mutex);
+
+		// run
+		job->run(m_db);
+
+		// queue for delivering
+		pthread_mutex_lock(&m_mutex);
+		m_finishedJobs.push_back(job);
+		m_running = false;
+		if(m_pendingJobs.empty())
+			pthread_cond_broadcast(&m_idleCond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	// wake up waiters
+	pthread_mutex_lock(&m_mutex);
+	pthread_cond_broadcast(&m_idleCond);
+	pthread_mutex_unlock(&m_mutex);
+
+	// close connection
+	if(m_db) {
+		sqlite3_close(m_db);
+		m_db = NULL;
+	}
+}
+
+void CCDatabaseWorker::post(Job* job) {
+	// check state
+	if(m_quit) {
+		CCLOGWARN("CCDatabaseWorker::post: worker is stopped, job is discarded");
+		delete job;
+		return;
+	}
+
+	// start thread if not yet
+	if(!m_started) {
+		if(pthread_create(&m_thread, NULL, threadEntry, this) != 0) {
+			CCLOGERROR("CCDatabaseWorker::post: failed to create thread");
+			delete job;
+			return;
+		}
+		m_started = true;
+	}
+
+	// queue job
+	pthread_mutex_lock(&m_mutex);
+	m_pendingJobs.push_back(job);
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+
+	// schedule delivering
+	m_outstandingJobs++;
+	if(!m_scheduled) {
+		CCDirector::sharedDirector()->getScheduler()->scheduleSelector(schedule_selector(CCDatabaseWorker::dispatchFinishedJobs), this, 0, false);
+		m_scheduled = true;
+	}
+}
+
+void CCDatabaseWorker::cancelPendingJobs() {
+	pthread_mutex_lock(&m_mutex);
+	for(JobList::iterator iter = m_pendingJobs.begin(); iter != m_pendingJobs.end(); iter++) {
+		delete *iter;
+		m_outstandingJobs--;
+	}
+	m_pendingJobs.clear();
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void CCDatabaseWorker::waitUntilIdle() {
+	if(!m_started)
+		return;
+
+	pthread_mutex_lock(&m_mutex);
+	while(!m_quit && (m_running || !m_pendingJobs.empty()))
+		pthread_cond_wait(&m_idleCond, &m_mutex);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void CCDatabaseWorker::stop() {
+	// signal thread to quit
+	pthread_mutex_lock(&m_mutex);
+	m_quit = true;
+	for(JobList::iterator iter = m_pendingJobs.begin(); iter != m_pendingJobs.end(); iter++) {
+		delete *iter;
+	}
+	m_pendingJobs.clear();
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+
+	// wait thread
+	if(m_started) {
+		pthread_join(m_thread, NULL);
+		m_started = false;
+	}
+
+	// discard finished jobs
+	for(JobList::iterator iter = m_finishedJobs.begin(); iter != m_finishedJobs.end(); iter++) {
+		delete *iter;
+	}
+	m_finishedJobs.clear();
+	m_outstandingJobs = 0;
+
+	// unschedule
+	if(m_scheduled) {
+		m_scheduled = false;
+		CCDirector::sharedDirector()->getScheduler()->unscheduleSelector(schedule_selector(CCDatabaseWorker::dispatchFinishedJobs), this);
+	}
+}
+
+bool CCDatabaseWorker::isStopped() {
+	pthread_mutex_lock(&m_mutex);
+	bool quit = m_quit;
+	pthread_mutex_unlock(&m_mutex);
+	return quit;
+}
+
+void CCDatabaseWorker::dispatchFinishedJobs(float dt) {
+	// a job may release last reference of worker owner, keep self alive
+	retain();
+
+	// take finished jobs
+	JobList jobs;
+	pthread_mutex_lock(&m_mutex);
+	jobs.swap(m_finishedJobs);
+	pthread_mutex_unlock(&m_mutex);
+
+	// deliver, done may post new jobs
+	for(JobList::iterator iter = jobs.begin(); iter != jobs.end(); iter++) {
+		Job* job = *iter;
+		m_outstandingJobs--;
+		if(!m_quit)
+			job->done();
+		delete job;
+	}
+
+	// no more jobs, unschedule so that we don't tick and retain self forever
+	if(m_outstandingJobs <= 0 && m_scheduled) {
+		m_scheduled = false;
+		CCDirector::sharedDirector()->getScheduler()->unscheduleSelector(schedule_selector(CCDatabaseWorker::dispatchFinishedJobs), this);
+	}
+
+	release();
+}
+
+NS_CC_END
@@ -0,0 +1,311 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCEntityTable.h"
+#include "CCDatabase.h"
+#include "CCStatement.h"
+#include "CCResultSet.h"
+#include "CCSchemaCatalog.h"
+#include "CCUtils.h"
+#include "sqlite3.h"
+#include <algorithm>
+
+NS_CC_BEGIN
+
+CCEntityTableBase::CCEntityTableBase() :
+		m_current(NULL),
+		m_cachesEntities(false),
+		m_keyIndex(-1),
+		m_db(NULL) {
+}
+
+CCEntityTableBase::~CCEntityTableBase() {
+	finishStatement();
+	setCachesEntities(false);
+	CC_SAFE_RELEASE(m_db);
+}
+
+bool CCEntityTableBase::initWithSchema(CCDatabase* db, const char* table, const CCEntityColumnCollector& c) {
+	if(c.count <= 0 || c.count > CC_DB_MAX_FIELDS) {
+		CCLOGERROR("CCEntityTable: table %s has %d columns", table, c.count);
+		return false;
+	}
+
+	m_db = db;
+	CC_SAFE_RETAIN(m_db);
+	m_table = table;
+	for(int i = 0; i < c.count; i++) {
+		// view points into statement which is reset after loading, so it can't be kept by entity
+		if(c.views[i]) {
+			CCLOGERROR("CCEntityTable: column %s of table %s is a CCDataView, use string for blob column", c.names[i], table);
+			return false;
+		}
+		m_columns.push_back(c.names[i]);
+		m_kinds.push_back(c.kinds[i]);
+		if(c.keys[i]) {
+			if(m_keyIndex >= 0) {
+				CCLOGERROR("CCEntityTable: table %s has more than one key", table);
+				return false;
+			}
+			m_keyIndex = i;
+		}
+	}
+
+	// column lists
+	string quoted = CCDatabase::quoteIdentifier(m_table);
+	string all, params, assigns;
+	for(int i = 0; i < m_columns.size(); i++) {
+		if(i > 0) {
+			all += ", ";
+			params += ", ";
+		}
+		all += CCDatabase::quoteIdentifier(m_columns[i]);
+		params += "?";
+		if(i != m_keyIndex) {
+			if(!assigns.empty())
+				assigns += ", ";
+			assigns += CCDatabase::quoteIdentifier(m_columns[i]) + " = ?";
+		}
+	}
+
+	// generate statements, statements need key are left empty if no key
+	m_sql[kCCEntityInsert] = "INSERT INTO " + quoted + " (" + all + ") VALUES (" + params + ")";
+	m_sql[kCCEntityReplace] = "INSERT OR REPLACE INTO " + quoted + " (" + all + ") VALUES (" + params + ")";
+	m_sql[kCCEntitySelectAll] = "SELECT " + all + " FROM " + quoted;
+	if(m_keyIndex >= 0) {
+		string where = " WHERE " + CCDatabase::quoteIdentifier(m_columns[m_keyIndex]) + " = ?";
+		if(!assigns.empty())
+			m_sql[kCCEntityUpdate] = "UPDATE " + quoted + " SET " + assigns + where;
+		m_sql[kCCEntityDelete] = "DELETE FROM " + quoted + where;
+		m_sql[kCCEntitySelectByKey] = m_sql[kCCEntitySelectAll] + where;
+	}
+
+	return true;
+}
+
+bool CCEntityTableBase::createTable() {
+	string sql = "CREATE TABLE IF NOT EXISTS " + CCDatabase::quoteIdentifier(m_table) + " (";
+	for(int i = 0; i < m_columns.size(); i++) {
+		if(i > 0)
+			sql += ", ";
+		sql += CCDatabase::quoteIdentifier(m_columns[i]);
+		switch(m_kinds[i]) {
+			case kCCFieldInteger:
+				sql += " INTEGER";
+				break;
+			case kCCFieldFloat:
+				sql += " REAL";
+				break;
+			case kCCFieldText:
+				sql += " TEXT";
+				break;
+			default:
+				sql += " BLOB";
+				break;
+		}
+		if(i == m_keyIndex)
+			sql += " PRIMARY KEY";
+	}
+	sql += ")";
+
+	// sql may be longer than format buffer of executeUpdate, and names may contain %
+	return m_db->_executeUpdate(sql.c_str());
+}
+
+bool CCEntityTableBase::isKeyRowId() {
+	if(getKeyKind() != kCCFieldInteger)
+		return false;
+	const CCSchemaCatalog::Table* t = m_db->getSchemaCatalog()->findTable(m_table);
+	if(!t)
+		return true;
+
+	// INT or composite primary key is an ordinary column, not rowid
+	const CCSchemaCatalog::Column* key = t->findColumn(m_columns[m_keyIndex]);
+	int pkCount = 0;
+	for(vector<CCSchemaCatalog::Column>::const_iterator iter = t->columns.begin(); iter != t->columns.end(); iter++) {
+		if(iter->primaryKey)
+			pkCount++;
+	}
+	if(!key || !key->primaryKey || pkCount != 1)
+		return false;
+	string type = key->type;
+	CCUtils::toLowercase(type);
+	return type == "integer";
+}
+
+int CCEntityTableBase::getChangedRowCount() {
+	return sqlite3_changes(m_db->sqliteHandle());
+}
+
+bool CCEntityTableBase::beginStatement(int which) {
+	// previous statement is not finished, possible if a select is abandoned
+	finishStatement();
+
+	if(m_sql[which].empty()) {
+		CCLOGERROR("CCEntityTable: table %s has no key or no value columns for this operation", m_table.c_str());
+		return false;
+	}
+	if(!m_db->databaseOpened())
+		return false;
+	if(m_db->m_inUse) {
+		m_db->warnInUse();
+		return false;
+	}
+
+	m_current = m_db->prepareStatement(m_sql[which].c_str());
+	return m_current != NULL;
+}
+
+bool CCEntityTableBase::execute() {
+	if(!m_current)
+		return false;
+	int rc = m_db->stepStatement(m_current->getStatement());
+	finishStatement();
+	return rc == SQLITE_DONE || rc == SQLITE_ROW;
+}
+
+bool CCEntityTableBase::step() {
+	if(!m_current)
+		return false;
+	return m_db->stepStatement(m_current->getStatement()) == SQLITE_ROW;
+}
+
+void CCEntityTableBase::finishStatement() {
+	if(m_current) {
+		CCStatement* statement = m_current;
+		m_current = NULL;
+		statement->reset();
+		m_db->releaseStatement(statement->getQuery());
+	}
+}
+
+void CCEntityTableBase::setCachesEntities(bool value) {
+	if(!m_db || m_cachesEntities == value)
+		return;
+	m_cachesEntities = value;
+	if(value)
+		m_db->m_entityCaches.push_back(this);
+	else
+		m_db->m_entityCaches.erase(find(m_db->m_entityCaches.begin(), m_db->m_entityCaches.end(), this));
+	m_db->installHooks();
+}
+
+void CCEntityTableBase::bindValue(int idx, const bool& value) {
+	sqlite3_bind_int(m_current->getStatement(), idx, value ? 1 : 0);
+}
+
+void CCEntityTableBase::bindValue(int idx, const int& value) {
+	sqlite3_bind_int(m_current->getStatement(), idx, value);
+}
+
+void CCEntityTableBase::bindValue(int idx, const long& value) {
+	sqlite3_bind_int64(m_current->getStatement(), idx, value);
+}
+
+void CCEntityTableBase::bindValue(int idx, const long long& value) {
+	sqlite3_bind_int64(m_current->getStatement(), idx, value);
+}
+
+void CCEntityTableBase::bindValue(int idx, const float& value) {
+	sqlite3_bind_double(m_current->getStatement(), idx, value);
+}
+
+void CCEntityTableBase::bindValue(int idx, const double& value) {
+	sqlite3_bind_double(m_current->getStatement(), idx, value);
+}
+
+void CCEntityTableBase::bindValue(int idx, const string& value) {
+	// statement is stepped before value goes away, no need to copy
+	sqlite3_bind_text(m_current->getStatement(), idx, value.c_str(), (int)value.length(), SQLITE_STATIC);
+}
+
+void CCEntityTableBase::bindValue(int idx, const CCDataView& value) {
+	if(value.isNull())
+		sqlite3_bind_null(m_current->getStatement(), idx);
+	else
+		sqlite3_bind_blob(m_current->getStatement(), idx, value.bytes, (int)value.length, SQLITE_STATIC);
+}
+
+void CCEntityTableBase::bindValue(int idx, const CCEntityBlob& value) {
+	// zero length blob is not null
+	sqlite3_bind_blob(m_current->getStatement(), idx, value.value.data(), (int)value.value.length(), SQLITE_STATIC);
+}
+
+void CCEntityTableBase::bindNull(int idx) {
+	sqlite3_bind_null(m_current->getStatement(), idx);
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, bool& out) {
+	out = sqlite3_column_int(m_current->getStatement(), columnIdx) != 0;
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, int& out) {
+	out = sqlite3_column_int(m_current->getStatement(), columnIdx);
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, long& out) {
+	out = (long)sqlite3_column_int64(m_current->getStatement(), columnIdx);
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, long long& out) {
+	out = sqlite3_column_int64(m_current->getStatement(), columnIdx);
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, float& out) {
+	out = (float)sqlite3_column_double(m_current->getStatement(), columnIdx);
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, double& out) {
+	out = sqlite3_column_double(m_current->getStatement(), columnIdx);
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, string& out) {
+	sqlite3_stmt* stmt = m_current->getStatement();
+	const char* p = (const char*)sqlite3_column_text(stmt, columnIdx);
+	if(p)
+		out.assign(p, sqlite3_column_bytes(stmt, columnIdx));
+	else
+		out.clear();
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, CCEntityBlob& out) {
+	sqlite3_stmt* stmt = m_current->getStatement();
+	const char* p = (const char*)sqlite3_column_blob(stmt, columnIdx);
+	if(p)
+		out.value.assign(p, sqlite3_column_bytes(stmt, columnIdx));
+	else
+		out.value.clear();
+}
+
+void CCEntityTableBase::readColumn(int columnIdx, CCDataView& out) {
+	// never used by entities since view fields are rejected, it only lets visitor compile
+	sqlite3_stmt* stmt = m_current->getStatement();
+	if(sqlite3_column_type(stmt, columnIdx) == SQLITE_NULL) {
+		out = CCDataView();
+	} else {
+		const char* p = (const char*)sqlite3_column_blob(stmt, columnIdx);
+		out = CCDataView(p, sqlite3_column_bytes(stmt, columnIdx));
+	}
+}
+
+NS_CC_END
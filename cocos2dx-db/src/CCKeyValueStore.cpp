@@ -0,0 +1,472 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCKeyValueStore.h"
+#include "CCDatabase.h"
+#include "CCStringPool.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+///////////////////////////////////////////////////
+// flush job
+
+class CCKeyValueStore::FlushJob : public CCDatabaseWorker::Job {
+public:
+	/// a dirty value, type none means removed
+	struct Row {
+		string ns;
+		string key;
+		Value value;
+	};
+	vector<Row> m_rows;
+
+	/// false if connection is already in a transaction
+	bool m_ownTransaction;
+
+	/// true if all rows are written
+	bool m_ok;
+
+	/// store which marks rows dirty again if writing failed
+	CCKeyValueStore* m_store;
+
+private:
+	string m_replaceSQL;
+	string m_deleteSQL;
+
+private:
+	/// bind value of a row and step statement
+	static bool writeRow(sqlite3* db, sqlite3_stmt* replace, sqlite3_stmt* del, const Row& r) {
+		sqlite3_stmt* stmt = r.value.type == kTypeNone ? del : replace;
+		sqlite3_bind_text(stmt, 1, r.ns.c_str(), -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 2, r.key.c_str(), -1, SQLITE_STATIC);
+		if(stmt == replace) {
+			sqlite3_bind_int(stmt, 3, r.value.type);
+			switch(r.value.type) {
+				case kTypeInteger:
+				case kTypeBool:
+					sqlite3_bind_int64(stmt, 4, r.value.i);
+					break;
+				case kTypeDouble:
+					sqlite3_bind_double(stmt, 4, r.value.d);
+					break;
+				default:
+					sqlite3_bind_text(stmt, 4, r.value.s.data(), (int)r.value.s.length(), SQLITE_STATIC);
+					break;
+			}
+		}
+		bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+		if(!ok)
+			CCLOGERROR("CCKeyValueStore: failed to write %s.%s: \"%s\"", r.ns.c_str(), r.key.c_str(), sqlite3_errmsg(db));
+		sqlite3_reset(stmt);
+		return ok;
+	}
+
+public:
+	FlushJob(CCKeyValueStore* store, const string& table) :
+			m_ownTransaction(true),
+			m_ok(false),
+			m_store(store),
+			m_replaceSQL("INSERT OR REPLACE INTO " + CCDatabase::quoteIdentifier(table) + " (ns, key, type, value) VALUES (?, ?, ?, ?)"),
+			m_deleteSQL("DELETE FROM " + CCDatabase::quoteIdentifier(table) + " WHERE ns = ? AND key = ?") {
+	}
+
+	virtual void run(sqlite3* db) {
+		if(!db)
+			return;
+
+		// all rows in one transaction
+		sqlite3_stmt* replace = NULL;
+		sqlite3_stmt* del = NULL;
+		if(sqlite3_prepare_v2(db, m_replaceSQL.c_str(), -1, &replace, 0) != SQLITE_OK ||
+		   sqlite3_prepare_v2(db, m_deleteSQL.c_str(), -1, &del, 0) != SQLITE_OK) {
+			CCLOGERROR("CCKeyValueStore: DB Error: \"%s\"", sqlite3_errmsg(db));
+			sqlite3_finalize(replace);
+			sqlite3_finalize(del);
+			return;
+		}
+		bool ok = !m_ownTransaction || sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL) == SQLITE_OK;
+		for(vector<Row>::iterator iter = m_rows.begin(); ok && iter != m_rows.end(); iter++)
+			ok = writeRow(db, replace, del, *iter);
+		sqlite3_finalize(replace);
+		sqlite3_finalize(del);
+		if(!m_ownTransaction) {
+			if(!ok)
+				CCLOGERROR("CCKeyValueStore: failed to flush %d values", (int)m_rows.size());
+		} else if(!ok || sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
+			CCLOGERROR("CCKeyValueStore: failed to flush %d values: \"%s\"", (int)m_rows.size(), sqlite3_errmsg(db));
+			sqlite3_exec(db, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+			ok = false;
+		}
+		m_ok = ok;
+	}
+
+	virtual void done() {
+		// not delivered after worker is stopped, so store is alive
+		if(m_ok)
+			m_store->m_db->invalidateTable(m_store->m_table);
+		else
+			m_store->markDirty(this);
+	}
+};
+
+///////////////////////////////////////////////////
+// store
+
+CCKeyValueStore::Namespace::Namespace() :
+		keys(CCStringPool::create()) {
+	keys->retain();
+}
+
+CCKeyValueStore::Namespace::~Namespace() {
+	keys->release();
+}
+
+CCKeyValueStore::CCKeyValueStore() :
+		m_db(NULL),
+		m_worker(NULL),
+		m_autoFlushDelay(1),
+		m_flushScheduled(false),
+		m_dirtyCount(0),
+		m_destroying(false) {
+}
+
+CCKeyValueStore::~CCKeyValueStore() {
+	// scheduler retains store, so auto flush is not scheduled now
+	m_destroying = true;
+	flush();
+	if(m_dirtyCount > 0)
+		CCLOGERROR("CCKeyValueStore: %d values are not saved before store is destroyed", m_dirtyCount);
+	if(m_worker) {
+		m_worker->waitUntilIdle();
+		m_worker->stop();
+		m_worker->release();
+	}
+	for(NamespaceMap::iterator iter = m_namespaces.begin(); iter != m_namespaces.end(); iter++) {
+		delete iter->second;
+	}
+	CC_SAFE_RELEASE(m_db);
+}
+
+CCKeyValueStore* CCKeyValueStore::create(CCDatabase* db, const string& table) {
+	CCKeyValueStore* s = new CCKeyValueStore();
+	if(s->initWithDatabase(db, table)) {
+		return (CCKeyValueStore*)s->autorelease();
+	}
+	s->release();
+	return NULL;
+}
+
+bool CCKeyValueStore::initWithDatabase(CCDatabase* db, const string& table) {
+	if(!db)
+		return false;
+
+	// create table
+	if(!db->executeUpdate("CREATE TABLE IF NOT EXISTS %s (ns TEXT, key TEXT, type INTEGER, value, PRIMARY KEY(ns, key))",
+			CCDatabase::quoteIdentifier(table).c_str())) {
+		CCLOGERROR("CCKeyValueStore: failed to create table %s", table.c_str());
+		return false;
+	}
+
+	m_db = db;
+	CC_SAFE_RETAIN(m_db);
+	m_table = table;
+
+	// in-memory or resident database can't be shared with worker, it is written on main thread
+	if(db->isFileShared()) {
+		m_worker = CCDatabaseWorker::create(db->getDatabasePath());
+		m_worker->retain();
+	}
+
+	return true;
+}
+
+CCKeyValueStore::Namespace* CCKeyValueStore::getNamespace(const string& ns) {
+	NamespaceMap::iterator iter = m_namespaces.find(ns);
+	if(iter != m_namespaces.end())
+		return iter->second;
+
+	Namespace* n = new Namespace();
+	m_namespaces[ns] = n;
+	load(ns, n);
+	return n;
+}
+
+void CCKeyValueStore::load(const string& ns, Namespace* n) {
+	if(!m_db->databaseOpened())
+		return;
+
+	string sql = "SELECT key, type, value FROM " + CCDatabase::quoteIdentifier(m_table) + " WHERE ns = ?";
+	sqlite3_stmt* stmt = NULL;
+	if(sqlite3_prepare_v2(m_db->sqliteHandle(), sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+		CCLOGERROR("CCKeyValueStore: DB Error: %d \"%s\"", m_db->lastErrorCode(), m_db->lastErrorMessage().c_str());
+		sqlite3_finalize(stmt);
+		return;
+	}
+	sqlite3_bind_text(stmt, 1, ns.c_str(), -1, SQLITE_STATIC);
+	while(m_db->stepStatement(stmt) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(stmt, 0);
+		n->keys->intern(key ? key : "");
+		n->values.push_back(Value());
+		Value& v = n->values.back();
+		v.type = sqlite3_column_int(stmt, 1);
+		switch(v.type) {
+			case kTypeInteger:
+			case kTypeBool:
+				v.i = sqlite3_column_int64(stmt, 2);
+				break;
+			case kTypeDouble:
+				v.d = sqlite3_column_double(stmt, 2);
+				break;
+			case kTypeString:
+			{
+				const char* text = (const char*)sqlite3_column_text(stmt, 2);
+				v.s.assign(text ? text : "", sqlite3_column_bytes(stmt, 2));
+				break;
+			}
+			default:
+				v.type = kTypeNone;
+				break;
+		}
+	}
+	sqlite3_finalize(stmt);
+}
+
+const CCKeyValueStore::Value* CCKeyValueStore::find(const string& ns, const string& key) {
+	Namespace* n = getNamespace(ns);
+	int index = n->keys->codeForString(key);
+	if(index < 0 || n->values[index].type == kTypeNone)
+		return NULL;
+	return &n->values[index];
+}
+
+CCKeyValueStore::Value* CCKeyValueStore::edit(const string& ns, const string& key) {
+	Namespace* n = getNamespace(ns);
+	int index = n->keys->intern(key);
+	if(index >= (int)n->values.size())
+		n->values.push_back(Value());
+	markDirty(n, index);
+	return &n->values[index];
+}
+
+void CCKeyValueStore::markDirty(Namespace* n, int index) {
+	Value& v = n->values[index];
+	if(!v.dirty) {
+		v.dirty = true;
+		n->dirty.push_back(index);
+		m_dirtyCount++;
+	}
+
+	// auto flush after delay from first change
+	if(!m_flushScheduled && !m_destroying && m_autoFlushDelay > 0) {
+		CCDirector::sharedDirector()->getScheduler()->scheduleSelector(schedule_selector(CCKeyValueStore::onAutoFlush), this, m_autoFlushDelay, false);
+		m_flushScheduled = true;
+	}
+}
+
+void CCKeyValueStore::markDirty(FlushJob* job) {
+	// value changed after flush is already dirty and holds newer value
+	for(vector<FlushJob::Row>::const_iterator iter = job->m_rows.begin(); iter != job->m_rows.end(); iter++) {
+		Namespace* n = getNamespace(iter->ns);
+		int index = n->keys->codeForString(iter->key);
+		if(index >= 0)
+			markDirty(n, index);
+	}
+}
+
+int64_t CCKeyValueStore::getInt64(const string& ns, const string& key, int64_t def) {
+	const Value* v = find(ns, key);
+	if(!v)
+		return def;
+	switch(v->type) {
+		case kTypeInteger:
+		case kTypeBool:
+			return v->i;
+		case kTypeDouble:
+			return (int64_t)v->d;
+		default:
+			return strtoll(v->s.c_str(), NULL, 10);
+	}
+}
+
+double CCKeyValueStore::getDouble(const string& ns, const string& key, double def) {
+	const Value* v = find(ns, key);
+	if(!v)
+		return def;
+	switch(v->type) {
+		case kTypeInteger:
+		case kTypeBool:
+			return (double)v->i;
+		case kTypeDouble:
+			return v->d;
+		default:
+			return atof(v->s.c_str());
+	}
+}
+
+bool CCKeyValueStore::getBool(const string& ns, const string& key, bool def) {
+	const Value* v = find(ns, key);
+	if(!v)
+		return def;
+	if(v->type == kTypeString)
+		return v->s == "true" || atoi(v->s.c_str()) != 0;
+	return v->type == kTypeDouble ? v->d != 0 : v->i != 0;
+}
+
+string CCKeyValueStore::getString(const string& ns, const string& key, const string& def) {
+	const Value* v = find(ns, key);
+	if(!v)
+		return def;
+	char buf[32];
+	switch(v->type) {
+		case kTypeInteger:
+			sprintf(buf, "%lld", (long long)v->i);
+			return buf;
+		case kTypeBool:
+			return v->i ? "true" : "false";
+		case kTypeDouble:
+			sprintf(buf, "%.17g", v->d);
+			return buf;
+		default:
+			return v->s;
+	}
+}
+
+void CCKeyValueStore::setInt64(const string& ns, const string& key, int64_t value) {
+	Value* v = edit(ns, key);
+	v->type = kTypeInteger;
+	v->i = value;
+	v->s.clear();
+}
+
+void CCKeyValueStore::setDouble(const string& ns, const string& key, double value) {
+	Value* v = edit(ns, key);
+	v->type = kTypeDouble;
+	v->d = value;
+	v->s.clear();
+}
+
+void CCKeyValueStore::setBool(const string& ns, const string& key, bool value) {
+	Value* v = edit(ns, key);
+	v->type = kTypeBool;
+	v->i = value ? 1 : 0;
+	v->s.clear();
+}
+
+void CCKeyValueStore::setString(const string& ns, const string& key, const string& value) {
+	Value* v = edit(ns, key);
+	v->type = kTypeString;
+	v->s = value;
+}
+
+int CCKeyValueStore::getType(const string& ns, const string& key) {
+	const Value* v = find(ns, key);
+	return v ? v->type : kTypeNone;
+}
+
+void CCKeyValueStore::remove(const string& ns, const string& key) {
+	// removed value is a dirty none, key stays in pool
+	if(find(ns, key)) {
+		Value* v = edit(ns, key);
+		v->type = kTypeNone;
+		v->s.clear();
+	}
+}
+
+void CCKeyValueStore::getKeys(const string& ns, vector<string>& out) {
+	Namespace* n = getNamespace(ns);
+	for(int i = 0; i < (int)n->values.size(); i++) {
+		if(n->values[i].type != kTypeNone)
+			out.push_back(n->keys->stringForCode(i));
+	}
+}
+
+void CCKeyValueStore::onAutoFlush(float dt) {
+	// scheduler may hold last reference, which is dropped by unscheduling in flush
+	retain();
+	flush();
+	release();
+}
+
+void CCKeyValueStore::flush() {
+	if(m_flushScheduled) {
+		CCDirector::sharedDirector()->getScheduler()->unscheduleSelector(schedule_selector(CCKeyValueStore::onAutoFlush), this);
+		m_flushScheduled = false;
+	}
+	if(m_dirtyCount == 0)
+		return;
+
+	// copy dirty values so memory can change while worker writes
+	FlushJob* job = new FlushJob(this, m_table);
+	for(NamespaceMap::iterator iter = m_namespaces.begin(); iter != m_namespaces.end(); iter++) {
+		Namespace* n = iter->second;
+		for(vector<int>::iterator d = n->dirty.begin(); d != n->dirty.end(); d++) {
+			Value& v = n->values[*d];
+			v.dirty = false;
+			job->m_rows.push_back(FlushJob::Row());
+			FlushJob::Row& r = job->m_rows.back();
+			r.ns = iter->first;
+			r.key = n->keys->stringForCode(*d);
+			r.value = v;
+		}
+		n->dirty.clear();
+	}
+	m_dirtyCount = 0;
+
+	if(m_worker)
+		m_worker->post(job);
+	else
+		writeNow(job);
+}
+
+bool CCKeyValueStore::writeNow(FlushJob* job) {
+	// same job on main connection, it joins transaction of database if there is one
+	bool ok = m_db->databaseOpened();
+	if(ok) {
+		job->m_ownTransaction = !m_db->isInTransaction();
+		job->run(m_db->sqliteHandle());
+		ok = job->m_ok;
+	}
+	if(!ok)
+		markDirty(job);
+	delete job;
+	return ok;
+}
+
+void CCKeyValueStore::waitUntilSaved() {
+	if(m_worker)
+		m_worker->waitUntilIdle();
+}
+
+void CCKeyValueStore::setAutoFlushDelay(float delay) {
+	m_autoFlushDelay = delay;
+
+	// scheduling again only updates interval, disabling flushes pending values now
+	if(m_flushScheduled && m_autoFlushDelay > 0) {
+		CCDirector::sharedDirector()->getScheduler()->scheduleSelector(schedule_selector(CCKeyValueStore::onAutoFlush), this, m_autoFlushDelay, false);
+	} else if(m_flushScheduled) {
+		flush();
+	}
+}
+
+NS_CC_END
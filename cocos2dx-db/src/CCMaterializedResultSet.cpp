@@ -0,0 +1,364 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCMaterializedResultSet.h"
+#include "sqlite3.h"
+#include "CCUtils.h"
+#include "CCStringPool.h"
+
+NS_CC_BEGIN
+
+/// cell type of interned text, not used by sqlite
+#define CELL_INTERNED 0x10
+
+CCMaterializedResultSet::Data::Data() :
+		m_columnCount(0),
+		m_rowCount(0),
+		m_pool(NULL) {
+}
+
+CCMaterializedResultSet::Data::~Data() {
+	CC_SAFE_RELEASE(m_pool);
+}
+
+CCMaterializedResultSet::CCMaterializedResultSet() :
+		m_data(new Data()),
+		m_cursor(-1) {
+}
+
+CCMaterializedResultSet::~CCMaterializedResultSet() {
+	m_data->release();
+}
+
+CCMaterializedResultSet* CCMaterializedResultSet::copy() {
+	CCMaterializedResultSet* mrs = new CCMaterializedResultSet();
+	mrs->m_data->release();
+	mrs->m_data = m_data;
+	m_data->retain();
+	return (CCMaterializedResultSet*)mrs->autorelease();
+}
+
+void CCMaterializedResultSet::initWithStatement(sqlite3_stmt* stmt, CCStringPool* pool) {
+	m_data->m_pool = pool;
+	CC_SAFE_RETAIN(m_data->m_pool);
+	m_data->m_columnCount = sqlite3_column_count(stmt);
+	for(int i = 0; i < m_data->m_columnCount; i++) {
+		string name = sqlite3_column_name(stmt, i);
+		CCUtils::toLowercase(name);
+		m_data->m_columnNames.push_back(name);
+	}
+}
+
+void CCMaterializedResultSet::appendRow(sqlite3_stmt* stmt) {
+	for(int i = 0; i < m_data->m_columnCount; i++) {
+		Cell c;
+		c.type = sqlite3_column_type(stmt, i);
+		switch(c.type) {
+			case SQLITE_INTEGER:
+				c.v.i = sqlite3_column_int64(stmt, i);
+				break;
+			case SQLITE_FLOAT:
+				c.v.d = sqlite3_column_double(stmt, i);
+				break;
+			case SQLITE_TEXT:
+			case SQLITE_BLOB:
+			{
+				// get pointer before bytes, as sqlite requires
+				const char* p = c.type == SQLITE_TEXT ? (const char*)sqlite3_column_text(stmt, i) : (const char*)sqlite3_column_blob(stmt, i);
+				int len = sqlite3_column_bytes(stmt, i);
+
+				// interned text keeps only the code
+				if(c.type == SQLITE_TEXT && m_data->m_pool) {
+					c.type = CELL_INTERNED;
+					c.v.i = m_data->m_pool->intern(p ? p : "", p ? len : 0);
+					break;
+				}
+
+				c.v.bytes.offset = (uint32_t)m_data->m_arena.size();
+				c.v.bytes.length = len;
+				if(p && len > 0)
+					m_data->m_arena.insert(m_data->m_arena.end(), p, p + len);
+
+				// text is terminated so it can be returned as c string
+				if(c.type == SQLITE_TEXT)
+					m_data->m_arena.push_back(0);
+				break;
+			}
+			default:
+				c.v.i = 0;
+				break;
+		}
+		m_data->m_cells.push_back(c);
+	}
+	m_data->m_rowCount++;
+}
+
+const CCMaterializedResultSet::Cell* CCMaterializedResultSet::cellAt(int columnIdx) {
+	if(m_cursor < 0 || m_cursor >= m_data->m_rowCount || columnIdx < 0 || columnIdx >= m_data->m_columnCount)
+		return NULL;
+	return &m_data->m_cells[m_cursor * m_data->m_columnCount + columnIdx];
+}
+
+const char* CCMaterializedResultSet::bytesOf(const Cell* c, uint32_t* outLen) {
+	switch(c->type) {
+		case SQLITE_TEXT:
+		case SQLITE_BLOB:
+			*outLen = c->v.bytes.length;
+			return m_data->m_arena.empty() ? "" : &m_data->m_arena[0] + c->v.bytes.offset;
+		case CELL_INTERNED:
+		{
+			const string& s = m_data->m_pool->stringForCode((int)c->v.i);
+			*outLen = (uint32_t)s.length();
+			return s.c_str();
+		}
+		default:
+			*outLen = 0;
+			return NULL;
+	}
+}
+
+bool CCMaterializedResultSet::next() {
+	if(m_cursor < m_data->m_rowCount)
+		m_cursor++;
+	return m_cursor < m_data->m_rowCount;
+}
+
+bool CCMaterializedResultSet::previous() {
+	if(m_cursor <= 0) {
+		m_cursor = -1;
+		return false;
+	}
+	m_cursor--;
+	return true;
+}
+
+bool CCMaterializedResultSet::moveTo(int row) {
+	if(row < 0 || row >= m_data->m_rowCount)
+		return false;
+	m_cursor = row;
+	return true;
+}
+
+int CCMaterializedResultSet::columnIndexForName(string columnName) {
+	int index = 0;
+	for(StringList::iterator iter = m_data->m_columnNames.begin(); iter != m_data->m_columnNames.end(); iter++, index++) {
+		if(*iter == columnName) {
+			return index;
+		}
+	}
+
+	CCLOGWARN("Can't find column index for name: %s", columnName.c_str());
+	return -1;
+}
+
+string CCMaterializedResultSet::columnNameForIndex(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_data->m_columnNames.size())
+		return "";
+	else
+		return m_data->m_columnNames.at(columnIdx);
+}
+
+bool CCMaterializedResultSet::columnIndexIsNull(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	return !c || c->type == SQLITE_NULL;
+}
+
+bool CCMaterializedResultSet::columnIsNull(string columnName) {
+	return columnIndexIsNull(columnIndexForName(columnName));
+}
+
+int CCMaterializedResultSet::intForColumn(string columnName) {
+	return intForColumnIndex(columnIndexForName(columnName));
+}
+
+int CCMaterializedResultSet::intForColumnIndex(int columnIdx) {
+	return (int)int64ForColumnIndex(columnIdx);
+}
+
+long CCMaterializedResultSet::longForColumn(string columnName) {
+	return longForColumnIndex(columnIndexForName(columnName));
+}
+
+long CCMaterializedResultSet::longForColumnIndex(int columnIdx) {
+	return (long)int64ForColumnIndex(columnIdx);
+}
+
+int64_t CCMaterializedResultSet::int64ForColumn(string columnName) {
+	return int64ForColumnIndex(columnIndexForName(columnName));
+}
+
+int64_t CCMaterializedResultSet::int64ForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(!c)
+		return 0;
+	switch(c->type) {
+		case SQLITE_INTEGER:
+			return c->v.i;
+		case SQLITE_FLOAT:
+			return (int64_t)c->v.d;
+		case SQLITE_TEXT:
+		case CELL_INTERNED:
+		{
+			uint32_t len;
+			return strtoll(bytesOf(c, &len), NULL, 10);
+		}
+		default:
+			return 0;
+	}
+}
+
+bool CCMaterializedResultSet::boolForColumn(string columnName) {
+	return boolForColumnIndex(columnIndexForName(columnName));
+}
+
+bool CCMaterializedResultSet::boolForColumnIndex(int columnIdx) {
+	return int64ForColumnIndex(columnIdx) != 0;
+}
+
+double CCMaterializedResultSet::doubleForColumn(string columnName) {
+	return doubleForColumnIndex(columnIndexForName(columnName));
+}
+
+double CCMaterializedResultSet::doubleForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(!c)
+		return 0;
+	switch(c->type) {
+		case SQLITE_INTEGER:
+			return (double)c->v.i;
+		case SQLITE_FLOAT:
+			return c->v.d;
+		case SQLITE_TEXT:
+		case CELL_INTERNED:
+		{
+			uint32_t len;
+			return strtod(bytesOf(c, &len), NULL);
+		}
+		default:
+			return 0;
+	}
+}
+
+string CCMaterializedResultSet::stringForColumn(string columnName) {
+	return stringForColumnIndex(columnIndexForName(columnName));
+}
+
+string CCMaterializedResultSet::stringForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(!c)
+		return "";
+	switch(c->type) {
+		case SQLITE_INTEGER:
+		{
+			char buf[32];
+			sprintf(buf, "%lld", (long long)c->v.i);
+			return buf;
+		}
+		case SQLITE_FLOAT:
+		{
+			char buf[32];
+			sprintf(buf, "%.15g", c->v.d);
+			return buf;
+		}
+		case CELL_INTERNED:
+			return m_data->m_pool->stringForCode((int)c->v.i);
+		case SQLITE_TEXT:
+		case SQLITE_BLOB:
+		{
+			uint32_t len;
+			const char* p = bytesOf(c, &len);
+			return string(p, len);
+		}
+		default:
+			return "";
+	}
+}
+
+const char* CCMaterializedResultSet::textForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(!c || (c->type != SQLITE_TEXT && c->type != CELL_INTERNED))
+		return NULL;
+	uint32_t len;
+	return bytesOf(c, &len);
+}
+
+CCDataView CCMaterializedResultSet::textViewForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(!c || c->type == SQLITE_NULL)
+		return CCDataView();
+	if(c->type != SQLITE_TEXT && c->type != CELL_INTERNED && c->type != SQLITE_BLOB)
+		return CCDataView("", 0);
+	uint32_t len;
+	const char* p = bytesOf(c, &len);
+	return CCDataView(p, len);
+}
+
+CCDataView CCMaterializedResultSet::blobViewForColumnIndex(int columnIdx) {
+	return textViewForColumnIndex(columnIdx);
+}
+
+const string& CCMaterializedResultSet::stringRefForColumn(string columnName) {
+	return stringRefForColumnIndex(columnIndexForName(columnName));
+}
+
+const string& CCMaterializedResultSet::stringRefForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(c && c->type == CELL_INTERNED)
+		return m_data->m_pool->stringForCode((int)c->v.i);
+	m_scratch = stringForColumnIndex(columnIdx);
+	return m_scratch;
+}
+
+int CCMaterializedResultSet::codeForColumn(string columnName) {
+	return codeForColumnIndex(columnIndexForName(columnName));
+}
+
+int CCMaterializedResultSet::codeForColumnIndex(int columnIdx) {
+	const Cell* c = cellAt(columnIdx);
+	if(!c || c->type != CELL_INTERNED)
+		return -1;
+	return (int)c->v.i;
+}
+
+const void* CCMaterializedResultSet::dataNoCopyForColumn(string columnName, size_t* outLen) {
+	return dataNoCopyForColumnIndex(columnIndexForName(columnName), outLen);
+}
+
+const void* CCMaterializedResultSet::dataNoCopyForColumnIndex(int columnIdx, size_t* outLen) {
+	const Cell* c = cellAt(columnIdx);
+	uint32_t len = 0;
+	const char* p = c ? bytesOf(c, &len) : NULL;
+	if(!p || len == 0) {
+		*outLen = 0;
+		return NULL;
+	}
+
+	*outLen = len;
+	return p;
+}
+
+size_t CCMaterializedResultSet::getMemorySize() {
+	return m_data->m_cells.capacity() * sizeof(Cell) + m_data->m_arena.capacity();
+}
+
+NS_CC_END
@@ -0,0 +1,127 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCQueryCache.h"
+#include "CCMaterializedResultSet.h"
+#include "CCUtils.h"
+#include <algorithm>
+
+NS_CC_BEGIN
+
+CCQueryCache::CCQueryCache() :
+		m_maxEntries(64),
+		m_hits(0),
+		m_misses(0),
+		m_invalidations(0) {
+}
+
+CCQueryCache::~CCQueryCache() {
+	clear();
+}
+
+CCQueryCache* CCQueryCache::create() {
+	CCQueryCache* c = new CCQueryCache();
+	return (CCQueryCache*)c->autorelease();
+}
+
+void CCQueryCache::removeEntry(EntryMap::iterator iter) {
+	// unlink from tables
+	StringList& tables = iter->second.tables;
+	for(StringList::iterator t = tables.begin(); t != tables.end(); t++) {
+		TableMap::iterator tm = m_tables.find(*t);
+		if(tm != m_tables.end()) {
+			tm->second.erase(iter->first);
+			if(tm->second.empty())
+				m_tables.erase(tm);
+		}
+	}
+
+	m_lru.erase(iter->second.lru);
+	iter->second.rs->release();
+	m_entries.erase(iter);
+}
+
+CCMaterializedResultSet* CCQueryCache::lookup(const string& sql) {
+	EntryMap::iterator iter = m_entries.find(sql);
+	if(iter == m_entries.end()) {
+		m_misses++;
+		return NULL;
+	}
+
+	// most recent
+	m_lru.splice(m_lru.begin(), m_lru, iter->second.lru);
+	m_hits++;
+	return iter->second.rs;
+}
+
+void CCQueryCache::store(const string& sql, CCMaterializedResultSet* rs, const StringList& tables) {
+	// replace old
+	EntryMap::iterator old = m_entries.find(sql);
+	if(old != m_entries.end())
+		removeEntry(old);
+
+	// evict least recent
+	while(!m_lru.empty() && m_entries.size() >= MAX(1, m_maxEntries))
+		removeEntry(m_entries.find(m_lru.back()));
+
+	// add and link to tables
+	m_lru.push_front(sql);
+	Entry& e = m_entries[sql];
+	e.rs = rs;
+	e.lru = m_lru.begin();
+	rs->retain();
+	for(StringList::const_iterator iter = tables.begin(); iter != tables.end(); iter++) {
+		string t = *iter;
+		CCUtils::toLowercase(t);
+		if(find(e.tables.begin(), e.tables.end(), t) == e.tables.end()) {
+			e.tables.push_back(t);
+			m_tables[t].insert(sql);
+		}
+	}
+}
+
+void CCQueryCache::invalidateTable(const string& table) {
+	string t = table;
+	CCUtils::toLowercase(t);
+	TableMap::iterator tm = m_tables.find(t);
+	if(tm == m_tables.end())
+		return;
+
+	// copy since removing entry changes table map
+	set<string> sqls = tm->second;
+	for(set<string>::iterator iter = sqls.begin(); iter != sqls.end(); iter++) {
+		EntryMap::iterator e = m_entries.find(*iter);
+		if(e != m_entries.end()) {
+			removeEntry(e);
+			m_invalidations++;
+		}
+	}
+}
+
+void CCQueryCache::clear() {
+	while(!m_entries.empty())
+		removeEntry(m_entries.begin());
+	m_tables.clear();
+}
+
+NS_CC_END
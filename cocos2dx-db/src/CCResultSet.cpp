@@ -25,15 +25,27 @@
 #include "CCDatabase.h"
 #include "CCStatement.h"
 #include <unistd.h>
+#include <algorithm>
 #include "sqlite3.h"
 #include "CCUtils.h"
+#include "CCColumnBatch.h"
+#include "CCMaterializedResultSet.h"
+#include "CCVariantRow.h"
 
 NS_CC_BEGIN
 
+/// last serial given to a result set, unlike address it is never reused
+static unsigned int s_lastSerial = 0;
+
 CCResultSet::CCResultSet(CCDatabase* db, CCStatement* statement) :
 		m_db(db),
 		m_statement(statement),
-		m_sql(statement->getQuery()) {
+		m_sql(statement->getQuery()),
+		m_batch(NULL),
+		m_serial(++s_lastSerial),
+		m_row(NULL),
+		m_fieldType(NULL),
+		m_fieldsMatched(false) {
 	// setup column names
     int columnCount = sqlite3_column_count(statement->getStatement());
     for(int i = 0; i < columnCount; i++) {
@@ -49,6 +61,10 @@ CCResultSet::~CCResultSet() {
 	
 	// nullify
 	m_db = NULL;
+
+	// release buffers
+	CC_SAFE_DELETE(m_batch);
+	CC_SAFE_DELETE(m_row);
 }
 
 CCResultSet* CCResultSet::create(CCDatabase* db, CCStatement* statement) {
@@ -57,6 +73,20 @@ CCResultSet* CCResultSet::create(CCDatabase* db, CCStatement* statement) {
 }
 
 bool CCResultSet::next() {
+	bool ok = step();
+
+	// decode whole row once
+	if(m_row) {
+		if(ok)
+			m_row->decode(m_statement->getStatement());
+		else
+			m_row->clear();
+	}
+
+	return ok;
+}
+
+bool CCResultSet::step() {
 	int rc = 0;
 	if(m_statement) {
 		bool retry;
@@ -70,6 +100,7 @@ bool CCResultSet::next() {
 				// this will happen if the db is locked, like if we are doing an update or insert.
 				// in that case, retry the step... and maybe wait just 10 milliseconds.
 				retry = true;
+				bool giveUp = m_db->shouldStopRetry(rc, numberOfRetries);
 				if(SQLITE_LOCKED == rc) {
 					rc = sqlite3_reset(m_statement->getStatement());
 					if(rc != SQLITE_LOCKED) {
@@ -78,7 +109,7 @@ bool CCResultSet::next() {
 				}
 				usleep(20);
 
-				if(m_db->getBusyRetryTimeout() && (numberOfRetries++ > m_db->getBusyRetryTimeout())) {
+				if(giveUp) {
 					CCLOGWARN("CCResultSet::next: Database busy (%@)");
 					break;
 				}
@@ -119,11 +150,115 @@ void CCResultSet::close() {
 	}
 }
 
+bool CCResultSet::prepareFields(const void* type, const int* kinds, const char* const* names, int count) {
+	// result is remembered for type, so a mismatch is logged once
+	m_fieldType = type;
+	m_fieldsMatched = false;
+	if(count > CC_DB_MAX_FIELDS) {
+		CCLOGERROR("CCResultSet: row has %d fields, at most %d are supported", count, CC_DB_MAX_FIELDS);
+		return false;
+	}
+	m_fieldColumns.assign(MAX(count, 1), 0);
+	if(!m_statement)
+		return false;
+
+	// map fields to columns
+	int columnCount = (int)m_columnNames.size();
+	if(names) {
+		for(int i = 0; i < count; i++) {
+			string name = names[i];
+			CCUtils::toLowercase(name);
+			StringList::iterator iter = find(m_columnNames.begin(), m_columnNames.end(), name);
+			if(iter == m_columnNames.end()) {
+				CCLOGERROR("CCResultSet: field %s has no column in query: %s", names[i], m_sql.c_str());
+				return false;
+			}
+			m_fieldColumns[i] = (int)(iter - m_columnNames.begin());
+		}
+	} else {
+		if(count != columnCount) {
+			CCLOGERROR("CCResultSet: row has %d fields but query has %d columns: %s", count, columnCount, m_sql.c_str());
+			return false;
+		}
+		for(int i = 0; i < count; i++)
+			m_fieldColumns[i] = i;
+	}
+
+	// numbers can't be read from text or blob columns, checked by declared type
+	sqlite3_stmt* stmt = m_statement->getStatement();
+	for(int i = 0; i < count; i++) {
+		if(kinds[i] != kCCFieldInteger && kinds[i] != kCCFieldFloat)
+			continue;
+		const char* decl = sqlite3_column_decltype(stmt, m_fieldColumns[i]);
+		if(!decl)
+			continue;
+		string d = decl;
+		CCUtils::toLowercase(d);
+		if(d.find("int") == string::npos &&
+		   (d.find("char") != string::npos || d.find("clob") != string::npos || d.find("text") != string::npos || d.find("blob") != string::npos)) {
+			CCLOGERROR("CCResultSet: field %d is a number but column %s is %s: %s", i, m_columnNames[m_fieldColumns[i]].c_str(), decl, m_sql.c_str());
+			return false;
+		}
+	}
+
+	m_fieldsMatched = true;
+	return true;
+}
+
 int CCResultSet::columnCount() {
 	return sqlite3_column_count(m_statement->getStatement());
 }
 
+void CCResultSet::setDecodesRows(bool flag) {
+	if(flag && !m_row)
+		m_row = new CCVariantRow();
+	else if(!flag)
+		CC_SAFE_DELETE(m_row);
+}
+
+CCColumnBatch* CCResultSet::fetchBatch(int maxRows) {
+	if(!m_batch)
+		m_batch = new CCColumnBatch();
+	fetchBatch(m_batch, maxRows);
+	return m_batch;
+}
+
+int CCResultSet::fetchBatch(CCColumnBatch* batch, int maxRows) {
+	// closed
+	if(!m_statement) {
+		batch->m_rowCount = 0;
+		return 0;
+	}
+
+	// step rows and append them, next closes result set at end
+	sqlite3_stmt* stmt = m_statement->getStatement();
+	batch->reset(stmt, batch->m_filler == m_serial);
+	batch->m_filler = m_serial;
+	while(batch->m_rowCount < maxRows && step()) {
+		batch->appendRow(stmt);
+	}
+	return batch->m_rowCount;
+}
+
+CCMaterializedResultSet* CCResultSet::materialize(CCStringPool* pool) {
+	CCMaterializedResultSet* mrs = new CCMaterializedResultSet();
+	if(m_statement) {
+		sqlite3_stmt* stmt = m_statement->getStatement();
+		mrs->initWithStatement(stmt, pool);
+		while(step()) {
+			mrs->appendRow(stmt);
+		}
+
+		// drop spare capacity since it won't grow again
+		CCMaterializedResultSet::CellList(mrs->m_data->m_cells).swap(mrs->m_data->m_cells);
+		vector<char>(mrs->m_data->m_arena).swap(mrs->m_data->m_arena);
+	}
+	return (CCMaterializedResultSet*)mrs->autorelease();
+}
+
 bool CCResultSet::columnIndexIsNull(int columnIdx) {
+	if(m_row)
+		return m_row->isNull(columnIdx);
 	return sqlite3_column_type(m_statement->getStatement(), columnIdx) == SQLITE_NULL;
 }
 
@@ -146,7 +281,7 @@ int CCResultSet::columnIndexForName(string columnName) {
 
 string CCResultSet::columnNameForIndex(int columnIdx) {
 	if(columnIdx < 0 || columnIdx >= m_columnNames.size())
-		return NULL;
+		return "";
 	else
 		return m_columnNames.at(columnIdx);
 }
@@ -156,6 +291,8 @@ int CCResultSet::intForColumn(string columnName) {
 }
 
 int CCResultSet::intForColumnIndex(int columnIdx) {
+	if(m_row)
+		return (int)m_row->int64At(columnIdx);
 	return sqlite3_column_int(m_statement->getStatement(), columnIdx);
 }
 
@@ -164,6 +301,8 @@ long CCResultSet::longForColumn(string columnName) {
 }
 
 long CCResultSet::longForColumnIndex(int columnIdx) {
+	if(m_row)
+		return (long)m_row->int64At(columnIdx);
 	return (long)sqlite3_column_int64(m_statement->getStatement(), columnIdx);
 }
 
@@ -172,6 +311,8 @@ int64_t CCResultSet::int64ForColumn(string columnName) {
 }
 
 int64_t CCResultSet::int64ForColumnIndex(int columnIdx) {
+	if(m_row)
+		return m_row->int64At(columnIdx);
 	return (int64_t)sqlite3_column_int64(m_statement->getStatement(), columnIdx);
 }
 
@@ -188,6 +329,8 @@ double CCResultSet::doubleForColumn(string columnName) {
 }
 
 double CCResultSet::doubleForColumnIndex(int columnIdx) {
+	if(m_row)
+		return m_row->doubleAt(columnIdx);
 	return sqlite3_column_double(m_statement->getStatement(), columnIdx);
 }
 
@@ -196,11 +339,57 @@ string CCResultSet::stringForColumn(string columnName) {
 }
 
 string CCResultSet::stringForColumnIndex(int columnIdx) {
-    if (sqlite3_column_type(m_statement->getStatement(), columnIdx) == SQLITE_NULL || (columnIdx < 0)) {
-        return NULL;
-    }
+	// string can't be constructed from NULL, null value is empty string
+	CCDataView view = textViewForColumnIndex(columnIdx);
+	return view.toString();
+}
+
+CCDataView CCResultSet::textViewForColumn(string columnName) {
+	return textViewForColumnIndex(columnIndexForName(columnName));
+}
+
+CCDataView CCResultSet::textViewForColumnIndex(int columnIdx) {
+	if(!m_statement || columnIdx < 0 || columnIdx >= m_columnNames.size())
+		return CCDataView();
+
+	// decoded row has text and blob, numbers are converted by sqlite
+	if(m_row) {
+		int type = m_row->typeAt(columnIdx);
+		if(type == SQLITE_NULL)
+			return CCDataView();
+		else if(type == SQLITE_TEXT || type == SQLITE_BLOB)
+			return m_row->bytesAt(columnIdx);
+	}
+	sqlite3_stmt* stmt = m_statement->getStatement();
+	if(sqlite3_column_type(stmt, columnIdx) == SQLITE_NULL)
+		return CCDataView();
+
+	// pointer must be got before length
+	const char* p = (const char*)sqlite3_column_text(stmt, columnIdx);
+	return CCDataView(p, sqlite3_column_bytes(stmt, columnIdx));
+}
+
+CCDataView CCResultSet::blobViewForColumn(string columnName) {
+	return blobViewForColumnIndex(columnIndexForName(columnName));
+}
+
+CCDataView CCResultSet::blobViewForColumnIndex(int columnIdx) {
+	if(!m_statement || columnIdx < 0 || columnIdx >= m_columnNames.size())
+		return CCDataView();
+	if(m_row) {
+		int type = m_row->typeAt(columnIdx);
+		if(type == SQLITE_NULL)
+			return CCDataView();
+		else if(type == SQLITE_TEXT || type == SQLITE_BLOB)
+			return m_row->bytesAt(columnIdx);
+	}
+	sqlite3_stmt* stmt = m_statement->getStatement();
+	if(sqlite3_column_type(stmt, columnIdx) == SQLITE_NULL)
+		return CCDataView();
 
-    return (const char*)sqlite3_column_text(m_statement->getStatement(), columnIdx);
+	// zero length blob has NULL pointer, view turns it to empty
+	const char* p = (const char*)sqlite3_column_blob(stmt, columnIdx);
+	return CCDataView(p, sqlite3_column_bytes(stmt, columnIdx));
 }
 
 const void* CCResultSet::dataForColumn(string columnName, size_t* outLen) {
@@ -0,0 +1,230 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCSchemaCatalog.h"
+#include "CCDatabase.h"
+#include "CCStringPool.h"
+#include "CCUtils.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+CCSchemaCatalog::Table::Table() :
+		m_columnNames(NULL) {
+}
+
+CCSchemaCatalog::Table::Table(const Table& t) :
+		m_columnNames(t.m_columnNames),
+		name(t.name),
+		columns(t.columns) {
+	CC_SAFE_RETAIN(m_columnNames);
+}
+
+CCSchemaCatalog::Table::~Table() {
+	CC_SAFE_RELEASE(m_columnNames);
+}
+
+CCSchemaCatalog::Table& CCSchemaCatalog::Table::operator=(const Table& t) {
+	CC_SAFE_RETAIN(t.m_columnNames);
+	CC_SAFE_RELEASE(m_columnNames);
+	m_columnNames = t.m_columnNames;
+	name = t.name;
+	columns = t.columns;
+	return *this;
+}
+
+int CCSchemaCatalog::Table::columnIndex(string columnName) const {
+	if(!m_columnNames)
+		return -1;
+	CCUtils::toLowercase(columnName);
+	return m_columnNames->codeForString(columnName);
+}
+
+const CCSchemaCatalog::Column* CCSchemaCatalog::Table::findColumn(const string& columnName) const {
+	int index = columnIndex(columnName);
+	return index < 0 ? NULL : &columns[index];
+}
+
+CCSchemaCatalog::CCSchemaCatalog() :
+		m_db(NULL),
+		m_versionStmt(NULL),
+		m_version(-1),
+		m_tableNames(NULL),
+		m_loadCount(0) {
+}
+
+CCSchemaCatalog::~CCSchemaCatalog() {
+	reset();
+}
+
+CCSchemaCatalog* CCSchemaCatalog::create(CCDatabase* db) {
+	CCSchemaCatalog* c = new CCSchemaCatalog();
+	if(c->initWithDatabase(db)) {
+		return (CCSchemaCatalog*)c->autorelease();
+	}
+	c->release();
+	return NULL;
+}
+
+bool CCSchemaCatalog::initWithDatabase(CCDatabase* db) {
+	if(!db)
+		return false;
+	m_db = db;
+	return true;
+}
+
+void CCSchemaCatalog::reset() {
+	if(m_versionStmt) {
+		sqlite3_finalize(m_versionStmt);
+		m_versionStmt = NULL;
+	}
+	CC_SAFE_RELEASE_NULL(m_tableNames);
+	m_tables.clear();
+	m_version = -1;
+}
+
+int CCSchemaCatalog::readVersion() {
+	sqlite3* handle = m_db->sqliteHandle();
+	if(!handle)
+		return -1;
+
+	// statement is kept, version check is one step
+	if(!m_versionStmt) {
+		if(sqlite3_prepare_v2(handle, "PRAGMA schema_version", -1, &m_versionStmt, NULL) != SQLITE_OK) {
+			CCLOGERROR("CCSchemaCatalog::readVersion: DB Error: %d \"%s\"", m_db->lastErrorCode(), m_db->lastErrorMessage().c_str());
+			sqlite3_finalize(m_versionStmt);
+			m_versionStmt = NULL;
+			return -1;
+		}
+	}
+	int version = -1;
+	if(m_db->stepStatement(m_versionStmt) == SQLITE_ROW)
+		version = sqlite3_column_int(m_versionStmt, 0);
+	sqlite3_reset(m_versionStmt);
+	return version;
+}
+
+bool CCSchemaCatalog::load(int version) {
+	sqlite3* handle = m_db->sqliteHandle();
+	CCStringPool* tableNames = CCStringPool::create();
+	vector<Table> tables;
+
+	// table names
+	sqlite3_stmt* stmt = NULL;
+	if(sqlite3_prepare_v2(handle, "SELECT name FROM sqlite_master WHERE type = 'table'", -1, &stmt, NULL) != SQLITE_OK) {
+		CCLOGERROR("CCSchemaCatalog::load: DB Error: %d \"%s\"", m_db->lastErrorCode(), m_db->lastErrorMessage().c_str());
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	while(m_db->stepStatement(stmt) == SQLITE_ROW) {
+		const char* name = (const char*)sqlite3_column_text(stmt, 0);
+		string lower = name ? name : "";
+		CCUtils::toLowercase(lower);
+		if(tableNames->codeForString(lower) >= 0)
+			continue;
+		tableNames->intern(lower);
+		tables.push_back(Table());
+		tables.back().name = name ? name : "";
+	}
+	sqlite3_finalize(stmt);
+
+	// columns of every table
+	for(vector<Table>::iterator iter = tables.begin(); iter != tables.end(); iter++) {
+		string sql = "PRAGMA table_info(" + CCDatabase::quoteIdentifier(iter->name) + ")";
+		stmt = NULL;
+		if(sqlite3_prepare_v2(handle, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+			CCLOGERROR("CCSchemaCatalog::load: DB Error: %d \"%s\"", m_db->lastErrorCode(), m_db->lastErrorMessage().c_str());
+			sqlite3_finalize(stmt);
+			return false;
+		}
+
+		// result columns: cid, name, type, notnull, dflt_value, pk
+		iter->m_columnNames = CCStringPool::create();
+		iter->m_columnNames->retain();
+		while(m_db->stepStatement(stmt) == SQLITE_ROW) {
+			Column col;
+			const char* text = (const char*)sqlite3_column_text(stmt, 1);
+			col.name = text ? text : "";
+			text = (const char*)sqlite3_column_text(stmt, 2);
+			col.type = text ? text : "";
+			col.notNull = sqlite3_column_int(stmt, 3) != 0;
+			text = (const char*)sqlite3_column_text(stmt, 4);
+			col.defaultValue = text ? text : "";
+			col.primaryKey = sqlite3_column_int(stmt, 5) != 0;
+
+			// column names are unique ignoring case, so code is index
+			string lower = col.name;
+			CCUtils::toLowercase(lower);
+			iter->m_columnNames->intern(lower);
+			iter->columns.push_back(col);
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	// replace old catalogue
+	tableNames->retain();
+	CC_SAFE_RELEASE(m_tableNames);
+	m_tableNames = tableNames;
+	m_tables.swap(tables);
+	m_version = version;
+	m_loadCount++;
+	return true;
+}
+
+bool CCSchemaCatalog::validate() {
+	m_db->waitForOpen();
+	if(!m_db->databaseOpened())
+		return false;
+
+	int version = readVersion();
+	if(version < 0)
+		return false;
+	if(version == m_version)
+		return true;
+	return load(version);
+}
+
+const CCSchemaCatalog::Table* CCSchemaCatalog::findTable(string tableName) {
+	if(!validate())
+		return NULL;
+	CCUtils::toLowercase(tableName);
+	int index = m_tableNames->codeForString(tableName);
+	return index < 0 ? NULL : &m_tables[index];
+}
+
+bool CCSchemaCatalog::columnExists(const string& tableName, const string& columnName) {
+	const Table* t = findTable(tableName);
+	return t && t->columnIndex(columnName) >= 0;
+}
+
+int CCSchemaCatalog::getTableCount() {
+	return validate() ? (int)m_tables.size() : 0;
+}
+
+const CCSchemaCatalog::Table* CCSchemaCatalog::getTableAt(int index) {
+	if(!validate() || index < 0 || index >= (int)m_tables.size())
+		return NULL;
+	return &m_tables[index];
+}
+
+NS_CC_END
@@ -0,0 +1,307 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCSchemaCodeGenerator.h"
+#include "CCDatabase.h"
+#include "CCResultSet.h"
+#include "CCSchemaCatalog.h"
+#include "CCUtils.h"
+#include <set>
+
+NS_CC_BEGIN
+
+CCSchemaCodeGenerator::CCSchemaCodeGenerator() :
+		m_db(NULL) {
+}
+
+CCSchemaCodeGenerator::~CCSchemaCodeGenerator() {
+	CC_SAFE_RELEASE(m_db);
+}
+
+CCSchemaCodeGenerator* CCSchemaCodeGenerator::create(CCDatabase* db) {
+	CCSchemaCodeGenerator* g = new CCSchemaCodeGenerator();
+	if(g->initWithDatabase(db)) {
+		return (CCSchemaCodeGenerator*)g->autorelease();
+	}
+	g->release();
+	return NULL;
+}
+
+bool CCSchemaCodeGenerator::initWithDatabase(CCDatabase* db) {
+	m_db = db;
+	CC_SAFE_RETAIN(m_db);
+	return m_db != NULL;
+}
+
+string CCSchemaCodeGenerator::camelName(const string& name) {
+	string ret;
+	bool upper = true;
+	for(string::const_iterator iter = name.begin(); iter != name.end(); iter++) {
+		char c = *iter;
+		if(isalnum(c)) {
+			ret += upper ? toupper(c) : c;
+			upper = false;
+		} else {
+			upper = true;
+		}
+	}
+
+	// identifier can't start with digit
+	if(ret.empty() || isdigit(ret[0]))
+		ret = "T" + ret;
+	return ret;
+}
+
+string CCSchemaCodeGenerator::memberName(const string& name) {
+	string ret;
+	for(string::const_iterator iter = name.begin(); iter != name.end(); iter++)
+		ret += isalnum(*iter) ? *iter : '_';
+
+	// identifier can't start with digit
+	if(ret.empty() || isdigit(ret[0]))
+		ret = "c" + ret;
+	if(isKeyword(ret))
+		ret += "_";
+	return ret;
+}
+
+bool CCSchemaCodeGenerator::isKeyword(const string& name) {
+	static const char* keywords[] = {
+		"alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+		"case", "catch", "char", "char16_t", "char32_t", "class", "compl", "const", "const_cast",
+		"constexpr", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+		"else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+		"if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+		"nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+		"reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert",
+		"static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+		"try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
+		"volatile", "wchar_t", "while", "xor", "xor_eq", NULL
+	};
+	for(int i = 0; keywords[i]; i++) {
+		if(name == keywords[i])
+			return true;
+	}
+	return false;
+}
+
+string CCSchemaCodeGenerator::cString(const string& s) {
+	string ret;
+	for(string::const_iterator iter = s.begin(); iter != s.end(); iter++) {
+		if(*iter == '"' || *iter == '\\')
+			ret += '\\';
+		ret += *iter;
+	}
+	return ret;
+}
+
+bool CCSchemaCodeGenerator::isBlob(const string& declType) {
+	string d = declType;
+	CCUtils::toLowercase(d);
+	return d.empty() || (d.find("blob") != string::npos && d.find("int") == string::npos);
+}
+
+string CCSchemaCodeGenerator::cppType(const string& declType) {
+	string d = declType;
+	CCUtils::toLowercase(d);
+	if(d.find("int") != string::npos)
+		return "int64_t";
+	if(d.find("char") != string::npos || d.find("clob") != string::npos || d.find("text") != string::npos)
+		return "std::string";
+	if(isBlob(declType))
+		return "std::string";
+	return "double";
+}
+
+bool CCSchemaCodeGenerator::readColumns(const string& table, ColumnList& columns) {
+	// catalogue quotes table name, so keyword table works
+	const CCSchemaCatalog::Table* t = m_db->getSchemaCatalog()->findTable(table);
+	if(!t)
+		return false;
+
+	// count key columns, entity table supports only one key
+	int keys = 0;
+	set<string> members, indexes;
+	for(vector<CCSchemaCatalog::Column>::const_iterator iter = t->columns.begin(); iter != t->columns.end(); iter++) {
+		Column c;
+		c.name = iter->name;
+		c.type = iter->type;
+		c.key = iter->primaryKey;
+		if(c.key)
+			keys++;
+
+		// different names may convert to same identifier, add column position then
+		char buf[16];
+		sprintf(buf, "%d", (int)columns.size());
+		c.member = memberName(c.name);
+		if(!members.insert(c.member).second) {
+			c.member += buf;
+			members.insert(c.member);
+		}
+		c.index = camelName(c.name);
+		if(!indexes.insert(c.index).second) {
+			c.index += buf;
+			indexes.insert(c.index);
+		}
+		columns.push_back(c);
+	}
+	if(keys > 1) {
+		for(ColumnList::iterator iter = columns.begin(); iter != columns.end(); iter++)
+			iter->key = false;
+	}
+	return !columns.empty();
+}
+
+void CCSchemaCodeGenerator::generateTable(const string& table, const ColumnList& columns, string& out) {
+	string type = camelName(table) + "Row";
+	string prefix = "k" + camelName(table);
+
+	// struct with default values
+	out += "/// row of table " + table + "\n";
+	out += "struct " + type + " {\n";
+	string inits;
+	for(ColumnList::const_iterator iter = columns.begin(); iter != columns.end(); iter++) {
+		string t = cppType(iter->type);
+		out += "\t" + t + " " + iter->member + ";\n";
+		if(t != "std::string") {
+			inits += inits.empty() ? " : " : ", ";
+			inits += iter->member + "(0)";
+		}
+	}
+	out += "\n\t" + type + "()" + inits + " {}\n";
+	out += "};\n\n";
+
+	// column indexes
+	string macro = type;
+	for(string::iterator iter = macro.begin(); iter != macro.end(); iter++)
+		*iter = toupper(*iter);
+	char buf[32];
+	out += "/// column indexes of " + macro + "_SELECT\n";
+	out += "enum {\n";
+	int index = 0;
+	string select;
+	for(ColumnList::const_iterator iter = columns.begin(); iter != columns.end(); iter++, index++) {
+		sprintf(buf, "%d", index);
+		out += "\t" + prefix + iter->index + " = " + buf + ",\n";
+		if(!select.empty())
+			select += ", ";
+		select += CCDatabase::quoteIdentifier(iter->name);
+	}
+	sprintf(buf, "%d", index);
+	out += "\t" + prefix + "ColumnCount = " + buf + "\n";
+	out += "};\n\n";
+
+	// select matching indexes
+	out += "/// select all columns in index order\n";
+	out += "#define " + macro + "_SELECT \"" + cString("SELECT " + select + " FROM " + CCDatabase::quoteIdentifier(table)) + "\"\n\n";
+
+	// load by index
+	out += "/// read current row of a result set selected by " + macro + "_SELECT\n";
+	out += "inline void load" + type + "(cocos2d::CCResultSet* rs, " + type + "& row) {\n";
+	for(ColumnList::const_iterator iter = columns.begin(); iter != columns.end(); iter++) {
+		string t = cppType(iter->type);
+		string idx = prefix + iter->index;
+		if(t == "int64_t")
+			out += "\trow." + iter->member + " = rs->int64ForColumnIndex(" + idx + ");\n";
+		else if(t == "double")
+			out += "\trow." + iter->member + " = rs->doubleForColumnIndex(" + idx + ");\n";
+		else if(isBlob(iter->type))
+			out += "\trow." + iter->member + " = rs->blobViewForColumnIndex(" + idx + ").toString();\n";
+		else
+			out += "\trow." + iter->member + " = rs->textViewForColumnIndex(" + idx + ").toString();\n";
+	}
+	out += "}\n\n";
+
+	// entity description, it must be at global scope
+	out += "/// store by cocos2d::CCEntityTable<" + type + ">\n";
+	out += "CC_DB_TABLE_BEGIN(" + type + ", \"" + cString(table) + "\")\n";
+	for(ColumnList::const_iterator iter = columns.begin(); iter != columns.end(); iter++) {
+		// declared blob is bound as blob, column without type is bound as text
+		string macro = iter->key ? "CC_DB_KEY" : "CC_DB_COLUMN";
+		if(!iter->type.empty() && isBlob(iter->type))
+			macro = iter->key ? "CC_DB_BLOB_KEY" : "CC_DB_BLOB_COLUMN";
+		if(iter->member == iter->name)
+			out += "\t" + macro + "(" + iter->member + ")\n";
+		else
+			out += "\t" + macro + "_NAMED(" + iter->member + ", \"" + cString(iter->name) + "\")\n";
+	}
+	out += "CC_DB_TABLE_END(" + type + ")\n\n";
+}
+
+string CCSchemaCodeGenerator::generate(string guard) {
+	// tables
+	StringList tables = m_tables;
+	if(tables.empty()) {
+		CCResultSet* rs = m_db->executeQuery("SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%%' ORDER BY name");
+		while(rs && rs->next()) {
+			tables.push_back(rs->stringForColumnIndex(0));
+		}
+	}
+
+	string body;
+	for(StringList::iterator iter = tables.begin(); iter != tables.end(); iter++) {
+		ColumnList columns;
+		if(!readColumns(*iter, columns)) {
+			CCLOGWARN("CCSchemaCodeGenerator: table %s doesn't exist", iter->c_str());
+			continue;
+		}
+		generateTable(*iter, columns, body);
+	}
+	if(body.empty())
+		return "";
+
+	string out;
+	out += "// generated by CCSchemaCodeGenerator, do not edit\n";
+	out += "#ifndef " + guard + "\n";
+	out += "#define " + guard + "\n\n";
+	out += "#include \"cocos2d-db.h\"\n\n";
+	out += body;
+	out += "#endif // " + guard + "\n";
+	return out;
+}
+
+bool CCSchemaCodeGenerator::writeToFile(string path) {
+	// guard from file name, GameData.h is __GameData_h__
+	size_t slash = path.find_last_of("/\\");
+	string guard = slash == string::npos ? path : path.substr(slash + 1);
+	for(string::iterator iter = guard.begin(); iter != guard.end(); iter++) {
+		if(!isalnum(*iter))
+			*iter = '_';
+	}
+	guard = "__" + guard + "__";
+
+	string code = generate(guard);
+	if(code.empty())
+		return false;
+
+	FILE* f = fopen(path.c_str(), "wb");
+	if(!f) {
+		CCLOGERROR("CCSchemaCodeGenerator: can't open %s", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(code.c_str(), 1, code.length(), f) == code.length();
+	fclose(f);
+	return ok;
+}
+
+NS_CC_END
@@ -0,0 +1,342 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCStaticTable.h"
+#include "CCDatabase.h"
+#include "CCStatement.h"
+#include "CCUtils.h"
+#include "sqlite3.h"
+#include <algorithm>
+
+// max displacement tried for a bucket before giving up
+#define MAX_DISPLACEMENT 0x100000
+
+NS_CC_BEGIN
+
+/// sort buckets by key count, larger first
+struct CCStaticBucketLess {
+	const vector<vector<int> >& buckets;
+	CCStaticBucketLess(const vector<vector<int> >& b) : buckets(b) {}
+	bool operator()(int a, int b) const { return buckets[a].size() > buckets[b].size(); }
+};
+
+CCStaticTable::CCStaticTable() :
+		m_columnCount(0),
+		m_rowCount(0),
+		m_keyIndex(0),
+		m_textKeys(false) {
+}
+
+CCStaticTable::~CCStaticTable() {
+}
+
+CCStaticTable* CCStaticTable::create(CCDatabase* db, const string& table, const string& keyColumn, const string& columns) {
+	string sql = "SELECT " + columns + " FROM " + CCDatabase::quoteIdentifier(table);
+	CCStaticTable* t = new CCStaticTable();
+	if(t->initWithQuery(db, sql, -1, keyColumn)) {
+		return (CCStaticTable*)t->autorelease();
+	}
+	t->release();
+	return NULL;
+}
+
+CCStaticTable* CCStaticTable::createWithQuery(CCDatabase* db, const string& sql, int keyIndex) {
+	CCStaticTable* t = new CCStaticTable();
+	if(t->initWithQuery(db, sql, keyIndex, "")) {
+		return (CCStaticTable*)t->autorelease();
+	}
+	t->release();
+	return NULL;
+}
+
+bool CCStaticTable::initWithQuery(CCDatabase* db, const string& sql, int keyIndex, const string& keyColumn) {
+	if(!db)
+		return false;
+
+	// sql is run as it is, formatting would truncate long sql and mangle %
+	CCResultSet* rs = db->_executeQuery(sql.c_str());
+	if(!rs)
+		return false;
+	m_keyIndex = keyIndex;
+	vector<Cell> cells;
+	bool ok = loadRows(rs, keyColumn, cells);
+
+	// result set closes itself at end, drain it if loading stops early
+	if(!ok) {
+		while(rs->next()) {
+		}
+	}
+	return ok && buildHash(cells);
+}
+
+bool CCStaticTable::loadRows(CCResultSet* rs, const string& keyColumn, vector<Cell>& cells) {
+	sqlite3_stmt* stmt = rs->getStatement()->getStatement();
+	m_columnCount = sqlite3_column_count(stmt);
+	for(int i = 0; i < m_columnCount; i++) {
+		const char* name = sqlite3_column_name(stmt, i);
+		string lower = name ? name : "";
+		CCUtils::toLowercase(lower);
+		m_columnNames.push_back(lower);
+	}
+	if(!keyColumn.empty())
+		m_keyIndex = columnIndexForName(keyColumn);
+	if(m_keyIndex < 0 || m_keyIndex >= m_columnCount) {
+		CCLOGERROR("CCStaticTable: key column %s is not selected", keyColumn.empty() ? "" : keyColumn.c_str());
+		return false;
+	}
+
+	m_rowCount = 0;
+	while(rs->next()) {
+		for(int i = 0; i < m_columnCount; i++) {
+			Cell c;
+			c.type = sqlite3_column_type(stmt, i);
+			switch(c.type) {
+				case SQLITE_INTEGER:
+					c.v.i = sqlite3_column_int64(stmt, i);
+					break;
+				case SQLITE_FLOAT:
+					c.v.d = sqlite3_column_double(stmt, i);
+					break;
+				case SQLITE_TEXT:
+				case SQLITE_BLOB:
+				{
+					const char* p = c.type == SQLITE_TEXT ? (const char*)sqlite3_column_text(stmt, i) : (const char*)sqlite3_column_blob(stmt, i);
+					int len = sqlite3_column_bytes(stmt, i);
+					c.v.bytes.offset = (uint32_t)m_arena.size();
+					c.v.bytes.length = (uint32_t)len;
+					if(len > 0)
+						m_arena.insert(m_arena.end(), p, p + len);
+					if(c.type == SQLITE_TEXT)
+						m_arena.push_back(0);
+					break;
+				}
+				default:
+					c.v.i = 0;
+					break;
+			}
+
+			// key type is decided by first row
+			if(i == m_keyIndex) {
+				if(m_rowCount == 0)
+					m_textKeys = c.type == SQLITE_TEXT;
+				if(c.type != (m_textKeys ? SQLITE_TEXT : SQLITE_INTEGER)) {
+					CCLOGERROR("CCStaticTable: key of row %d is not %s", m_rowCount, m_textKeys ? "text" : "integer");
+					return false;
+				}
+			}
+			cells.push_back(c);
+		}
+		m_rowCount++;
+	}
+	return true;
+}
+
+uint64_t CCStaticTable::hashOfCell(const Cell& c) const {
+	if(m_textKeys)
+		return hashBytes(m_arena.empty() ? "" : &m_arena[c.v.bytes.offset], c.v.bytes.length);
+	else
+		return hashInt(c.v.i);
+}
+
+bool CCStaticTable::buildHash(const vector<Cell>& cells) {
+	uint32_t n = (uint32_t)m_rowCount;
+	uint32_t bucketCount = n / 3 + 1;
+	m_displacements.assign(bucketCount, 0);
+	if(n == 0)
+		return true;
+
+	// hash keys into buckets
+	vector<uint64_t> hashes(n);
+	vector<vector<int> > buckets(bucketCount);
+	for(uint32_t row = 0; row < n; row++) {
+		hashes[row] = hashOfCell(cells[row * m_columnCount + m_keyIndex]);
+		buckets[bucketOf(hashes[row])].push_back(row);
+	}
+
+	// place larger buckets first, they are harder to place
+	vector<int> order(bucketCount);
+	for(uint32_t i = 0; i < bucketCount; i++)
+		order[i] = i;
+	stable_sort(order.begin(), order.end(), CCStaticBucketLess(buckets));
+
+	// find a displacement for every bucket which maps its keys to free slots
+	vector<int> rowOfSlot(n, -1);
+	vector<uint32_t> slots;
+	for(uint32_t i = 0; i < bucketCount; i++) {
+		const vector<int>& bucket = buckets[order[i]];
+		if(bucket.empty())
+			break;
+
+		// same hash can't be separated by displacement
+		for(size_t a = 0; a < bucket.size(); a++) {
+			for(size_t b = a + 1; b < bucket.size(); b++) {
+				if(hashes[bucket[a]] == hashes[bucket[b]]) {
+					CCLOGERROR("CCStaticTable: duplicated key at row %d", bucket[b]);
+					return false;
+				}
+			}
+		}
+
+		uint32_t d = 0;
+		for(; d < MAX_DISPLACEMENT; d++) {
+			slots.clear();
+			bool fit = true;
+			for(size_t k = 0; k < bucket.size() && fit; k++) {
+				uint32_t s = slotOf(hashes[bucket[k]], d, n);
+				fit = rowOfSlot[s] < 0 && find(slots.begin(), slots.end(), s) == slots.end();
+				slots.push_back(s);
+			}
+			if(fit)
+				break;
+		}
+		if(d == MAX_DISPLACEMENT) {
+			CCLOGERROR("CCStaticTable: failed to build perfect hash");
+			return false;
+		}
+		m_displacements[order[i]] = d;
+		for(size_t k = 0; k < bucket.size(); k++)
+			rowOfSlot[slots[k]] = bucket[k];
+	}
+
+	// store rows in slot order
+	m_cells.resize(cells.size());
+	for(uint32_t s = 0; s < n; s++) {
+		const Cell* src = &cells[rowOfSlot[s] * m_columnCount];
+		copy(src, src + m_columnCount, m_cells.begin() + s * m_columnCount);
+	}
+	return true;
+}
+
+uint64_t CCStaticTable::hashBytes(const char* p, size_t len) {
+	// FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	for(size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+uint64_t CCStaticTable::hashInt(int64_t key) {
+	// splitmix64 finalizer, spreads sequential ids
+	uint64_t x = (uint64_t)key;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+uint32_t CCStaticTable::slotOf(uint64_t h, uint32_t d, uint32_t n) {
+	uint64_t x = h ^ ((uint64_t)d * 0x9e3779b97f4a7c15ULL);
+	x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return (uint32_t)(x % n);
+}
+
+int CCStaticTable::rowForKey(const char* key, size_t len) const {
+	if(!m_textKeys || m_rowCount == 0 || !key)
+		return -1;
+	uint64_t h = hashBytes(key, len);
+	uint32_t s = slotOf(h, m_displacements[bucketOf(h)], m_rowCount);
+
+	// slot always has a row, compare its key
+	const Cell& c = m_cells[s * m_columnCount + m_keyIndex];
+	if(c.v.bytes.length != len || memcmp(&m_arena[c.v.bytes.offset], key, len) != 0)
+		return -1;
+	return (int)s;
+}
+
+int CCStaticTable::rowForKey(int64_t key) const {
+	if(m_textKeys || m_rowCount == 0)
+		return -1;
+	uint64_t h = hashInt(key);
+	uint32_t s = slotOf(h, m_displacements[bucketOf(h)], m_rowCount);
+	return m_cells[s * m_columnCount + m_keyIndex].v.i == key ? (int)s : -1;
+}
+
+int CCStaticTable::columnIndexForName(string columnName) const {
+	CCUtils::toLowercase(columnName);
+	for(int i = 0; i < m_columnCount; i++) {
+		if(m_columnNames[i] == columnName)
+			return i;
+	}
+	return -1;
+}
+
+const CCStaticTable::Cell* CCStaticTable::cellAt(int row, int columnIdx) const {
+	if(row < 0 || row >= m_rowCount || columnIdx < 0 || columnIdx >= m_columnCount)
+		return NULL;
+	return &m_cells[row * m_columnCount + columnIdx];
+}
+
+bool CCStaticTable::isNullAt(int row, int columnIdx) const {
+	const Cell* c = cellAt(row, columnIdx);
+	return !c || c->type == SQLITE_NULL;
+}
+
+int64_t CCStaticTable::int64At(int row, int columnIdx) const {
+	const Cell* c = cellAt(row, columnIdx);
+	if(!c)
+		return 0;
+	switch(c->type) {
+		case SQLITE_INTEGER:
+			return c->v.i;
+		case SQLITE_FLOAT:
+			return (int64_t)c->v.d;
+		case SQLITE_TEXT:
+			return strtoll(&m_arena[c->v.bytes.offset], NULL, 10);
+		default:
+			return 0;
+	}
+}
+
+double CCStaticTable::doubleAt(int row, int columnIdx) const {
+	const Cell* c = cellAt(row, columnIdx);
+	if(!c)
+		return 0;
+	switch(c->type) {
+		case SQLITE_INTEGER:
+			return (double)c->v.i;
+		case SQLITE_FLOAT:
+			return c->v.d;
+		case SQLITE_TEXT:
+			return atof(&m_arena[c->v.bytes.offset]);
+		default:
+			return 0;
+	}
+}
+
+CCDataView CCStaticTable::textAt(int row, int columnIdx) const {
+	const Cell* c = cellAt(row, columnIdx);
+	if(!c || (c->type != SQLITE_TEXT && c->type != SQLITE_BLOB))
+		return CCDataView();
+	if(c->v.bytes.length == 0)
+		return CCDataView("", 0);
+	return CCDataView(&m_arena[c->v.bytes.offset], c->v.bytes.length);
+}
+
+size_t CCStaticTable::getMemorySize() const {
+	return sizeof(CCStaticTable) + m_cells.capacity() * sizeof(Cell) + m_arena.capacity() +
+		m_displacements.capacity() * sizeof(uint32_t);
+}
+
+NS_CC_END
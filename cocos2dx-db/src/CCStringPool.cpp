@@ -0,0 +1,112 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCStringPool.h"
+
+NS_CC_BEGIN
+
+/// empty string returned for invalid code
+static const string s_emptyString;
+
+CCStringPool::CCStringPool() :
+		m_bytes(0) {
+	m_slots.resize(64, -1);
+}
+
+CCStringPool::~CCStringPool() {
+}
+
+CCStringPool* CCStringPool::create() {
+	CCStringPool* p = new CCStringPool();
+	return (CCStringPool*)p->autorelease();
+}
+
+uint32_t CCStringPool::hash(const char* p, size_t len) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for(size_t i = 0; i < len; i++) {
+		h ^= (uint8_t)p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+int CCStringPool::findSlot(const char* p, size_t len, uint32_t h) {
+	size_t mask = m_slots.size() - 1;
+	size_t i = h & mask;
+	while(true) {
+		int code = m_slots[i];
+		if(code < 0)
+			return (int)i;
+
+		// compare hash first so most mismatches don't touch string
+		if(m_hashes[code] == h) {
+			const string& s = m_strings[code];
+			if(s.length() == len && (len == 0 || memcmp(s.data(), p, len) == 0))
+				return (int)i;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+void CCStringPool::grow() {
+	vector<int> slots(m_slots.size() * 2, -1);
+	size_t mask = slots.size() - 1;
+	for(int code = 0; code < m_strings.size(); code++) {
+		size_t i = m_hashes[code] & mask;
+		while(slots[i] >= 0)
+			i = (i + 1) & mask;
+		slots[i] = code;
+	}
+	m_slots.swap(slots);
+}
+
+int CCStringPool::intern(const char* p, size_t len) {
+	uint32_t h = hash(p, len);
+	int slot = findSlot(p, len, h);
+	if(m_slots[slot] >= 0)
+		return m_slots[slot];
+
+	// add, keep load factor under 1/2
+	int code = (int)m_strings.size();
+	m_strings.push_back(string(p, len));
+	m_hashes.push_back(h);
+	m_slots[slot] = code;
+	m_bytes += len;
+	if(m_strings.size() * 2 > m_slots.size())
+		grow();
+	return code;
+}
+
+int CCStringPool::codeForString(const string& s) {
+	int slot = findSlot(s.data(), s.length(), hash(s.data(), s.length()));
+	return m_slots[slot];
+}
+
+const string& CCStringPool::stringForCode(int code) {
+	if(code < 0 || code >= m_strings.size())
+		return s_emptyString;
+	return m_strings[code];
+}
+
+NS_CC_END
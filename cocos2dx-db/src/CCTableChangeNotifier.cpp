@@ -0,0 +1,238 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCTableChangeNotifier.h"
+#include "CCDatabase.h"
+#include "CCUtils.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+CCTableChange::CCTableChange(const string& table) :
+		m_tableName(table) {
+}
+
+CCTableChange::~CCTableChange() {
+}
+
+void CCTableChange::record(int op, int64_t rowId) {
+	RowOpMap::iterator iter = m_ops.find(rowId);
+	if(iter == m_ops.end()) {
+		m_ops[rowId] = op;
+		return;
+	}
+
+	// merge with earlier operation of same row
+	int old = iter->second;
+	if(old == SQLITE_INSERT) {
+		if(op == SQLITE_DELETE)
+			m_ops.erase(iter);
+	} else if(old == SQLITE_DELETE) {
+		if(op == SQLITE_INSERT)
+			iter->second = SQLITE_UPDATE;
+	} else {
+		if(op == SQLITE_DELETE)
+			iter->second = SQLITE_DELETE;
+	}
+}
+
+void CCTableChange::build() {
+	for(RowOpMap::iterator iter = m_ops.begin(); iter != m_ops.end(); iter++) {
+		switch(iter->second) {
+			case SQLITE_INSERT:
+				m_inserted.push_back(iter->first);
+				break;
+			case SQLITE_DELETE:
+				m_deleted.push_back(iter->first);
+				break;
+			default:
+				m_updated.push_back(iter->first);
+				break;
+		}
+	}
+}
+
+CCTableChangeNotifier::CCTableChangeNotifier(CCDatabase* db) :
+		m_db(db),
+		m_scheduled(false) {
+}
+
+CCTableChangeNotifier::~CCTableChangeNotifier() {
+	reset();
+}
+
+CCTableChangeNotifier* CCTableChangeNotifier::create(CCDatabase* db) {
+	CCTableChangeNotifier* n = new CCTableChangeNotifier(db);
+	return (CCTableChangeNotifier*)n->autorelease();
+}
+
+void CCTableChangeNotifier::releaseChanges(ChangeMap& changes) {
+	for(ChangeMap::iterator iter = changes.begin(); iter != changes.end(); iter++) {
+		iter->second->release();
+	}
+	changes.clear();
+}
+
+void CCTableChangeNotifier::addObserver(CCObject* target, SEL_CallFuncO selector, string table, int64_t rowId) {
+	Observer o;
+	o.target = target;
+	o.selector = selector;
+	o.table = table;
+	CCUtils::toLowercase(o.table);
+	o.rowId = rowId;
+	o.hasRowId = rowId >= 0;
+	m_observers.push_back(o);
+}
+
+void CCTableChangeNotifier::removeObserver(CCObject* target, string table) {
+	CCUtils::toLowercase(table);
+	for(ObserverList::iterator iter = m_observers.begin(); iter != m_observers.end();) {
+		if(iter->target == target && (table.empty() || iter->table == table))
+			iter = m_observers.erase(iter);
+		else
+			iter++;
+	}
+}
+
+bool CCTableChangeNotifier::isObserved(const string& table) {
+	for(ObserverList::iterator iter = m_observers.begin(); iter != m_observers.end(); iter++) {
+		if(iter->table == table)
+			return true;
+	}
+	return false;
+}
+
+bool CCTableChangeNotifier::isRegistered(const Observer& o) {
+	for(ObserverList::iterator iter = m_observers.begin(); iter != m_observers.end(); iter++) {
+		if(iter->target == o.target && iter->selector == o.selector && iter->table == o.table && iter->rowId == o.rowId)
+			return true;
+	}
+	return false;
+}
+
+void CCTableChangeNotifier::recordChange(int op, const char* table, int64_t rowId) {
+	string key = table;
+	CCUtils::toLowercase(key);
+	if(!isObserved(key))
+		return;
+
+	ChangeMap::iterator iter = m_pending.find(key);
+	CCTableChange* change;
+	if(iter == m_pending.end()) {
+		change = new CCTableChange(table);
+		m_pending[key] = change;
+	} else {
+		change = iter->second;
+	}
+	change->record(op, rowId);
+}
+
+void CCTableChangeNotifier::commit() {
+	if(m_pending.empty())
+		return;
+
+	// seal batch, it is confirmed when transaction is ended
+	for(ChangeMap::iterator iter = m_pending.begin(); iter != m_pending.end(); iter++) {
+		iter->second->build();
+	}
+	m_sealed.push_back(ChangeMap());
+	m_sealed.back().swap(m_pending);
+
+	// deliver in next tick, scheduler retains us while scheduled
+	if(!m_scheduled) {
+		m_scheduled = true;
+		CCDirector::sharedDirector()->getScheduler()->scheduleSelector(schedule_selector(CCTableChangeNotifier::deliver), this, 0, false);
+	}
+}
+
+void CCTableChangeNotifier::rollback() {
+	// commit hook runs before commit can fail with busy, so sealed batches may be rolled back too
+	releaseChanges(m_pending);
+	while(!m_sealed.empty()) {
+		releaseChanges(m_sealed.front());
+		m_sealed.pop_front();
+	}
+}
+
+void CCTableChangeNotifier::confirm() {
+	if(m_sealed.empty())
+		return;
+	sqlite3* handle = m_db ? m_db->sqliteHandle() : NULL;
+	if(handle && sqlite3_get_autocommit(handle))
+		m_committed.splice(m_committed.end(), m_sealed);
+}
+
+void CCTableChangeNotifier::reset() {
+	releaseChanges(m_pending);
+	while(!m_sealed.empty()) {
+		releaseChanges(m_sealed.front());
+		m_sealed.pop_front();
+	}
+	while(!m_committed.empty()) {
+		releaseChanges(m_committed.front());
+		m_committed.pop_front();
+	}
+	if(m_scheduled) {
+		m_scheduled = false;
+		CCDirector::sharedDirector()->getScheduler()->unscheduleSelector(schedule_selector(CCTableChangeNotifier::deliver), this);
+	}
+}
+
+void CCTableChangeNotifier::deliver(float delta) {
+	// a failed commit leaves transaction open, wait until it ends
+	confirm();
+	if(!m_sealed.empty())
+		return;
+
+	// stop ticking before callbacks, they may commit again
+	m_scheduled = false;
+	CCDirector::sharedDirector()->getScheduler()->unscheduleSelector(schedule_selector(CCTableChangeNotifier::deliver), this);
+
+	// keep alive during callbacks
+	retain();
+	list<ChangeMap> batches;
+	batches.swap(m_committed);
+	for(list<ChangeMap>::iterator b = batches.begin(); b != batches.end(); b++) {
+		for(ChangeMap::iterator c = b->begin(); c != b->end(); c++) {
+			CCTableChange* change = c->second;
+			if(change->isEmpty())
+				continue;
+
+			// observers may be removed by callbacks
+			ObserverList observers = m_observers;
+			for(ObserverList::iterator o = observers.begin(); o != observers.end(); o++) {
+				if(o->table != c->first)
+					continue;
+				if(o->hasRowId && !change->containsRow(o->rowId))
+					continue;
+				if(!isRegistered(*o))
+					continue;
+				(o->target->*o->selector)(change);
+			}
+		}
+		releaseChanges(*b);
+	}
+	release();
+}
+
+NS_CC_END
@@ -0,0 +1,492 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCTileChunkStore.h"
+#include "CCDatabase.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+///////////////////////////////////////////////////
+// jobs
+
+class CCTileChunkStore::LoadJob : public CCDatabaseWorker::Job {
+private:
+	CCTileChunkStore* m_owner;
+	ChunkKey m_key;
+	string m_sql;
+	size_t m_tileCount;
+	vector<uint32_t>* m_gids;
+
+public:
+	LoadJob(CCTileChunkStore* owner, const ChunkKey& key, const string& table, size_t tileCount) :
+			m_owner(owner),
+			m_key(key),
+			m_sql("SELECT data FROM " + CCDatabase::quoteIdentifier(table) + " WHERE layer = ? AND cx = ? AND cy = ?"),
+			m_tileCount(tileCount),
+			m_gids(NULL) {
+	}
+
+	virtual ~LoadJob() {
+		delete m_gids;
+	}
+
+	virtual void run(sqlite3* db) {
+		// empty chunk by default
+		m_gids = new vector<uint32_t>(m_tileCount, 0);
+		if(!db)
+			return;
+
+		// query
+		sqlite3_stmt* pStmt = NULL;
+		if(sqlite3_prepare_v2(db, m_sql.c_str(), -1, &pStmt, 0) != SQLITE_OK) {
+			CCLOGERROR("CCTileChunkStore: DB Error: \"%s\"", sqlite3_errmsg(db));
+			sqlite3_finalize(pStmt);
+			return;
+		}
+		sqlite3_bind_text(pStmt, 1, m_key.layer.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(pStmt, 2, m_key.cx);
+		sqlite3_bind_int(pStmt, 3, m_key.cy);
+		if(sqlite3_step(pStmt) == SQLITE_ROW) {
+			size_t bytes = MIN((size_t)sqlite3_column_bytes(pStmt, 0), m_tileCount * sizeof(uint32_t));
+			const void* data = sqlite3_column_blob(pStmt, 0);
+			if(data)
+				memcpy(&m_gids->front(), data, bytes);
+		}
+		sqlite3_finalize(pStmt);
+	}
+
+	virtual void done() {
+		m_owner->onChunkLoaded(m_key, m_gids);
+		m_gids = NULL;
+	}
+};
+
+class CCTileChunkStore::SaveJob : public CCDatabaseWorker::Job {
+private:
+	CCTileChunkStore* m_owner;
+	ChunkKey m_key;
+	string m_sql;
+	vector<uint32_t> m_gids;
+
+public:
+	SaveJob(CCTileChunkStore* owner, const ChunkKey& key, const string& table, const uint32_t* gids, size_t tileCount) :
+			m_owner(owner),
+			m_key(key),
+			m_sql("INSERT OR REPLACE INTO " + CCDatabase::quoteIdentifier(table) + " (layer, cx, cy, data) VALUES (?, ?, ?, ?)"),
+			m_gids(gids, gids + tileCount) {
+	}
+
+	virtual void run(sqlite3* db) {
+		if(!db)
+			return;
+
+		sqlite3_stmt* pStmt = NULL;
+		if(sqlite3_prepare_v2(db, m_sql.c_str(), -1, &pStmt, 0) != SQLITE_OK) {
+			CCLOGERROR("CCTileChunkStore: DB Error: \"%s\"", sqlite3_errmsg(db));
+			sqlite3_finalize(pStmt);
+			return;
+		}
+		sqlite3_bind_text(pStmt, 1, m_key.layer.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(pStmt, 2, m_key.cx);
+		sqlite3_bind_int(pStmt, 3, m_key.cy);
+		sqlite3_bind_blob(pStmt, 4, &m_gids.front(), (int)(m_gids.size() * sizeof(uint32_t)), SQLITE_STATIC);
+		if(sqlite3_step(pStmt) != SQLITE_DONE) {
+			CCLOGERROR("CCTileChunkStore: failed to save chunk (%d, %d): \"%s\"", m_key.cx, m_key.cy, sqlite3_errmsg(db));
+		}
+		sqlite3_finalize(pStmt);
+	}
+
+	virtual void done() {
+		// main connection doesn't see worker writes
+		m_owner->m_db->invalidateTable(m_owner->m_table);
+	}
+};
+
+class CCTileChunkStore::ImportJob : public CCDatabaseWorker::Job {
+private:
+	CCTileChunkStore* m_owner;
+	string m_layer;
+	string m_deleteSQL;
+	string m_insertSQL;
+	size_t m_tileCount;
+
+	/// chunk coordinates in pairs, and their gids one chunk after another
+	vector<int> m_coords;
+	vector<uint32_t> m_gids;
+
+public:
+	ImportJob(CCTileChunkStore* owner, const string& layer, const string& table, size_t tileCount) :
+			m_owner(owner),
+			m_layer(layer),
+			m_deleteSQL("DELETE FROM " + CCDatabase::quoteIdentifier(table) + " WHERE layer = ?"),
+			m_insertSQL("INSERT INTO " + CCDatabase::quoteIdentifier(table) + " (layer, cx, cy, data) VALUES (?, ?, ?, ?)"),
+			m_tileCount(tileCount) {
+	}
+
+	void addChunk(int cx, int cy, const uint32_t* gids) {
+		m_coords.push_back(cx);
+		m_coords.push_back(cy);
+		m_gids.insert(m_gids.end(), gids, gids + m_tileCount);
+	}
+
+	virtual void run(sqlite3* db) {
+		if(!db)
+			return;
+
+		// old rows of layer are deleted so that chunks empty now don't survive
+		sqlite3_stmt* del = NULL;
+		sqlite3_stmt* insert = NULL;
+		if(sqlite3_prepare_v2(db, m_deleteSQL.c_str(), -1, &del, 0) != SQLITE_OK ||
+		   sqlite3_prepare_v2(db, m_insertSQL.c_str(), -1, &insert, 0) != SQLITE_OK) {
+			CCLOGERROR("CCTileChunkStore: DB Error: \"%s\"", sqlite3_errmsg(db));
+			sqlite3_finalize(del);
+			sqlite3_finalize(insert);
+			return;
+		}
+		bool ok = sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL) == SQLITE_OK;
+		if(ok) {
+			sqlite3_bind_text(del, 1, m_layer.c_str(), -1, SQLITE_STATIC);
+			ok = sqlite3_step(del) == SQLITE_DONE;
+		}
+		for(size_t i = 0; ok && i < m_coords.size() / 2; i++) {
+			sqlite3_bind_text(insert, 1, m_layer.c_str(), -1, SQLITE_STATIC);
+			sqlite3_bind_int(insert, 2, m_coords[i * 2]);
+			sqlite3_bind_int(insert, 3, m_coords[i * 2 + 1]);
+			sqlite3_bind_blob(insert, 4, &m_gids[i * m_tileCount], (int)(m_tileCount * sizeof(uint32_t)), SQLITE_STATIC);
+			ok = sqlite3_step(insert) == SQLITE_DONE;
+			sqlite3_reset(insert);
+		}
+		sqlite3_finalize(del);
+		sqlite3_finalize(insert);
+		if(!ok || sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
+			CCLOGERROR("CCTileChunkStore: failed to import layer %s: \"%s\"", m_layer.c_str(), sqlite3_errmsg(db));
+			sqlite3_exec(db, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+		}
+	}
+
+	virtual void done() {
+		// main connection doesn't see worker writes
+		m_owner->m_db->invalidateTable(m_owner->m_table);
+	}
+};
+
+///////////////////////////////////////////////////
+// store
+
+CCTileChunkStore::CCTileChunkStore() :
+		m_worker(NULL),
+		m_db(NULL),
+		m_delegate(NULL),
+		m_cameraChunkX(0),
+		m_cameraChunkY(0),
+		m_hasCamera(false),
+		m_chunkSize(32),
+		m_loadRadius(1),
+		m_unloadRadius(2) {
+}
+
+CCTileChunkStore::~CCTileChunkStore() {
+	// save modified chunks before stopping worker
+	if(m_worker) {
+		flush();
+		m_worker->waitUntilIdle();
+		m_worker->stop();
+		m_worker->release();
+	}
+	CC_SAFE_RELEASE(m_db);
+
+	// release chunks
+	for(ChunkMap::iterator iter = m_chunks.begin(); iter != m_chunks.end(); iter++) {
+		delete iter->second;
+	}
+}
+
+CCTileChunkStore* CCTileChunkStore::create(CCDatabase* db, int chunkSize, string table) {
+	CCTileChunkStore* s = new CCTileChunkStore();
+	if(s->initWithDatabase(db, chunkSize, table)) {
+		return (CCTileChunkStore*)s->autorelease();
+	}
+	s->release();
+	return NULL;
+}
+
+bool CCTileChunkStore::initWithDatabase(CCDatabase* db, int chunkSize, string table) {
+	// in-memory or resident database can't be shared with worker
+	if(!db->isFileShared()) {
+		CCLOGERROR("CCTileChunkStore: in-memory or resident database can't be streamed by worker");
+		return false;
+	}
+
+	// create table
+	if(!db->executeUpdate("CREATE TABLE IF NOT EXISTS %s (layer TEXT, cx INTEGER, cy INTEGER, data BLOB, PRIMARY KEY(layer, cx, cy))",
+			CCDatabase::quoteIdentifier(table).c_str())) {
+		CCLOGERROR("CCTileChunkStore: failed to create table %s", table.c_str());
+		return false;
+	}
+
+	m_table = table;
+	m_chunkSize = MAX(1, chunkSize);
+	m_worker = CCDatabaseWorker::create(db->getDatabasePath());
+	m_worker->retain();
+	m_db = db;
+	m_db->retain();
+
+	return true;
+}
+
+int CCTileChunkStore::chunkCoord(int tile) {
+	// floor division so that negative tiles map correctly
+	return tile >= 0 ? tile / m_chunkSize : -((-tile + m_chunkSize - 1) / m_chunkSize);
+}
+
+bool CCTileChunkStore::isInRadius(int cx, int cy, int radius) {
+	return abs(cx - m_cameraChunkX) <= radius && abs(cy - m_cameraChunkY) <= radius;
+}
+
+void CCTileChunkStore::bindLayer(string layer, CCTMXLayer* tmxLayer) {
+	m_layers[layer] = tmxLayer;
+}
+
+void CCTileChunkStore::unbindLayer(string layer) {
+	// unload its chunks
+	for(ChunkMap::iterator iter = m_chunks.begin(); iter != m_chunks.end();) {
+		if(iter->first.layer == layer) {
+			unapplyChunk(iter->first, iter->second);
+			if(iter->second->dirty)
+				postSave(iter->first, &iter->second->gids.front());
+			delete iter->second;
+			m_chunks.erase(iter++);
+		} else {
+			iter++;
+		}
+	}
+
+	m_layers.erase(layer);
+}
+
+void CCTileChunkStore::updateCamera(const CCPoint& tileCoord) {
+	int cx = chunkCoord((int)floorf(tileCoord.x));
+	int cy = chunkCoord((int)floorf(tileCoord.y));
+	if(m_hasCamera && cx == m_cameraChunkX && cy == m_cameraChunkY)
+		return;
+	m_cameraChunkX = cx;
+	m_cameraChunkY = cy;
+	m_hasCamera = true;
+
+	// unload far chunks, modified chunks are saved first
+	int unloadRadius = MAX(m_unloadRadius, m_loadRadius);
+	for(ChunkMap::iterator iter = m_chunks.begin(); iter != m_chunks.end();) {
+		if(!isInRadius(iter->first.cx, iter->first.cy, unloadRadius)) {
+			unapplyChunk(iter->first, iter->second);
+			if(iter->second->dirty)
+				postSave(iter->first, &iter->second->gids.front());
+			delete iter->second;
+			m_chunks.erase(iter++);
+		} else {
+			iter++;
+		}
+	}
+
+	// load near chunks, nearest first
+	size_t tileCount = m_chunkSize * m_chunkSize;
+	for(int r = 0; r <= m_loadRadius; r++) {
+		for(int y = cy - r; y <= cy + r; y++) {
+			for(int x = cx - r; x <= cx + r; x++) {
+				// only ring of this radius
+				if(abs(x - cx) != r && abs(y - cy) != r)
+					continue;
+
+				for(LayerMap::iterator iter = m_layers.begin(); iter != m_layers.end(); iter++) {
+					ChunkKey key(iter->first, x, y);
+					if(m_chunks.find(key) != m_chunks.end() || m_loadingChunks.find(key) != m_loadingChunks.end())
+						continue;
+					m_loadingChunks.insert(key);
+					m_worker->post(new LoadJob(this, key, m_table, tileCount));
+				}
+			}
+		}
+	}
+}
+
+void CCTileChunkStore::onChunkLoaded(const ChunkKey& key, vector<uint32_t>* gids) {
+	m_loadingChunks.erase(key);
+
+	// camera may move away or layer may be unbound
+	if(!gids || m_layers.find(key.layer) == m_layers.end() || !isInRadius(key.cx, key.cy, MAX(m_unloadRadius, m_loadRadius))) {
+		delete gids;
+		return;
+	}
+
+	// save chunk
+	Chunk* chunk = new Chunk();
+	chunk->gids.swap(*gids);
+	chunk->dirty = false;
+	delete gids;
+	m_chunks[key] = chunk;
+
+	// feed
+	applyChunk(key, chunk);
+}
+
+void CCTileChunkStore::applyChunk(const ChunkKey& key, Chunk* chunk) {
+	// tmx layer
+	CCTMXLayer* tmxLayer = m_layers[key.layer];
+	if(tmxLayer) {
+		CCSize size = tmxLayer->getLayerSize();
+		int x0 = key.cx * m_chunkSize;
+		int y0 = key.cy * m_chunkSize;
+		for(int y = MAX(0, y0); y < MIN((int)size.height, y0 + m_chunkSize); y++) {
+			for(int x = MAX(0, x0); x < MIN((int)size.width, x0 + m_chunkSize); x++) {
+				unsigned int gid = chunk->gids[(y - y0) * m_chunkSize + (x - x0)];
+				CCPoint pos = ccp(x, y);
+				if(gid != 0)
+					tmxLayer->setTileGID(gid, pos);
+				else if(tmxLayer->tileGIDAt(pos) != 0)
+					tmxLayer->removeTileAt(pos);
+			}
+		}
+	}
+
+	// delegate
+	if(m_delegate)
+		m_delegate->onTileChunkLoaded(this, key.layer, key.cx, key.cy, &chunk->gids.front());
+}
+
+void CCTileChunkStore::unapplyChunk(const ChunkKey& key, Chunk* chunk) {
+	// tmx layer, remove tiles so that their sprites are freed
+	CCTMXLayer* tmxLayer = m_layers[key.layer];
+	if(tmxLayer) {
+		CCSize size = tmxLayer->getLayerSize();
+		int x0 = key.cx * m_chunkSize;
+		int y0 = key.cy * m_chunkSize;
+		for(int y = MAX(0, y0); y < MIN((int)size.height, y0 + m_chunkSize); y++) {
+			for(int x = MAX(0, x0); x < MIN((int)size.width, x0 + m_chunkSize); x++) {
+				CCPoint pos = ccp(x, y);
+				if(tmxLayer->tileGIDAt(pos) != 0)
+					tmxLayer->removeTileAt(pos);
+			}
+		}
+	}
+
+	// delegate
+	if(m_delegate)
+		m_delegate->onTileChunkUnloaded(this, key.layer, key.cx, key.cy);
+}
+
+void CCTileChunkStore::postSave(const ChunkKey& key, const uint32_t* gids) {
+	m_worker->post(new SaveJob(this, key, m_table, gids, m_chunkSize * m_chunkSize));
+}
+
+unsigned int CCTileChunkStore::tileGIDAt(string layer, int x, int y) {
+	int cx = chunkCoord(x);
+	int cy = chunkCoord(y);
+	ChunkMap::iterator iter = m_chunks.find(ChunkKey(layer, cx, cy));
+	if(iter == m_chunks.end())
+		return 0;
+	return iter->second->gids[(y - cy * m_chunkSize) * m_chunkSize + (x - cx * m_chunkSize)];
+}
+
+bool CCTileChunkStore::setTileGID(string layer, int x, int y, unsigned int gid) {
+	int cx = chunkCoord(x);
+	int cy = chunkCoord(y);
+	ChunkMap::iterator iter = m_chunks.find(ChunkKey(layer, cx, cy));
+	if(iter == m_chunks.end())
+		return false;
+
+	// update chunk
+	iter->second->gids[(y - cy * m_chunkSize) * m_chunkSize + (x - cx * m_chunkSize)] = gid;
+	iter->second->dirty = true;
+
+	// update tmx layer
+	CCTMXLayer* tmxLayer = m_layers[layer];
+	if(tmxLayer) {
+		CCSize size = tmxLayer->getLayerSize();
+		if(x >= 0 && y >= 0 && x < size.width && y < size.height) {
+			CCPoint pos = ccp(x, y);
+			if(gid != 0)
+				tmxLayer->setTileGID(gid, pos);
+			else if(tmxLayer->tileGIDAt(pos) != 0)
+				tmxLayer->removeTileAt(pos);
+		}
+	}
+
+	return true;
+}
+
+void CCTileChunkStore::syncLoadedChunk(const ChunkKey& key, const uint32_t* gids) {
+	ChunkMap::iterator iter = m_chunks.find(key);
+	if(iter != m_chunks.end()) {
+		memcpy(&iter->second->gids.front(), gids, m_chunkSize * m_chunkSize * sizeof(uint32_t));
+		iter->second->dirty = false;
+		applyChunk(key, iter->second);
+	}
+}
+
+void CCTileChunkStore::saveChunk(string layer, int cx, int cy, const uint32_t* gids) {
+	ChunkKey key(layer, cx, cy);
+	postSave(key, gids);
+
+	// keep loaded copy in sync
+	syncLoadedChunk(key, gids);
+}
+
+void CCTileChunkStore::importLayer(string layer, CCTMXLayer* tmxLayer) {
+	CCSize size = tmxLayer->getLayerSize();
+	int width = (int)size.width;
+	int height = (int)size.height;
+	vector<uint32_t> gids(m_chunkSize * m_chunkSize);
+	ImportJob* job = new ImportJob(this, layer, m_table, gids.size());
+	for(int cy = 0; cy * m_chunkSize < height; cy++) {
+		for(int cx = 0; cx * m_chunkSize < width; cx++) {
+			// collect gids of chunk
+			bool empty = true;
+			for(int y = 0; y < m_chunkSize; y++) {
+				for(int x = 0; x < m_chunkSize; x++) {
+					int tx = cx * m_chunkSize + x;
+					int ty = cy * m_chunkSize + y;
+					uint32_t gid = (tx < width && ty < height) ? tmxLayer->tileGIDAt(ccp(tx, ty)) : 0;
+					gids[y * m_chunkSize + x] = gid;
+					empty = empty && gid == 0;
+				}
+			}
+
+			// empty chunk needs no row, but loaded copy is still cleared
+			if(!empty)
+				job->addChunk(cx, cy, &gids.front());
+			syncLoadedChunk(ChunkKey(layer, cx, cy), &gids.front());
+		}
+	}
+	m_worker->post(job);
+}
+
+void CCTileChunkStore::flush() {
+	for(ChunkMap::iterator iter = m_chunks.begin(); iter != m_chunks.end(); iter++) {
+		if(iter->second->dirty) {
+			postSave(iter->first, &iter->second->gids.front());
+			iter->second->dirty = false;
+		}
+	}
+}
+
+NS_CC_END
@@ -0,0 +1,140 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "CCVariantRow.h"
+#include "sqlite3.h"
+
+NS_CC_BEGIN
+
+CCVariantRow::CCVariantRow() {
+}
+
+CCVariantRow::~CCVariantRow() {
+}
+
+void CCVariantRow::clear() {
+	m_cells.clear();
+	m_spill.clear();
+}
+
+void CCVariantRow::decode(sqlite3_stmt* stmt) {
+	// buffers keep capacity
+	int count = sqlite3_column_count(stmt);
+	m_cells.resize(count);
+	m_spill.clear();
+
+	for(int i = 0; i < count; i++) {
+		Cell& c = m_cells[i];
+		c.type = sqlite3_column_type(stmt, i);
+		c.isInline = false;
+		switch(c.type) {
+			case SQLITE_INTEGER:
+				c.v.i = sqlite3_column_int64(stmt, i);
+				break;
+			case SQLITE_FLOAT:
+				c.v.d = sqlite3_column_double(stmt, i);
+				break;
+			case SQLITE_TEXT:
+			case SQLITE_BLOB:
+			{
+				const char* p = c.type == SQLITE_TEXT ? (const char*)sqlite3_column_text(stmt, i) : (const char*)sqlite3_column_blob(stmt, i);
+				int len = sqlite3_column_bytes(stmt, i);
+				if(!p)
+					len = 0;
+
+				// inline if it fits with terminator
+				if(len < INLINE_SIZE) {
+					c.isInline = true;
+					c.inlineLength = len;
+					if(len > 0)
+						memcpy(c.v.bytes, p, len);
+					c.v.bytes[len] = 0;
+				} else {
+					c.v.spill.offset = (uint32_t)m_spill.size();
+					c.v.spill.length = len;
+					m_spill.insert(m_spill.end(), p, p + len);
+					m_spill.push_back(0);
+				}
+				break;
+			}
+			default:
+				c.v.i = 0;
+				break;
+		}
+	}
+}
+
+int CCVariantRow::typeAt(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_cells.size())
+		return SQLITE_NULL;
+	return m_cells[columnIdx].type;
+}
+
+bool CCVariantRow::isNull(int columnIdx) {
+	return typeAt(columnIdx) == SQLITE_NULL;
+}
+
+int64_t CCVariantRow::int64At(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_cells.size())
+		return 0;
+	Cell& c = m_cells[columnIdx];
+	switch(c.type) {
+		case SQLITE_INTEGER:
+			return c.v.i;
+		case SQLITE_FLOAT:
+			return (int64_t)c.v.d;
+		case SQLITE_TEXT:
+			return strtoll(bytesAt(columnIdx).bytes, NULL, 10);
+		default:
+			return 0;
+	}
+}
+
+double CCVariantRow::doubleAt(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_cells.size())
+		return 0;
+	Cell& c = m_cells[columnIdx];
+	switch(c.type) {
+		case SQLITE_INTEGER:
+			return (double)c.v.i;
+		case SQLITE_FLOAT:
+			return c.v.d;
+		case SQLITE_TEXT:
+			return strtod(bytesAt(columnIdx).bytes, NULL);
+		default:
+			return 0;
+	}
+}
+
+CCDataView CCVariantRow::bytesAt(int columnIdx) {
+	if(columnIdx < 0 || columnIdx >= m_cells.size())
+		return CCDataView();
+	Cell& c = m_cells[columnIdx];
+	if(c.type != SQLITE_TEXT && c.type != SQLITE_BLOB)
+		return CCDataView();
+	if(c.isInline)
+		return CCDataView(c.v.bytes, c.inlineLength);
+	return CCDataView(&m_spill[c.v.spill.offset], c.v.spill.length);
+}
+
+NS_CC_END
@@ -2,16 +2,37 @@
 #include "../testResource.h"
 #include "cocos2d.h"
 #include "CCUtils.h"
-#include "CCDatabase.h"
+#include "cocos2d-db.h"
+
+// entity used by entity table demo
+struct DemoItem {
+	int64_t id;
+	string name;
+	int count;
+};
+
+CC_DB_TABLE_BEGIN(DemoItem, "item")
+	CC_DB_KEY(id)
+	CC_DB_COLUMN(name)
+	CC_DB_COLUMN(count)
+CC_DB_TABLE_END(DemoItem)
 
 TESTLAYER_CREATE_FUNC(DBCreateDatabase);
 TESTLAYER_CREATE_FUNC(DBSQLFile);
 TESTLAYER_CREATE_FUNC(DBTransaction);
+TESTLAYER_CREATE_FUNC(DBEntityTable);
+TESTLAYER_CREATE_FUNC(DBKeyValueStore);
+TESTLAYER_CREATE_FUNC(DBResident);
+TESTLAYER_CREATE_FUNC(DBAsyncOpen);
 
 static NEWTESTFUNC createFunctions[] = {
     CF(DBCreateDatabase),
 	CF(DBSQLFile),
-	CF(DBTransaction)
+	CF(DBTransaction),
+	CF(DBEntityTable),
+	CF(DBKeyValueStore),
+	CF(DBResident),
+	CF(DBAsyncOpen)
 };
 
 static int sceneIdx=-1;
@@ -265,6 +286,8 @@ DBTransaction::DBTransaction() :
 }
 
 DBTransaction::~DBTransaction() {
+	if(m_db)
+		m_db->removeTableObserver(this);
 	CC_SAFE_RELEASE(m_db);
 }
 
@@ -300,11 +323,9 @@ void DBTransaction::onEnter()
 	if(!m_db->tableExists("test"))
 		m_db->executeUpdate("CREATE TABLE test (_id INTEGER PRIMARY KEY autoincrement, test_column INTEGER)");
 	
-	// query the value inserted
-	int rowCount = m_db->intForQuery("SELECT count() FROM test");
-	char buf[64];
-	sprintf(buf, "row count: %d", rowCount);
-	m_hintLabel->setString(buf);
+	// label is refreshed by observer when committed changes are delivered, no polling
+	m_db->addTableObserver(this, callfuncO_selector(DBTransaction::onTestTableChanged), "test");
+	onTestTableChanged(NULL);
 }
 
 string DBTransaction::subtitle()
@@ -322,13 +343,7 @@ void DBTransaction::onInsertClicked() {
 }
 
 void DBTransaction::onCommitClicked() {
-	if(m_db->commit()) {
-		// query the value inserted
-		int rowCount = m_db->intForQuery("SELECT count() from test");
-		char buf[64];
-		sprintf(buf, "row count: %d", rowCount);
-		m_hintLabel->setString(buf);
-	} else {
+	if(!m_db->commit()) {
 		m_hintLabel->setString("commit transaction failed");
 	}
 }
@@ -339,4 +354,288 @@ void DBTransaction::onRollbackClicked() {
 	} else {
 		m_hintLabel->setString("rollback transaction failed");
 	}
-}
\ No newline at end of file
+}
+
+void DBTransaction::onTestTableChanged(CCObject* change) {
+	// change is NULL for first refresh
+	int rowCount = m_db->intForQuery("SELECT count() FROM test");
+	char buf[64];
+	if(change)
+		sprintf(buf, "row count: %d, %d rows inserted", rowCount, (int)((CCTableChange*)change)->getInserted().size());
+	else
+		sprintf(buf, "row count: %d", rowCount);
+	m_hintLabel->setString(buf);
+}
+
+//------------------------------------------------------------------
+//
+// Entity Table
+//
+//------------------------------------------------------------------
+DBEntityTable::DBEntityTable() :
+		m_db(NULL) {
+}
+
+DBEntityTable::~DBEntityTable() {
+	CC_SAFE_RELEASE(m_db);
+}
+
+void DBEntityTable::onEnter()
+{
+    DBDemo::onEnter();
+	
+    CCSize visibleSize = CCDirector::sharedDirector()->getVisibleSize();
+	CCPoint origin = CCDirector::sharedDirector()->getVisibleOrigin();
+	
+	CCLabelTTF* label1 = CCLabelTTF::create("Insert Item", "Helvetica", 24);
+	CCMenuItemLabel* item1 = CCMenuItemLabel::create(label1, this, menu_selector(DBEntityTable::onInsertClicked));
+	CCLabelTTF* label2 = CCLabelTTF::create("Load All Items", "Helvetica", 24);
+	CCMenuItemLabel* item2 = CCMenuItemLabel::create(label2, this, menu_selector(DBEntityTable::onLoadAllClicked));
+	CCMenu* menu = CCMenu::create(item1, item2, NULL);
+	menu->alignItemsVertically();
+	menu->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 2));
+	addChild(menu);
+	
+	m_hintLabel = CCLabelTTF::create("", "Helvetica", 14);
+	m_hintLabel->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 6));
+	addChild(m_hintLabel);
+	
+	// open database and create table of entity
+	m_db = CCDatabase::create("/sdcard/entity_test.db");
+	m_db->open();
+	m_db->retain();
+	CCEntityTable<DemoItem>::create(m_db)->createTable();
+}
+
+string DBEntityTable::subtitle()
+{
+    return "Entity Table";
+}
+
+void DBEntityTable::onInsertClicked() {
+	// zero key means sqlite assigns it
+	DemoItem item;
+	item.id = 0;
+	item.name = "potion";
+	item.count = 1000 * CCRANDOM_0_1();
+	CCEntityTable<DemoItem>* items = CCEntityTable<DemoItem>::create(m_db);
+	if(items->insert(item)) {
+		char buf[64];
+		sprintf(buf, "inserted item %d, count %d", (int)item.id, item.count);
+		m_hintLabel->setString(buf);
+	} else {
+		m_hintLabel->setString("failed to insert item");
+	}
+}
+
+void DBEntityTable::onLoadAllClicked() {
+	vector<DemoItem> all;
+	CCEntityTable<DemoItem>::create(m_db)->loadAll(all);
+	char buf[64];
+	if(all.empty())
+		sprintf(buf, "no item");
+	else
+		sprintf(buf, "%d items, last is %d with count %d", (int)all.size(), (int)all.back().id, all.back().count);
+	m_hintLabel->setString(buf);
+}
+
+//------------------------------------------------------------------
+//
+// Key Value Store
+//
+//------------------------------------------------------------------
+DBKeyValueStore::DBKeyValueStore() :
+		m_db(NULL),
+		m_store(NULL) {
+}
+
+DBKeyValueStore::~DBKeyValueStore() {
+	// store flushes when it is destroyed
+	CC_SAFE_RELEASE(m_store);
+	CC_SAFE_RELEASE(m_db);
+}
+
+void DBKeyValueStore::onEnter()
+{
+    DBDemo::onEnter();
+	
+    CCSize visibleSize = CCDirector::sharedDirector()->getVisibleSize();
+	CCPoint origin = CCDirector::sharedDirector()->getVisibleOrigin();
+	
+	CCLabelTTF* label1 = CCLabelTTF::create("Increase Counter", "Helvetica", 24);
+	CCMenuItemLabel* item1 = CCMenuItemLabel::create(label1, this, menu_selector(DBKeyValueStore::onIncreaseClicked));
+	CCLabelTTF* label2 = CCLabelTTF::create("Flush", "Helvetica", 24);
+	CCMenuItemLabel* item2 = CCMenuItemLabel::create(label2, this, menu_selector(DBKeyValueStore::onFlushClicked));
+	CCMenu* menu = CCMenu::create(item1, item2, NULL);
+	menu->alignItemsVertically();
+	menu->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 2));
+	addChild(menu);
+	
+	m_hintLabel = CCLabelTTF::create("", "Helvetica", 14);
+	m_hintLabel->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 6));
+	addChild(m_hintLabel);
+	
+	// auto flush is on by default, so counter is saved a second after last click
+	m_db = CCDatabase::create("/sdcard/kv_test.db");
+	m_db->open();
+	m_db->retain();
+	m_store = CCKeyValueStore::create(m_db);
+	m_store->retain();
+	updateHint();
+}
+
+string DBKeyValueStore::subtitle()
+{
+    return "Key Value Store";
+}
+
+void DBKeyValueStore::onIncreaseClicked() {
+	m_store->setInt("demo", "counter", m_store->getInt("demo", "counter") + 1);
+	updateHint();
+}
+
+void DBKeyValueStore::onFlushClicked() {
+	m_store->flush();
+	m_store->waitUntilSaved();
+	updateHint();
+}
+
+void DBKeyValueStore::updateHint() {
+	char buf[64];
+	sprintf(buf, "counter: %d, unsaved values: %d", m_store->getInt("demo", "counter"), m_store->getDirtyCount());
+	m_hintLabel->setString(buf);
+}
+
+//------------------------------------------------------------------
+//
+// Resident
+//
+//------------------------------------------------------------------
+DBResident::DBResident() :
+		m_db(NULL) {
+}
+
+DBResident::~DBResident() {
+	// close writes back last changes and stops timer
+	if(m_db)
+		m_db->close();
+	CC_SAFE_RELEASE(m_db);
+}
+
+void DBResident::onEnter()
+{
+    DBDemo::onEnter();
+	
+    CCSize visibleSize = CCDirector::sharedDirector()->getVisibleSize();
+	CCPoint origin = CCDirector::sharedDirector()->getVisibleOrigin();
+	
+	CCLabelTTF* label1 = CCLabelTTF::create("Insert One Row", "Helvetica", 24);
+	CCMenuItemLabel* item1 = CCMenuItemLabel::create(label1, this, menu_selector(DBResident::onInsertClicked));
+	CCLabelTTF* label2 = CCLabelTTF::create("Write Back", "Helvetica", 24);
+	CCMenuItemLabel* item2 = CCMenuItemLabel::create(label2, this, menu_selector(DBResident::onWriteBackClicked));
+	CCMenu* menu = CCMenu::create(item1, item2, NULL);
+	menu->alignItemsVertically();
+	menu->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 2));
+	addChild(menu);
+	
+	m_hintLabel = CCLabelTTF::create("", "Helvetica", 14);
+	m_hintLabel->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 6));
+	addChild(m_hintLabel);
+	
+	// file is loaded into memory, changes are written back every 5 seconds
+	m_db = CCDatabase::create("/sdcard/resident_test.db");
+	m_db->openResident(5);
+	m_db->retain();
+	if(!m_db->tableExists("test"))
+		m_db->executeUpdate("CREATE TABLE test (_id INTEGER PRIMARY KEY autoincrement, test_column INTEGER)");
+	updateHint();
+}
+
+string DBResident::subtitle()
+{
+    return "Memory Resident";
+}
+
+void DBResident::onInsertClicked() {
+	m_db->executeUpdate("INSERT INTO test (test_column) VALUES (%d)", (int)(1000 * CCRANDOM_0_1()));
+	updateHint();
+}
+
+void DBResident::onWriteBackClicked() {
+	m_db->writeBack(true);
+	updateHint();
+}
+
+void DBResident::updateHint() {
+	char buf[64];
+	sprintf(buf, "row count: %d, %s", m_db->intForQuery("SELECT count() FROM test"), m_db->isResidentDirty() ? "not written back" : "written back");
+	m_hintLabel->setString(buf);
+}
+
+//------------------------------------------------------------------
+//
+// Async Open
+//
+//------------------------------------------------------------------
+DBAsyncOpen::DBAsyncOpen() :
+		m_db(NULL) {
+}
+
+DBAsyncOpen::~DBAsyncOpen() {
+	// callback is not invoked if database is closed before opening is done
+	if(m_db)
+		m_db->close();
+	CC_SAFE_RELEASE(m_db);
+}
+
+void DBAsyncOpen::onEnter()
+{
+    DBDemo::onEnter();
+	
+    CCSize visibleSize = CCDirector::sharedDirector()->getVisibleSize();
+	CCPoint origin = CCDirector::sharedDirector()->getVisibleOrigin();
+	
+	CCLabelTTF* label1 = CCLabelTTF::create("Open In Background", "Helvetica", 24);
+	CCMenuItemLabel* item1 = CCMenuItemLabel::create(label1, this, menu_selector(DBAsyncOpen::onOpenClicked));
+	CCMenu* menu = CCMenu::create(item1, NULL);
+	menu->alignItemsVertically();
+	menu->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 2));
+	addChild(menu);
+	
+	m_hintLabel = CCLabelTTF::create("", "Helvetica", 14);
+	m_hintLabel->setPosition(ccp(origin.x + visibleSize.width / 2, origin.y + visibleSize.height / 6));
+	addChild(m_hintLabel);
+}
+
+string DBAsyncOpen::subtitle()
+{
+    return "Async Open";
+}
+
+void DBAsyncOpen::onOpenClicked() {
+	if(m_db) {
+		m_db->close();
+		CC_SAFE_RELEASE_NULL(m_db);
+	}
+	
+	// open and check integrity in worker
+	m_db = CCDatabase::create("/sdcard/async_open_test.db");
+	m_db->retain();
+	m_db->openAsync(this, callfuncO_selector(DBAsyncOpen::onOpened));
+	
+	// updates are queued until opening is done
+	m_db->executeUpdate("CREATE TABLE IF NOT EXISTS test (_id INTEGER PRIMARY KEY autoincrement, test_column INTEGER)");
+	m_db->executeUpdate("INSERT INTO test (test_column) VALUES (%d)", (int)(1000 * CCRANDOM_0_1()));
+	m_hintLabel->setString("opening...");
+}
+
+void DBAsyncOpen::onOpened(CCObject* db) {
+	char buf[128];
+	if(m_db->getOpenState() == kCCDatabaseOpenFailed) {
+		sprintf(buf, "failed to open: %s", m_db->getOpenMessage().c_str());
+	} else {
+		sprintf(buf, "state: %d, failed updates: %d, row count: %d", m_db->getOpenState(), m_db->getFailedUpdateCount(),
+				m_db->intForQuery("SELECT count() FROM test"));
+	}
+	m_hintLabel->setString(buf);
+}
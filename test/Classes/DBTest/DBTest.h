@@ -2,7 +2,7 @@
 #define _DBTest_H_
 
 #include "../testBasic.h"
-#include "CCDatabase.h"
+#include "cocos2d-db.h"
 
 using namespace std;
 USING_NS_CC;
@@ -13,6 +13,10 @@ enum
     DB_CREATE_DATABASE_LAYER = 0,
 	DB_SQL_FILE_LAYER,
 	DB_TRANSACTION_LAYER,
+	DB_ENTITY_TABLE_LAYER,
+	DB_KEY_VALUE_STORE_LAYER,
+	DB_RESIDENT_LAYER,
+	DB_ASYNC_OPEN_LAYER,
     DB_LAYER_COUNT,
 };
 
@@ -81,6 +85,74 @@ public:
 	void onInsertClicked();
 	void onCommitClicked();
 	void onRollbackClicked();
+	void onTestTableChanged(CCObject* change);
+};
+
+class DBEntityTable : public DBDemo
+{
+private:
+	CCLabelTTF* m_hintLabel;
+	CCDatabase* m_db;
+	
+public:
+	DBEntityTable();
+	virtual ~DBEntityTable();
+    virtual void onEnter();
+    virtual string subtitle();
+	
+	void onInsertClicked();
+	void onLoadAllClicked();
+};
+
+class DBKeyValueStore : public DBDemo
+{
+private:
+	CCLabelTTF* m_hintLabel;
+	CCDatabase* m_db;
+	CCKeyValueStore* m_store;
+	
+public:
+	DBKeyValueStore();
+	virtual ~DBKeyValueStore();
+    virtual void onEnter();
+    virtual string subtitle();
+	
+	void onIncreaseClicked();
+	void onFlushClicked();
+	void updateHint();
+};
+
+class DBResident : public DBDemo
+{
+private:
+	CCLabelTTF* m_hintLabel;
+	CCDatabase* m_db;
+	
+public:
+	DBResident();
+	virtual ~DBResident();
+    virtual void onEnter();
+    virtual string subtitle();
+	
+	void onInsertClicked();
+	void onWriteBackClicked();
+	void updateHint();
+};
+
+class DBAsyncOpen : public DBDemo
+{
+private:
+	CCLabelTTF* m_hintLabel;
+	CCDatabase* m_db;
+	
+public:
+	DBAsyncOpen();
+	virtual ~DBAsyncOpen();
+    virtual void onEnter();
+    virtual string subtitle();
+	
+	void onOpenClicked();
+	void onOpened(CCObject* db);
 };
 
 #endif
@@ -0,0 +1,66 @@
+/****************************************************************************
+ Author: Luma (stubma@gmail.com)
+ 
+ https://github.com/stubma/cocos2dx-db
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+/*
+ * schema2cpp: generate C++ row code from schema of a database
+ *
+ * usage: schema2cpp <database> <output header> [table...]
+ *
+ * It is a host tool and must be linked with cocos2dx-db and a desktop build of
+ * cocos2d-x and cocos2dx-common. Run it whenever content database schema changes and
+ * commit generated header with the database.
+ */
+#include "cocos2d.h"
+#include "cocos2d-db.h"
+#include <stdio.h>
+
+USING_NS_CC;
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		fprintf(stderr, "usage: %s <database> <output header> [table...]\n", argv[0]);
+		return 1;
+	}
+
+	// autoreleased objects are released when pool is released
+	CCPoolManager::sharedPoolManager()->push();
+
+	int ret = 0;
+	CCDatabase* db = CCDatabase::create(argv[1]);
+	if(!db->open()) {
+		fprintf(stderr, "can't open database %s\n", argv[1]);
+		ret = 1;
+	} else {
+		CCSchemaCodeGenerator* g = CCSchemaCodeGenerator::create(db);
+		for(int i = 3; i < argc; i++)
+			g->addTable(argv[i]);
+		if(!g->writeToFile(argv[2])) {
+			fprintf(stderr, "can't generate %s\n", argv[2]);
+			ret = 1;
+		}
+		db->close();
+	}
+
+	CCPoolManager::sharedPoolManager()->pop();
+	return ret;
+}